@@ -1,9 +1,89 @@
 #pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+// Incremental hashing: *_init, then *_update any number of times with chunks of any size, then *_final.
+// *_file hashes everything left in a stream through a fixed buffer, returns 0 or -1 on a read error.
+typedef struct {
+    uint32_t digest[5];
+    uint64_t length;    // bytes absorbed so far
+    int buffered;       // bytes in buffer waiting for a full block
+    char buffer[64];
+} sha1_ctx;
+
+typedef struct {
+    uint32_t digest[8];
+    uint64_t length;
+    int buffered;
+    char buffer[64];
+} sha256_ctx;
+
+typedef struct {
+    uint32_t digest[4];
+    uint64_t length;
+    int buffered;
+    char buffer[64];
+} md5_ctx;
 
 void sha1_to_string(char in[20], char out[40]);
-void sha1(const char* buffer, int length, char* out);
+void sha1(const char* buffer, int length, char out[20]);
 void sha1_print(char in[20]);
+void sha1_init(sha1_ctx* ctx);
+void sha1_update(sha1_ctx* ctx, const char* data, uint64_t length);
+void sha1_final(sha1_ctx* ctx, char out[20]);
+int sha1_file(FILE* file, char out[20]);
 
-void md5(const char* buffer, int length, char* out);
+void sha256(char* buffer, int length, char out[32]);
+void sha256_many(const char* const* msgs, const int* lens, int n, char* outs);
+void sha256_to_string(char in[32], char out[64]);
+void sha256_print(char in[32]);
+void sha256_init(sha256_ctx* ctx);
+void sha256_update(sha256_ctx* ctx, const char* data, uint64_t length);
+void sha256_final(sha256_ctx* ctx, char out[32]);
+int sha256_file(FILE* file, char out[32]);
+
+void md5(const char* buffer, int length, char out[16]);
 void md5_print(char in[16]);
-void test_md5();
\ No newline at end of file
+void md5_init(md5_ctx* ctx);
+void md5_update(md5_ctx* ctx, const char* data, uint64_t length);
+void md5_final(md5_ctx* ctx, char out[16]);
+int md5_file(FILE* file, char out[16]);
+void test_md5();
+
+// HMAC over one of the incremental hashes above
+typedef struct {
+    int digest_size;
+    void (*init)(void* ctx);
+    void (*update)(void* ctx, const char* data, uint64_t length);
+    void (*final)(void* ctx, char* out);
+} hmac_hash;
+
+extern const hmac_hash hmac_md5;
+extern const hmac_hash hmac_sha1;
+extern const hmac_hash hmac_sha256;
+
+typedef union {
+    md5_ctx md5;
+    sha1_ctx sha1;
+    sha256_ctx sha256;
+} hmac_hash_ctx;
+
+// A key prepared once: the hash states after absorbing key ^ ipad and key ^ opad.
+// It is never modified after hmac_init, so any number of messages can be MACed with it.
+typedef struct {
+    const hmac_hash* hash;
+    hmac_hash_ctx inner;
+    hmac_hash_ctx outer;
+} hmac_ctx;
+
+// One message being MACed in pieces with hmac_update
+typedef struct {
+    const hmac_ctx* key;
+    hmac_hash_ctx state;
+} hmac_state;
+
+void hmac_init(hmac_ctx* ctx, const hmac_hash* hash, const char* key, int key_length);
+void hmac_begin(const hmac_ctx* ctx, hmac_state* state);
+void hmac_update(hmac_state* state, const char* data, uint64_t length);
+void hmac_final(hmac_state* state, char* result);
+void hmac_compute(const hmac_ctx* ctx, const char* message, int message_length, char* result);
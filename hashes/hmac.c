@@ -7,6 +7,138 @@
 #define MAX(A, B) ((A > B) ? (A) : (B))
 #define MIN(A, B) ((A < B) ? (A) : (B))
 
+// ----------------------------------------------
+// Keyed contexts, nothing is allocated or copied
+// ----------------------------------------------
+
+#define HMAC_BLOCK_SIZE 64
+
+static void hmac_md5_init(void* ctx) { md5_init(ctx); }
+static void hmac_md5_update(void* ctx, const char* data, uint64_t length) { md5_update(ctx, data, length); }
+static void hmac_md5_final(void* ctx, char* out) { md5_final(ctx, out); }
+
+static void hmac_sha1_init(void* ctx) { sha1_init(ctx); }
+static void hmac_sha1_update(void* ctx, const char* data, uint64_t length) { sha1_update(ctx, data, length); }
+static void hmac_sha1_final(void* ctx, char* out) { sha1_final(ctx, out); }
+
+static void hmac_sha256_init(void* ctx) { sha256_init(ctx); }
+static void hmac_sha256_update(void* ctx, const char* data, uint64_t length) { sha256_update(ctx, data, length); }
+static void hmac_sha256_final(void* ctx, char* out) { sha256_final(ctx, out); }
+
+const hmac_hash hmac_md5 = { 16, hmac_md5_init, hmac_md5_update, hmac_md5_final };
+const hmac_hash hmac_sha1 = { 20, hmac_sha1_init, hmac_sha1_update, hmac_sha1_final };
+const hmac_hash hmac_sha256 = { 32, hmac_sha256_init, hmac_sha256_update, hmac_sha256_final };
+
+void
+hmac_init(hmac_ctx* ctx, const hmac_hash* hash, const char* key, int key_length) {
+    char temp_key[HMAC_BLOCK_SIZE] = {0};
+    char pad[HMAC_BLOCK_SIZE];
+
+    if(key_length > HMAC_BLOCK_SIZE) {
+        hash->init(&ctx->inner);
+        hash->update(&ctx->inner, key, key_length);
+        hash->final(&ctx->inner, temp_key);
+    } else {
+        memcpy(temp_key, key, key_length);
+    }
+
+    ctx->hash = hash;
+    for(int i = 0; i < HMAC_BLOCK_SIZE; ++i) {
+        pad[i] = 0x36 ^ temp_key[i];
+    }
+    hash->init(&ctx->inner);
+    hash->update(&ctx->inner, pad, HMAC_BLOCK_SIZE);
+
+    for(int i = 0; i < HMAC_BLOCK_SIZE; ++i) {
+        pad[i] = 0x5c ^ temp_key[i];
+    }
+    hash->init(&ctx->outer);
+    hash->update(&ctx->outer, pad, HMAC_BLOCK_SIZE);
+}
+
+void
+hmac_begin(const hmac_ctx* ctx, hmac_state* state) {
+    state->key = ctx;
+    state->state = ctx->inner;
+}
+
+void
+hmac_update(hmac_state* state, const char* data, uint64_t length) {
+    state->key->hash->update(&state->state, data, length);
+}
+
+// Writes hash->digest_size bytes to result
+void
+hmac_final(hmac_state* state, char* result) {
+    const hmac_hash* hash = state->key->hash;
+    char h[32];
+    hash->final(&state->state, h);
+
+    state->state = state->key->outer;
+    hash->update(&state->state, h, hash->digest_size);
+    hash->final(&state->state, result);
+}
+
+void
+hmac_compute(const hmac_ctx* ctx, const char* message, int message_length, char* result) {
+    hmac_state state;
+    hmac_begin(ctx, &state);
+    hmac_update(&state, message, message_length);
+    hmac_final(&state, result);
+}
+
+// The contexts only know the incremental hashes, other hash functions take the one shot path below
+static const hmac_hash*
+hmac_hash_for(void(*hash_function)(const char*, int, char*)) {
+    if(hash_function == md5) return &hmac_md5;
+    if(hash_function == sha1) return &hmac_sha1;
+    if(hash_function == (void(*)(const char*, int, char*))sha256) return &hmac_sha256;
+    return 0;
+}
+
+// P_hash of label || seed under a prepared key. With xor_result the output is folded into result
+// instead of overwriting it, which is how prf10 combines its md5 and sha1 halves.
+static void
+phash_keyed(
+    const hmac_ctx* ctx,
+    const char* label, int label_length,
+    const char* seed, int seed_length,
+    char* result, int result_length, int xor_result)
+{
+    int size = ctx->hash->digest_size;
+    char A[32];
+    char T[32];
+    hmac_state state;
+
+    // Calculate A(1) = hmac(secret, A(0))
+    hmac_begin(ctx, &state);
+    hmac_update(&state, label, label_length);
+    hmac_update(&state, seed, seed_length);
+    hmac_final(&state, A);
+
+    int offset = 0;
+    while(offset < result_length) {
+        hmac_begin(ctx, &state);
+        hmac_update(&state, A, size);
+        hmac_update(&state, label, label_length);
+        hmac_update(&state, seed, seed_length);
+        hmac_final(&state, T);
+
+        int a = MIN(result_length - offset, size);
+        for(int i = 0; i < a; ++i) {
+            result[offset + i] = xor_result ? (result[offset + i] ^ T[i]) : T[i];
+        }
+        offset += a;
+
+        // Next A
+        hmac_compute(ctx, A, size, A);
+    }
+}
+
+// -----------------------------------------
+// One shot
+// -----------------------------------------
+
 void
 hmac(
     void(*hash_function)(const char*, int, char*),
@@ -14,15 +146,37 @@ hmac(
     const char* message, int message_length, 
     char* result, int result_length) 
 {
-    #define HMAC_BLOCK_SIZE 64
+    const hmac_hash* hash = hmac_hash_for(hash_function);
+    if(hash) {
+        hmac_ctx ctx;
+        hmac_state state;
+        char h[512] = {0}; // the inner digest, zero padded like the one shot path below
+        char out[32];
+        hmac_init(&ctx, hash, key, key_length);
+        if(result_length == hash->digest_size) {
+            hmac_compute(&ctx, message, message_length, result);
+            return;
+        }
+
+        // Other lengths keep what hmac always did: the outer hash takes result_length bytes of the
+        // inner digest, which is standard HMAC only when result_length is the digest size
+        hmac_begin(&ctx, &state);
+        hmac_update(&state, message, message_length);
+        hash->final(&state.state, h);
+        state.state = ctx.outer;
+        hash->update(&state.state, h, MIN(result_length, (int)sizeof(h)));
+        hash->final(&state.state, out);
+        memcpy(result, out, MIN(result_length, hash->digest_size));
+        return;
+    }
+
     char temp_key[HMAC_BLOCK_SIZE] = {0};
     char o_key_pad[HMAC_BLOCK_SIZE] = {0};
     char i_key_pad[HMAC_BLOCK_SIZE] = {0};
 
     if(key_length > HMAC_BLOCK_SIZE) {
         hash_function(key, key_length, temp_key);
-    }
-    if(key_length < HMAC_BLOCK_SIZE) {
+    } else {
         memcpy(temp_key, key, key_length);
     }
     
@@ -42,6 +196,7 @@ hmac(
     memcpy(m + HMAC_BLOCK_SIZE, h, result_length);
 
     hash_function(m, HMAC_BLOCK_SIZE + result_length, result);
+    free(m);
 }
 
 void phash(
@@ -51,6 +206,14 @@ void phash(
     const char* seed, int seed_length, 
     char* result, int result_length_bytes) 
 {
+    const hmac_hash* hash = hmac_hash_for(hash_function);
+    if(hash) {
+        hmac_ctx ctx;
+        hmac_init(&ctx, hash, secret, secret_length);
+        phash_keyed(&ctx, 0, 0, seed, seed_length, result, result_length_bytes, 0);
+        return;
+    }
+
     int length = result_length_bytes;
     char A[512] = {0};
     char T[512] = {0};
@@ -87,6 +250,14 @@ void prf12(void(*hash_function)(const char*, int, char*),
     const char* seed, int seed_length,
     char* result, int result_length) 
 {
+    const hmac_hash* hash = hmac_hash_for(hash_function);
+    if(hash) {
+        hmac_ctx ctx;
+        hmac_init(&ctx, hash, secret, secret_length);
+        phash_keyed(&ctx, label, label_length, seed, seed_length, result, result_length, 0);
+        return;
+    }
+
     int label_and_seed_length = label_length + seed_length;
     char* label_and_seed = calloc(1, label_and_seed_length);
 
@@ -105,35 +276,15 @@ void prf10(
     const char* seed, int seed_length,
     char* result, int result_length) 
 {
-    const int MD5_RESULT_LENGTH = 16;
-    const int SHA1_RESULT_LENGTH = 20;
-
-    int label_and_seed_length = label_length + seed_length;
-    char* label_and_seed = calloc(1, label_and_seed_length);
-    memcpy(label_and_seed, label, label_length);
-    memcpy(label_and_seed + label_length, seed, seed_length);
-
-    int s1_len = (secret_length + 1) / 2;
-    int s2_len = secret_length - (secret_length / 2);
-    char* s1 = calloc(1, s1_len);
-	char* s2 = calloc(1, s2_len);
-
-    memcpy(s1, secret, s1_len);
-    memcpy(s2, secret + s1_len, s2_len);
-
-    phash(md5, MD5_RESULT_LENGTH, s1,  s1_len, label_and_seed, label_and_seed_length, result, result_length);
-
-    char* res_temp = calloc(1, result_length);
-	phash(sha1, SHA1_RESULT_LENGTH, s2, s2_len, label_and_seed, label_and_seed_length, res_temp, result_length);
-
-	for (int i = 0; i < result_length; ++i) {
-        result[i] ^= res_temp[i];
-	}
-
-    free(s1);
-    free(s2);
-    free(label_and_seed);
-    free(res_temp);
+    // Both halves are ceil(secret_length / 2) long and share the middle byte when the length is odd
+    int half_length = secret_length - (secret_length / 2);
+    hmac_ctx md5_key;
+    hmac_ctx sha1_key;
+    hmac_init(&md5_key, &hmac_md5, secret, half_length);
+    hmac_init(&sha1_key, &hmac_sha1, secret + (secret_length / 2), half_length);
+
+    phash_keyed(&md5_key, label, label_length, seed, seed_length, result, result_length, 0);
+    phash_keyed(&sha1_key, label, label_length, seed, seed_length, result, result_length, 1);
 }
 
 void test_phash() {
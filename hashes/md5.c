@@ -2,10 +2,12 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <math.h>
+#include "hhashes.h"
 
 #define BIG_ENDIAN_32(X) (((X) << 24) | (((X) << 8) & 0xff0000) | (((X) >> 8) & 0xff00) | ((X) >> 24))
 #define ROL(V, B) (((V) << (B)) | ((V) >> (32 - (B))))
 #define BLOCK_INTS 16
+#define MD5_FILE_CHUNK (64 * 1024)
 
 void md5_buffer_to_block(char* buffer, uint32_t block[16]) {
     for (uint64_t i = 0; i < BLOCK_INTS; i += 1) {
@@ -91,52 +93,100 @@ md5_transform(uint32_t digest[4], uint32_t block[16]) {
     digest[3] += D;
 }
 
-void 
-md5(const char* buffer, int length, char out[16]) {
-    uint32_t digest[] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
-    uint32_t block[16] = {0};
-
-    uint64_t total_bits = length * 8;
+static const uint32_t
+md5_h0[4] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476 };
 
-    // for each 64 bit chunk do
-    for(int i = 0; i < length / 64; ++i) {
-        memcpy(block, buffer, 64);
+static void
+md5_blocks(uint32_t digest[4], const char* blocks, int count) {
+    uint32_t block[16];
+    for (int i = 0; i < count; ++i) {
+        memcpy(block, blocks + i * 64, 64);
         md5_transform(digest, block);
-        buffer += 64;
     }
+}
 
-    char last_buffer[64] = {0};
+// Pads the last n bytes of a message into out, returns the number of blocks (1 or 2)
+static int
+md5_pad(const char* tail, int n, uint64_t total_bits, char out[128]) {
+    int blocks = (n + 9 > 64) ? 2 : 1;
+    memset(out, 0, 128);
+    memcpy(out, tail, n);
+    out[n] = (char)0x80;
+    ((uint32_t*)out)[blocks * BLOCK_INTS - 1] = (uint32_t)(total_bits >> 32);
+    ((uint32_t*)out)[blocks * BLOCK_INTS - 2] = (uint32_t)(total_bits);
+    return blocks;
+}
 
-    // n is the amount of bytes still left
-    int n = length % 64;
-    // copy it to the buffer with padding
-    memcpy(last_buffer, buffer, n);
+void
+md5_init(md5_ctx* ctx) {
+    memcpy(ctx->digest, md5_h0, sizeof(ctx->digest));
+    ctx->length = 0;
+    ctx->buffered = 0;
+}
 
-    last_buffer[n++] = 0x80; // this is safe, since n <= 63
+void
+md5_update(md5_ctx* ctx, const char* data, uint64_t length) {
+    ctx->length += length;
+
+    // top up a partially filled block first
+    if (ctx->buffered > 0) {
+        int take = 64 - ctx->buffered;
+        if ((uint64_t)take > length) take = (int)length;
+        memcpy(ctx->buffer + ctx->buffered, data, take);
+        ctx->buffered += take;
+        data += take;
+        length -= take;
+        if (ctx->buffered < 64) return;
+        md5_blocks(ctx->digest, ctx->buffer, 1);
+        ctx->buffered = 0;
+    }
 
-    if(n > 56) {
-        // there is no more space to put the length
-        memcpy(block, last_buffer, 64);
-        md5_transform(digest, block);
-        memset(last_buffer, 0, 64);
-        memcpy(block, last_buffer, 64);
-        block[BLOCK_INTS - 1] = (uint32_t)(total_bits >> 32);
-        block[BLOCK_INTS - 2] = (uint32_t)(total_bits);
-        md5_transform(digest, block);
-    } else {
-        // there is still space
-        //buffer_to_block(last_buffer, block);
-        memcpy(block, last_buffer, 64);
+    // full blocks are read straight from data, in runs that fit the int block count
+    while (length >= 64) {
+        uint64_t blocks = length / 64;
+        int count = (blocks > (1 << 20)) ? (1 << 20) : (int)blocks;
+        md5_blocks(ctx->digest, data, count);
+        data += (uint64_t)count * 64;
+        length -= (uint64_t)count * 64;
+    }
 
-        block[BLOCK_INTS - 1] = (uint32_t)(total_bits >> 32);
-        block[BLOCK_INTS - 2] = (uint32_t)(total_bits);
-        md5_transform(digest, block);
+    memcpy(ctx->buffer, data, length);
+    ctx->buffered = (int)length;
+}
+
+void
+md5_final(md5_ctx* ctx, char out[16]) {
+    char last_buffer[128];
+    int blocks = md5_pad(ctx->buffer, ctx->buffered, ctx->length * 8, last_buffer);
+    md5_blocks(ctx->digest, last_buffer, blocks);
+    ((uint32_t*)out)[0] = ctx->digest[0];
+    ((uint32_t*)out)[1] = ctx->digest[1];
+    ((uint32_t*)out)[2] = ctx->digest[2];
+    ((uint32_t*)out)[3] = ctx->digest[3];
+}
+
+int
+md5_file(FILE* file, char out[16]) {
+    char chunk[MD5_FILE_CHUNK];
+    md5_ctx ctx;
+    md5_init(&ctx);
+
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        md5_update(&ctx, chunk, n);
     }
+    if (ferror(file)) return -1;
+
+    md5_final(&ctx, out);
+    return 0;
+}
 
-    ((uint32_t*)out)[0] = digest[0];
-    ((uint32_t*)out)[1] = digest[1];
-    ((uint32_t*)out)[2] = digest[2];
-    ((uint32_t*)out)[3] = digest[3];
+void 
+md5(const char* buffer, int length, char out[16]) {
+    md5_ctx ctx;
+    md5_init(&ctx);
+    md5_update(&ctx, buffer, length);
+    md5_final(&ctx, out);
 }
 
 void md5_print(char in[16]) {
@@ -1,10 +1,12 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "hhashes.h"
 
 #define SHA1_BLOCK_INTS 16
 #define SHA1_BLOCK_SIZE_BYTES 64
 #define SHA1_DIGEST_SIZE 5
+#define SHA1_FILE_CHUNK (64 * 1024)
 #define BIG_ENDIAN_32(X) (((X) << 24) | (((X) << 8) & 0xff0000) | (((X) >> 8) & 0xff00) | ((X) >> 24))
 
 static void 
@@ -186,50 +188,170 @@ sha1_transform(uint32_t digest[5], uint32_t block[16]) {
     digest[4] += e;
 }
 
-void 
-sha1(const char* buffer, int length, char out[20]) {
-    uint32_t digest[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
-    uint32_t block[16] = {0};
-
-    uint64_t total_bits = length * 8;
+// Runs the compression function over count consecutive 64 byte blocks
+typedef void (*sha1_blocks_fn)(uint32_t digest[5], const char* blocks, int count);
 
-    // for each 64 bit chunk do
-    for(int i = 0; i < length / 64; ++i) {
-        sha1_buffer_to_block(buffer, 64, block);
+static void
+sha1_transform_blocks(uint32_t digest[5], const char* blocks, int count) {
+    uint32_t block[16];
+    for (int i = 0; i < count; ++i) {
+        sha1_buffer_to_block(blocks + i * SHA1_BLOCK_SIZE_BYTES, SHA1_BLOCK_SIZE_BYTES, block);
         sha1_transform(digest, block);
-        buffer += 64;
     }
+}
 
-    char last_buffer[64] = {0};
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA1_X86
+#include <immintrin.h>
+#include <cpuid.h>
 
-    // n is the amount of bytes still left
-    int n = length % 64;
-    // copy it to the buffer with padding
-    memcpy(last_buffer, buffer, n);
+// SHA extensions, ABCD is kept in one register with A in the top word and E rides along in the next one
+__attribute__((target("sha,sse4.1"))) static void
+sha1_transform_shani(uint32_t digest[5], const char* blocks, int count) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
 
-    last_buffer[n++] = 0x80; // this is safe, since n <= 63
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)digest), 0x1b);
+    __m128i e0 = _mm_set_epi32((int)digest[4], 0, 0, 0);
 
-    if(n > 56) {
-        // there is no more space to put the length
-        sha1_buffer_to_block(last_buffer, n, block);
-        sha1_transform(digest, block);
-        memset(last_buffer, 0, 64);
-        sha1_buffer_to_block(last_buffer, n, block);
-        block[SHA1_BLOCK_INTS - 1] = (uint32_t)total_bits;
-        block[SHA1_BLOCK_INTS - 2] = (uint32_t)(total_bits >> 32);
-        sha1_transform(digest, block);
-    } else {
-        // there is still space
-        sha1_buffer_to_block(last_buffer, n, block);
+    for (int block = 0; block < count; ++block) {
+        const char* buffer = blocks + block * SHA1_BLOCK_SIZE_BYTES;
+        __m128i abcd_save = abcd;
+        __m128i e_save = e0;
+        __m128i abcd_prev = abcd;
+        __m128i ms[4];
 
-        block[SHA1_BLOCK_INTS - 1] = (uint32_t)total_bits;
-        block[SHA1_BLOCK_INTS - 2] = (uint32_t)(total_bits >> 32);
-        sha1_transform(digest, block);
+        // 4 rounds per step, W[i] = sha1msg2(sha1msg1(W[i-4], W[i-3]) ^ W[i-2], W[i-1]) for i >= 4
+        for (int i = 0; i < 20; ++i) {
+            __m128i w;
+            if (i < 4) {
+                w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buffer + i * 16)), byte_swap);
+            } else {
+                w = _mm_xor_si128(_mm_sha1msg1_epu32(ms[i & 3], ms[(i + 1) & 3]), ms[(i + 2) & 3]);
+                w = _mm_sha1msg2_epu32(w, ms[(i + 3) & 3]);
+            }
+            ms[i & 3] = w;
+
+            __m128i e = (i == 0) ? _mm_add_epi32(e0, w) : _mm_sha1nexte_epu32(abcd_prev, w);
+            abcd_prev = abcd;
+            switch (i / 5) {
+            case 0: abcd = _mm_sha1rnds4_epu32(abcd, e, 0); break;
+            case 1: abcd = _mm_sha1rnds4_epu32(abcd, e, 1); break;
+            case 2: abcd = _mm_sha1rnds4_epu32(abcd, e, 2); break;
+            default: abcd = _mm_sha1rnds4_epu32(abcd, e, 3); break;
+            }
+        }
+
+        e0 = _mm_sha1nexte_epu32(abcd_prev, e_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((__m128i*)digest, _mm_shuffle_epi32(abcd, 0x1b));
+    digest[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+static int
+sha1_cpu_has_sha_ni(void) {
+    unsigned int a, b, c, d;
+    return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 29));
+}
+#endif
+
+static sha1_blocks_fn sha1_blocks = sha1_transform_blocks;
+
+#if defined(SHA1_X86)
+// Picks the block function once at startup, the plain C transform stays the fallback
+__attribute__((constructor)) static void
+sha1_select_transform(void) {
+    if (sha1_cpu_has_sha_ni()) {
+        sha1_blocks = sha1_transform_shani;
     }
+}
+#endif
+
+// Pads the last n bytes of a message into out, returns the number of blocks (1 or 2)
+static int
+sha1_pad(const char* tail, int n, uint64_t total_bits, char out[128]) {
+    int blocks = (n + 9 > SHA1_BLOCK_SIZE_BYTES) ? 2 : 1;
+    memset(out, 0, 128);
+    memcpy(out, tail, n);
+    out[n] = (char)0x80;
+    ((uint32_t*)out)[blocks * SHA1_BLOCK_INTS - 1] = BIG_ENDIAN_32((uint32_t)total_bits);
+    ((uint32_t*)out)[blocks * SHA1_BLOCK_INTS - 2] = BIG_ENDIAN_32((uint32_t)(total_bits >> 32));
+    return blocks;
+}
+
+static const uint32_t
+sha1_h0[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
 
-    ((uint32_t*)out)[0] = BIG_ENDIAN_32(digest[0]);
-    ((uint32_t*)out)[1] = BIG_ENDIAN_32(digest[1]);
-    ((uint32_t*)out)[2] = BIG_ENDIAN_32(digest[2]);
-    ((uint32_t*)out)[3] = BIG_ENDIAN_32(digest[3]);
-    ((uint32_t*)out)[4] = BIG_ENDIAN_32(digest[4]);
-}
\ No newline at end of file
+void
+sha1_init(sha1_ctx* ctx) {
+    memcpy(ctx->digest, sha1_h0, sizeof(ctx->digest));
+    ctx->length = 0;
+    ctx->buffered = 0;
+}
+
+void
+sha1_update(sha1_ctx* ctx, const char* data, uint64_t length) {
+    ctx->length += length;
+
+    // top up a partially filled block first
+    if (ctx->buffered > 0) {
+        int take = SHA1_BLOCK_SIZE_BYTES - ctx->buffered;
+        if ((uint64_t)take > length) take = (int)length;
+        memcpy(ctx->buffer + ctx->buffered, data, take);
+        ctx->buffered += take;
+        data += take;
+        length -= take;
+        if (ctx->buffered < SHA1_BLOCK_SIZE_BYTES) return;
+        sha1_blocks(ctx->digest, ctx->buffer, 1);
+        ctx->buffered = 0;
+    }
+
+    // full blocks are read straight from data, in runs that fit the int block count
+    while (length >= SHA1_BLOCK_SIZE_BYTES) {
+        uint64_t blocks = length / SHA1_BLOCK_SIZE_BYTES;
+        int count = (blocks > (1 << 20)) ? (1 << 20) : (int)blocks;
+        sha1_blocks(ctx->digest, data, count);
+        data += (uint64_t)count * SHA1_BLOCK_SIZE_BYTES;
+        length -= (uint64_t)count * SHA1_BLOCK_SIZE_BYTES;
+    }
+
+    memcpy(ctx->buffer, data, length);
+    ctx->buffered = (int)length;
+}
+
+void
+sha1_final(sha1_ctx* ctx, char out[20]) {
+    char last_buffer[128];
+    int blocks = sha1_pad(ctx->buffer, ctx->buffered, ctx->length * 8, last_buffer);
+    sha1_blocks(ctx->digest, last_buffer, blocks);
+    ((uint32_t*)out)[0] = BIG_ENDIAN_32(ctx->digest[0]);
+    ((uint32_t*)out)[1] = BIG_ENDIAN_32(ctx->digest[1]);
+    ((uint32_t*)out)[2] = BIG_ENDIAN_32(ctx->digest[2]);
+    ((uint32_t*)out)[3] = BIG_ENDIAN_32(ctx->digest[3]);
+    ((uint32_t*)out)[4] = BIG_ENDIAN_32(ctx->digest[4]);
+}
+
+int
+sha1_file(FILE* file, char out[20]) {
+    char chunk[SHA1_FILE_CHUNK];
+    sha1_ctx ctx;
+    sha1_init(&ctx);
+
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        sha1_update(&ctx, chunk, n);
+    }
+    if (ferror(file)) return -1;
+
+    sha1_final(&ctx, out);
+    return 0;
+}
+
+void 
+sha1(const char* buffer, int length, char out[20]) {
+    sha1_ctx ctx;
+    sha1_init(&ctx);
+    sha1_update(&ctx, buffer, length);
+    sha1_final(&ctx, out);
+}
@@ -1,127 +1,475 @@
 #pragma once
 #include <math.h>
+#include <stdint.h>
+
+// The types are templates on the scalar: vec2/vec3/vec4/mat4/quat use float, dvec2/dvec3/dvec4/dmat4/dquat
+// use double and xvec2/xvec3/xvec4/xmat4/xquat use the 16.16 fixed point type below.
+// float vec4 and mat4 use SSE (AVX and FMA when the target has them) chosen at compile time,
+// which aligns them to 16 bytes. double vec4 and mat4 use AVX when available.
+// Define HOMATH_NO_SIMD to only use the scalar code.
+#if !defined(HOMATH_NO_SIMD)
+#if defined(__AVX__)
+#include <immintrin.h>
+#define HOMATH_AVX
+#define HOMATH_SSE
+#if defined(__FMA__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define HOMATH_FMA
+#endif
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define HOMATH_SSE
+#endif
+#endif
 
 #define DEGTORAD(degree) ((degree) * (3.141592654f / 180.0f))
 #define RADTODEG(radian) ((radian) * (180.0f / 3.141592654f))
 
 namespace hm {
 
-	struct vec2 {
-		float x;
-		float y;
+#if defined(HOMATH_SSE)
+	// a * b + c
+	static inline __m128 simd_madd(__m128 a, __m128 b, __m128 c) {
+#if defined(HOMATH_FMA)
+		return _mm_fmadd_ps(a, b, c);
+#else
+		return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+	}
+#endif
+#if defined(HOMATH_AVX)
+	static inline __m256 simd_madd(__m256 a, __m256 b, __m256 c) {
+#if defined(HOMATH_FMA)
+		return _mm256_fmadd_ps(a, b, c);
+#else
+		return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+	}
+	static inline __m256d simd_madd(__m256d a, __m256d b, __m256d c) {
+#if defined(HOMATH_FMA)
+		return _mm256_fmadd_pd(a, b, c);
+#else
+		return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+	}
+#endif
+
+	// -----------------
+	// --- Fast math ---
+	// -----------------
+
+	// Polynomial sin/cos and rsqrt estimates. HOMATH_FAST_MATH_ACCURACY 1 (default) is within a few float ulps
+	// for |x| < 8192, 0 drops the Newton step of rsqrt (12 bits) and a polynomial term (about 4e-5 absolute).
+	// Define HOMATH_FAST_MATH to use them for float length/normalize/sqrt/sin/cos in the types below.
+#if !defined(HOMATH_FAST_MATH_ACCURACY)
+#define HOMATH_FAST_MATH_ACCURACY 1
+#endif
+
+#if defined(HOMATH_SSE)
+	static inline __m128 simd_rsqrt(__m128 v) {
+		__m128 y = _mm_rsqrt_ps(v);
+#if HOMATH_FAST_MATH_ACCURACY >= 1
+		// One Newton-Raphson step, y * (1.5 - 0.5 * v * y * y)
+		__m128 half_vyy = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), v), _mm_mul_ps(y, y));
+		y = _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), half_vyy));
+#endif
+		return y;
+	}
+
+	// sin and cos of r in [-pi/4, pi/4]
+	static inline void simd_sincos_reduced(__m128 r, __m128* s, __m128* c) {
+		__m128 r2 = _mm_mul_ps(r, r);
+#if HOMATH_FAST_MATH_ACCURACY >= 1
+		__m128 sin_r = simd_madd(r2, _mm_set1_ps(-1.9515295891e-4f), _mm_set1_ps(8.3321608736e-3f));
+		sin_r = simd_madd(sin_r, r2, _mm_set1_ps(-1.6666654611e-1f));
+		__m128 cos_r = simd_madd(r2, _mm_set1_ps(2.443315711809948e-5f), _mm_set1_ps(-1.388731625493765e-3f));
+		cos_r = simd_madd(cos_r, r2, _mm_set1_ps(4.166664568298827e-2f));
+#else
+		__m128 sin_r = simd_madd(r2, _mm_set1_ps(8.3321608736e-3f), _mm_set1_ps(-1.6666654611e-1f));
+		__m128 cos_r = simd_madd(r2, _mm_set1_ps(-1.388731625493765e-3f), _mm_set1_ps(4.166664568298827e-2f));
+#endif
+		cos_r = simd_madd(cos_r, r2, _mm_set1_ps(-0.5f));
+		*s = simd_madd(_mm_mul_ps(sin_r, r2), r, r);
+		*c = simd_madd(cos_r, r2, _mm_set1_ps(1.0f));
+	}
+
+	static inline void simd_sincos(__m128 x, __m128* s, __m128* c) {
+		// x = q * pi/2 + r, pi/2 is split in three so the reduction stays exact for large q
+		__m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.636619772f)));
+		__m128 qf = _mm_cvtepi32_ps(q);
+		__m128 r = simd_madd(qf, _mm_set1_ps(-1.5703125f), x);
+		r = simd_madd(qf, _mm_set1_ps(-4.837512969970703125e-4f), r);
+		r = simd_madd(qf, _mm_set1_ps(-7.54978995489188216e-8f), r);
+
+		__m128 sin_r, cos_r;
+		simd_sincos_reduced(r, &sin_r, &cos_r);
+
+		// Odd quadrants swap sin and cos, bit 1 of q negates sin and bit 1 of q + 1 negates cos
+		__m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+		__m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+		__m128 cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+		*s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, cos_r), _mm_andnot_ps(swap, sin_r)), sin_sign);
+		*c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, sin_r), _mm_andnot_ps(swap, cos_r)), cos_sign);
+	}
+
+	static inline __m128 simd_sin(__m128 x) {
+		__m128 s, c;
+		simd_sincos(x, &s, &c);
+		return s;
+	}
+
+	static inline __m128 simd_cos(__m128 x) {
+		__m128 s, c;
+		simd_sincos(x, &s, &c);
+		return c;
+	}
+#endif
+
+#if defined(HOMATH_AVX)
+	static inline __m256 simd_rsqrt(__m256 v) {
+		__m256 y = _mm256_rsqrt_ps(v);
+#if HOMATH_FAST_MATH_ACCURACY >= 1
+		__m256 half_vyy = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), v), _mm256_mul_ps(y, y));
+		y = _mm256_mul_ps(y, _mm256_sub_ps(_mm256_set1_ps(1.5f), half_vyy));
+#endif
+		return y;
+	}
+
+#endif
+
+#if defined(HOMATH_AVX) && defined(__AVX2__)
+	// Without AVX2 the quadrant selection would need 128 bit halves, 4 wide SSE is as fast there
+	static inline void simd_sincos(__m256 x, __m256* s, __m256* c) {
+		__m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(0.636619772f)));
+		__m256 qf = _mm256_cvtepi32_ps(q);
+		__m256 r = simd_madd(qf, _mm256_set1_ps(-1.5703125f), x);
+		r = simd_madd(qf, _mm256_set1_ps(-4.837512969970703125e-4f), r);
+		r = simd_madd(qf, _mm256_set1_ps(-7.54978995489188216e-8f), r);
+
+		__m256 r2 = _mm256_mul_ps(r, r);
+#if HOMATH_FAST_MATH_ACCURACY >= 1
+		__m256 sin_r = simd_madd(r2, _mm256_set1_ps(-1.9515295891e-4f), _mm256_set1_ps(8.3321608736e-3f));
+		sin_r = simd_madd(sin_r, r2, _mm256_set1_ps(-1.6666654611e-1f));
+		__m256 cos_r = simd_madd(r2, _mm256_set1_ps(2.443315711809948e-5f), _mm256_set1_ps(-1.388731625493765e-3f));
+		cos_r = simd_madd(cos_r, r2, _mm256_set1_ps(4.166664568298827e-2f));
+#else
+		__m256 sin_r = simd_madd(r2, _mm256_set1_ps(8.3321608736e-3f), _mm256_set1_ps(-1.6666654611e-1f));
+		__m256 cos_r = simd_madd(r2, _mm256_set1_ps(-1.388731625493765e-3f), _mm256_set1_ps(4.166664568298827e-2f));
+#endif
+		cos_r = simd_madd(cos_r, r2, _mm256_set1_ps(-0.5f));
+		sin_r = simd_madd(_mm256_mul_ps(sin_r, r2), r, r);
+		cos_r = simd_madd(cos_r, r2, _mm256_set1_ps(1.0f));
+
+		__m256i one = _mm256_set1_epi32(1), two = _mm256_set1_epi32(2);
+		__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+		__m256 sin_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+		__m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+		*s = _mm256_xor_ps(_mm256_blendv_ps(sin_r, cos_r, swap), sin_sign);
+		*c = _mm256_xor_ps(_mm256_blendv_ps(cos_r, sin_r, swap), cos_sign);
+	}
+#endif
+
+	static inline float fast_rsqrt(float v) {
+#if defined(HOMATH_SSE)
+		return _mm_cvtss_f32(simd_rsqrt(_mm_set_ss(v)));
+#else
+		return 1.0f / sqrtf(v);
+#endif
+	}
+
+	static inline float fast_sqrt(float v) {
+		if (v <= 0.0f) return sqrtf(v);
+		return v * fast_rsqrt(v);
+	}
+
+	static inline void fast_sincos(float x, float* s, float* c) {
+#if defined(HOMATH_SSE)
+		__m128 vs, vc;
+		simd_sincos(_mm_set_ss(x), &vs, &vc);
+		*s = _mm_cvtss_f32(vs);
+		*c = _mm_cvtss_f32(vc);
+#else
+		float q = x * 0.636619772f;
+		int qi = (int)(q < 0.0f ? q - 0.5f : q + 0.5f);
+		float qf = (float)qi;
+		float r = x - qf * 1.5703125f - qf * 4.837512969970703125e-4f - qf * 7.54978995489188216e-8f;
+		float r2 = r * r;
+#if HOMATH_FAST_MATH_ACCURACY >= 1
+		float sin_r = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+		float cos_r = 1.0f + r2 * (-0.5f + r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f)));
+#else
+		float sin_r = r + r * r2 * (-1.6666654611e-1f + r2 * 8.3321608736e-3f);
+		float cos_r = 1.0f + r2 * (-0.5f + r2 * (4.166664568298827e-2f + r2 * -1.388731625493765e-3f));
+#endif
+		*s = (qi & 1) ? cos_r : sin_r;
+		*c = (qi & 1) ? sin_r : cos_r;
+		if (qi & 2) *s = -*s;
+		if ((qi + 1) & 2) *c = -*c;
+#endif
+	}
+
+	static inline float fast_sin(float x) {
+		float s, c;
+		fast_sincos(x, &s, &c);
+		return s;
+	}
+
+	static inline float fast_cos(float x) {
+		float s, c;
+		fast_sincos(x, &s, &c);
+		return c;
+	}
+
+	// ---------------
+	// --- Scalars ---
+	// ---------------
+
+	// 16.16 fixed point in an int32_t. + - * / and sqrt are done in integers and give the same results on every
+	// machine, sin/cos/tan go through the C library in double and can differ between C libraries.
+	// Integers convert exactly in [-32768, 32767], floats, doubles and + - * / results out of range saturate, as do divisions by zero.
+	struct fixed {
+		int32_t raw;
+
+		fixed() = default;
+		fixed(int v) : raw((int32_t)((uint32_t)v << 16)) {}
+		fixed(float v) : raw(saturate((double)v * 65536.0)) {}
+		fixed(double v) : raw(saturate(v * 65536.0)) {}
+
+		// Rounds to the nearest raw value, NaN is 0
+		static inline int32_t saturate(double raw) {
+			if (raw != raw) return 0;
+			if (raw >= 2147483647.0) return INT32_MAX;
+			if (raw <= -2147483648.0) return INT32_MIN;
+			return (int32_t)(raw + (raw < 0.0 ? -0.5 : 0.5));
+		}
+		static inline int32_t saturate(int64_t raw) {
+			return (raw > INT32_MAX) ? INT32_MAX : (raw < INT32_MIN) ? INT32_MIN : (int32_t)raw;
+		}
+
+		static inline fixed from_raw(int32_t raw) {
+			fixed result;
+			result.raw = raw;
+			return result;
+		}
+
+		explicit operator float() const { return (float)raw / 65536.0f; }
+		explicit operator double() const { return (double)raw / 65536.0; }
 
-		vec2() {}
-		vec2(float x, float y) : x(x), y(y) {}
+		fixed operator+(fixed r) const { return from_raw(saturate((int64_t)raw + r.raw)); }
+		fixed operator-(fixed r) const { return from_raw(saturate((int64_t)raw - r.raw)); }
+		fixed operator-() const { return from_raw(saturate(-(int64_t)raw)); }
+		fixed operator*(fixed r) const { return from_raw(saturate(((int64_t)raw * r.raw) >> 16)); }
+		fixed operator/(fixed r) const {
+			if (r.raw == 0) return from_raw((raw > 0) ? INT32_MAX : (raw < 0) ? INT32_MIN : 0);
+			return from_raw(saturate((int64_t)raw * 65536 / r.raw));
+		}
+
+		fixed& operator+=(fixed r) { return *this = *this + r; }
+		fixed& operator-=(fixed r) { return *this = *this - r; }
+		fixed& operator*=(fixed r) { return *this = *this * r; }
+		fixed& operator/=(fixed r) { return *this = *this / r; }
+
+		bool operator==(fixed r) const { return raw == r.raw; }
+		bool operator!=(fixed r) const { return raw != r.raw; }
+		bool operator<(fixed r) const { return raw < r.raw; }
+		bool operator<=(fixed r) const { return raw <= r.raw; }
+		bool operator>(fixed r) const { return raw > r.raw; }
+		bool operator>=(fixed r) const { return raw >= r.raw; }
+	};
 
-		static inline float dot(vec2 l, vec2 r) {
+	// Scalar functions used by the templates
+#if defined(HOMATH_FAST_MATH)
+	static inline float math_sqrt(float v) { return fast_sqrt(v); }
+	static inline float math_sin(float v) { return fast_sin(v); }
+	static inline float math_cos(float v) { return fast_cos(v); }
+#else
+	static inline float math_sqrt(float v) { return sqrtf(v); }
+	static inline float math_sin(float v) { return sinf(v); }
+	static inline float math_cos(float v) { return cosf(v); }
+#endif
+	static inline float math_tan(float v) { return tanf(v); }
+	static inline float math_abs(float v) { return fabsf(v); }
+
+	static inline double math_sqrt(double v) { return sqrt(v); }
+	static inline double math_sin(double v) { return sin(v); }
+	static inline double math_cos(double v) { return cos(v); }
+	static inline double math_tan(double v) { return tan(v); }
+	static inline double math_abs(double v) { return fabs(v); }
+
+	static inline fixed math_sqrt(fixed v) {
+		// sqrt(raw * 2^16) one result bit at a time
+		if (v.raw <= 0) return fixed(0);
+		uint64_t n = (uint64_t)v.raw << 16;
+		uint64_t result = 0;
+		uint64_t bit = (uint64_t)1 << 62;
+		while (bit > n) bit >>= 2;
+		while (bit) {
+			if (n >= result + bit) {
+				n -= result + bit;
+				result = (result >> 1) + bit;
+			} else {
+				result >>= 1;
+			}
+			bit >>= 2;
+		}
+		return fixed::from_raw((int32_t)result);
+	}
+	static inline fixed math_sin(fixed v) { return fixed(sin((double)v)); }
+	static inline fixed math_cos(fixed v) { return fixed(cos((double)v)); }
+	static inline fixed math_tan(fixed v) { return fixed(tan((double)v)); }
+	static inline fixed math_abs(fixed v) { return v.raw < 0 ? -v : v; }
+
+	template<typename T>
+	static inline T radians(T degree) {
+		return degree * (T(3.14159265358979323846) / T(180));
+	}
+
+	// Storage for the SIMD register of a 4 wide vector, only float has one
+	template<typename T>
+	struct simd_storage {
+		struct type {
+			T v[4];
+		};
+	};
+#if defined(HOMATH_SSE)
+	template<>
+	struct simd_storage<float> {
+		typedef __m128 type;
+	};
+#endif
+
+	// ---------------
+	// --- Vectors ---
+	// ---------------
+
+	template<typename T>
+	struct tvec2 {
+		typedef T scalar;
+
+		T x;
+		T y;
+
+		tvec2() {}
+		tvec2(T x, T y) : x(x), y(y) {}
+
+		static inline T dot(tvec2 l, tvec2 r) {
 			return l.x * r.x + l.y * r.y;
 		}
 
-		static inline float length(vec2 v) {
-			return sqrtf(v.x * v.x + v.y * v.y);
+		static inline T length(tvec2 v) {
+			return math_sqrt(v.x * v.x + v.y * v.y);
 		}
 
-		static inline vec2& normalize(vec2& v) {
-			float len = length(v);
+		static inline tvec2& normalize(tvec2& v) {
+			T len = length(v);
 			v.x /= len;
 			v.y /= len;
 			return v;
 		}
 
-		vec2 operator+(const vec2& r) {
-			vec2 result;
+		tvec2 operator+(const tvec2& r) {
+			tvec2 result;
 			result.x = x + r.x;
 			result.y = y + r.y;
 			return result;
 		}
-		vec2 operator-(const vec2& r) {
-			vec2 result;
+		tvec2 operator-(const tvec2& r) {
+			tvec2 result;
 			result.x = x - r.x;
 			result.y = y - r.y;
 			return result;
 		}
-		vec2 operator-() {
-			vec2 result;
+		tvec2 operator-() {
+			tvec2 result;
 			result.x = -x;
 			result.y = -y;
 			return result;
 		}
 	};
-	static vec2 operator*(float l, vec2& r) {
-		vec2 result;
+	template<typename T>
+	static tvec2<T> operator*(typename tvec2<T>::scalar l, tvec2<T>& r) {
+		tvec2<T> result;
 		result.x = l * r.x;
 		result.y = l * r.y;
 		return result;
 	}
-	static vec2 operator*(vec2& l, float r) {
-		vec2 result;
+	template<typename T>
+	static tvec2<T> operator*(tvec2<T>& l, typename tvec2<T>::scalar r) {
+		tvec2<T> result;
 		result.x = r * l.x;
 		result.y = r * l.y;
 		return result;
 	}
 
-	struct vec3 {
+	typedef tvec2<float> vec2;
+	typedef tvec2<double> dvec2;
+	typedef tvec2<fixed> xvec2;
+
+	template<typename T>
+	struct tvec3 {
+		typedef T scalar;
+
 		union {
 			struct {
-				float x;
-				float y;
-				float z;
+				T x;
+				T y;
+				T z;
 			};
 			struct {
-				float r;
-				float g;
-				float b;
+				T r;
+				T g;
+				T b;
 			};
 		};
 
-		vec3() {}
-		vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+		tvec3() {}
+		tvec3(T x, T y, T z) : x(x), y(y), z(z) {}
 
-		static inline float dot(vec3 l, vec3 r) {
+		static inline T dot(tvec3 l, tvec3 r) {
 			return l.x * r.x + l.y * r.y + l.z * r.z;
 		}
 
-		static inline float length(vec3 v) {
-			return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+		static inline T length(tvec3 v) {
+			return math_sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
 		}
 
-		static inline vec3& normalize(vec3& v) {
-			float len = length(v);
+		static inline tvec3& normalize(tvec3& v) {
+			T len = length(v);
 			v.x /= len;
 			v.y /= len;
 			v.z /= len;
 			return v;
 		}
 
-		vec3 operator+(const vec3& r) {
-			vec3 result;
+		tvec3 operator+(const tvec3& r) {
+			tvec3 result;
 			result.x = x + r.x;
 			result.y = y + r.y;
 			result.z = z + r.z;
 			return result;
 		}
-		vec3 operator-(const vec3& r) {
-			vec3 result;
+		tvec3 operator-(const tvec3& r) {
+			tvec3 result;
 			result.x = x - r.x;
 			result.y = y - r.y;
 			result.z = z - r.z;
 			return result;
 		}
-		vec3 operator-() {
-			vec3 result;
+		tvec3 operator-() {
+			tvec3 result;
 			result.x = -x;
 			result.y = -y;
 			result.z = -z;
 			return result;
 		}
 
-		bool operator==(const vec3& r) {
+		bool operator==(const tvec3& r) {
 			if (x == r.x && y == r.y && z == r.z) return true;
 			return false;
 		}
 
-		static inline vec3 cross(vec3 l, vec3 r) {
-			vec3 result;
+		static inline tvec3 cross(tvec3 l, tvec3 r) {
+			tvec3 result;
 			result.x = l.y * r.z - l.z * r.y;
 			result.y = -l.x * r.z + l.z * r.x;
 			result.z = l.x * r.y - l.y * r.x;
@@ -129,58 +477,69 @@ namespace hm {
 		}
 	};
 
-	static vec3 operator*(float l, vec3& r) {
-		vec3 result;
+	template<typename T>
+	static tvec3<T> operator*(typename tvec3<T>::scalar l, tvec3<T>& r) {
+		tvec3<T> result;
 		result.x = l * r.x;
 		result.y = l * r.y;
 		result.z = l * r.z;
 		return result;
 	}
-	static vec3 operator*(vec3& l, float r) {
-		vec3 result;
+	template<typename T>
+	static tvec3<T> operator*(tvec3<T>& l, typename tvec3<T>::scalar r) {
+		tvec3<T> result;
 		result.x = r * l.x;
 		result.y = r * l.y;
 		result.z = r * l.z;
 		return result;
 	}
 
-	static vec3 operator/(vec3& l, float r) {
-		vec3 result;
+	template<typename T>
+	static tvec3<T> operator/(tvec3<T>& l, typename tvec3<T>::scalar r) {
+		tvec3<T> result;
 		result.x = l.x / r;
 		result.y = l.y / r;
 		result.z = l.z / r;
 		return result;
 	}
 
-	struct vec4 {
+	typedef tvec3<float> vec3;
+	typedef tvec3<double> dvec3;
+	typedef tvec3<fixed> xvec3;
+
+	template<typename T>
+	struct tvec4 {
+		typedef T scalar;
+
 		union {
 			struct {
-				float x;
-				float y;
-				float z;
-				float w;
+				T x;
+				T y;
+				T z;
+				T w;
 			};
 			struct {
-				float r;
-				float g;
-				float b;
-				float a;
+				T r;
+				T g;
+				T b;
+				T a;
 			};
+			typename simd_storage<T>::type simd;
 		};
 
-		vec4() {}
-		vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+		tvec4() {}
+		tvec4(T x, T y, T z, T w) : x(x), y(y), z(z), w(w) {}
 
-		static inline float dot(vec4 l, vec4 r) {
+		static inline T dot(tvec4 l, tvec4 r) {
 			return l.x * r.x + l.y * r.y + l.z * r.z + l.w * r.w;
 		}
 
-		static inline float length(vec4 v) {
-			return sqrtf(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
+		static inline T length(tvec4 v) {
+			return math_sqrt(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
 		}
 
-		static inline vec4& normalize(vec4& v) {
-			float len = length(v);
+		static inline tvec4& normalize(tvec4& v) {
+			T len = length(v);
 			v.x /= len;
 			v.y /= len;
 			v.z /= len;
@@ -188,24 +547,24 @@ namespace hm {
 			return v;
 		}
 
-		vec4 operator+(const vec4& r) {
-			vec4 result;
+		tvec4 operator+(const tvec4& r) {
+			tvec4 result;
 			result.x = x + r.x;
 			result.y = y + r.y;
 			result.z = z + r.z;
 			result.w = w + r.w;
 			return result;
 		}
-		vec4 operator-(const vec4& r) {
-			vec4 result;
+		tvec4 operator-(const tvec4& r) {
+			tvec4 result;
 			result.x = x - r.x;
 			result.y = y - r.y;
 			result.z = z - r.z;
 			result.w = w - r.w;
 			return result;
 		}
-		vec4 operator-() {
-			vec4 result;
+		tvec4 operator-() {
+			tvec4 result;
 			result.x = -x;
 			result.y = -y;
 			result.z = -z;
@@ -214,16 +573,18 @@ namespace hm {
 		}
 	};
 
-	static vec4 operator*(float l, vec4& r) {
-		vec4 result;
+	template<typename T>
+	static tvec4<T> operator*(typename tvec4<T>::scalar l, tvec4<T>& r) {
+		tvec4<T> result;
 		result.x = l * r.x;
 		result.y = l * r.y;
 		result.z = l * r.z;
 		result.w = l * r.w;
 		return result;
 	}
-	static vec4 operator*(vec4& l, float r) {
-		vec4 result;
+	template<typename T>
+	static tvec4<T> operator*(tvec4<T>& l, typename tvec4<T>::scalar r) {
+		tvec4<T> result;
 		result.x = r * l.x;
 		result.y = r * l.y;
 		result.z = r * l.z;
@@ -231,157 +592,359 @@ namespace hm {
 		return result;
 	}
 
+	typedef tvec4<float> vec4;
+	typedef tvec4<double> dvec4;
+	typedef tvec4<fixed> xvec4;
+
+	// SIMD specializations, the templates above are the scalar fallback
+#if defined(HOMATH_SSE)
+	template<>
+	inline vec4 vec4::operator+(const vec4& r) {
+		vec4 result;
+		result.simd = _mm_add_ps(simd, r.simd);
+		return result;
+	}
+	template<>
+	inline vec4 vec4::operator-(const vec4& r) {
+		vec4 result;
+		result.simd = _mm_sub_ps(simd, r.simd);
+		return result;
+	}
+	template<>
+	inline vec4 vec4::operator-() {
+		vec4 result;
+		result.simd = _mm_sub_ps(_mm_setzero_ps(), simd);
+		return result;
+	}
+
+	static vec4 operator*(float l, vec4& r) {
+		vec4 result;
+		result.simd = _mm_mul_ps(_mm_set1_ps(l), r.simd);
+		return result;
+	}
+	static vec4 operator*(vec4& l, float r) {
+		vec4 result;
+		result.simd = _mm_mul_ps(l.simd, _mm_set1_ps(r));
+		return result;
+	}
+#endif
+#if defined(HOMATH_AVX)
+	// double vectors aren't over-aligned, so they use unaligned loads and stores
+	template<>
+	inline dvec4 dvec4::operator+(const dvec4& r) {
+		dvec4 result;
+		_mm256_storeu_pd(&result.x, _mm256_add_pd(_mm256_loadu_pd(&x), _mm256_loadu_pd(&r.x)));
+		return result;
+	}
+	template<>
+	inline dvec4 dvec4::operator-(const dvec4& r) {
+		dvec4 result;
+		_mm256_storeu_pd(&result.x, _mm256_sub_pd(_mm256_loadu_pd(&x), _mm256_loadu_pd(&r.x)));
+		return result;
+	}
+	template<>
+	inline dvec4 dvec4::operator-() {
+		dvec4 result;
+		_mm256_storeu_pd(&result.x, _mm256_sub_pd(_mm256_setzero_pd(), _mm256_loadu_pd(&x)));
+		return result;
+	}
+
+	static dvec4 operator*(double l, dvec4& r) {
+		dvec4 result;
+		_mm256_storeu_pd(&result.x, _mm256_mul_pd(_mm256_set1_pd(l), _mm256_loadu_pd(&r.x)));
+		return result;
+	}
+	static dvec4 operator*(dvec4& l, double r) {
+		dvec4 result;
+		_mm256_storeu_pd(&result.x, _mm256_mul_pd(_mm256_loadu_pd(&l.x), _mm256_set1_pd(r)));
+		return result;
+	}
+#endif
+
+#if defined(HOMATH_FAST_MATH)
+	// Multiply by the reciprocal square root instead of dividing by the length
+	template<>
+	inline vec2& vec2::normalize(vec2& v) {
+		float rlen = fast_rsqrt(v.x * v.x + v.y * v.y);
+		v.x *= rlen;
+		v.y *= rlen;
+		return v;
+	}
+	template<>
+	inline vec3& vec3::normalize(vec3& v) {
+		float rlen = fast_rsqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+		v.x *= rlen;
+		v.y *= rlen;
+		v.z *= rlen;
+		return v;
+	}
+	template<>
+	inline vec4& vec4::normalize(vec4& v) {
+#if defined(HOMATH_SSE)
+		__m128 sq = _mm_mul_ps(v.simd, v.simd);
+		sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+		sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 0, 3, 2)));
+		v.simd = _mm_mul_ps(v.simd, simd_rsqrt(sq));
+#else
+		float rlen = fast_rsqrt(v.x * v.x + v.y * v.y + v.z * v.z + v.w * v.w);
+		v.x *= rlen;
+		v.y *= rlen;
+		v.z *= rlen;
+		v.w *= rlen;
+#endif
+		return v;
+	}
+#endif
+
 	// ----------------
 	// --- Matrices ---
 	// ----------------
 
-	struct mat4 {
+	template<typename T>
+	struct tmat4 {
+		typedef T scalar;
+
 		union {
-			float m[4][4];
-			float data[16];
+			T m[4][4];
+			T data[16];
+			typename simd_storage<T>::type rows[4];
 		};
 
-		mat4() {
-#ifdef USE_CRT
-			memset(data, 0, 16 * sizeof(float));
+		tmat4() {
+#if defined(USE_CRT)
+			memset(data, 0, 16 * sizeof(T));
 #else
 			for (int i = 0; i < 16; ++i) {
-				data[i] = 0.0f;
+				data[i] = T(0);
 			}
 #endif
 		}
 
-		static inline void identity(mat4& mat) {
+		static inline void identity(tmat4& mat) {
 #ifdef USE_CRT
-			memset(mat.data, 0, 16 * sizeof(float));
+			memset(mat.data, 0, 16 * sizeof(T));
 #else
 			for (int i = 0; i < 16; ++i) {
-				mat.data[i] = 0.0f;
+				mat.data[i] = T(0);
 			}
 #endif
-			mat.m[0][0] = 1.0f;
-			mat.m[1][1] = 1.0f;
-			mat.m[2][2] = 1.0f;
-			mat.m[3][3] = 1.0f;
+			mat.m[0][0] = T(1);
+			mat.m[1][1] = T(1);
+			mat.m[2][2] = T(1);
+			mat.m[3][3] = T(1);
 		}
 
-		static void print(mat4& m) {
+		static void print(tmat4& m) {
 			//printf("%f %f %f %f\n", m.m[0][0], m.m[0][1], m.m[0][2], m.m[0][3]);
 			//printf("%f %f %f %f\n", m.m[1][0], m.m[1][1], m.m[1][2], m.m[1][3]);
 			//printf("%f %f %f %f\n", m.m[2][0], m.m[2][1], m.m[2][2], m.m[2][3]);
 			//printf("%f %f %f %f\n", m.m[3][0], m.m[3][1], m.m[3][2], m.m[3][3]);
 		}
 
-		static inline mat4 translate(float x, float y, float z) {
-			mat4 result;
+		static inline tmat4 translate(T x, T y, T z) {
+			tmat4 result;
 			identity(result);
 			result.m[0][3] = x;
 			result.m[1][3] = y;
 			result.m[2][3] = z;
 			return result;
 		}
-		static inline mat4 translate(const vec3& vec) {
-			mat4 result;
+		static inline tmat4 translate(const tvec3<T>& vec) {
+			tmat4 result;
 			identity(result);
 			result.m[0][3] = vec.x;
 			result.m[1][3] = vec.y;
 			result.m[2][3] = vec.z;
 			return result;
 		}
-		static inline mat4 scale(float amt) {
-			mat4 result;
+		static inline tmat4 scale(T amt) {
+			tmat4 result;
 			result.m[0][0] = amt;
 			result.m[1][1] = amt;
 			result.m[2][2] = amt;
-			result.m[3][3] = 1;
+			result.m[3][3] = T(1);
 			return result;
 		}
 
-		static inline mat4 rotate(vec3& axis, float angle) {
-			mat4 result;
-			angle = DEGTORAD(angle);
-			float c = cosf(angle);
-			float t = 1.0f - c;
-			float s = sinf(angle);
-			vec3 a = vec3::normalize(axis);
+		static inline tmat4 rotate(tvec3<T>& axis, T angle) {
+			tmat4 result;
+			angle = radians(angle);
+			T c = math_cos(angle);
+			T t = T(1) - c;
+			T s = math_sin(angle);
+			tvec3<T> a = tvec3<T>::normalize(axis);
 
-			result.m[0][0] = t * a.x * a.x + c;			result.m[0][1] = t * a.x * a.y + s * a.z;	result.m[0][2] = t * a.x * a.z - s * a.y;	result.m[0][3] = 0;
-			result.m[1][0] = t * a.x * a.y - s * a.z;	result.m[1][1] = t * a.y * a.y + c;			result.m[1][2] = t * a.y * a.z + s * a.x;	result.m[1][3] = 0;
-			result.m[2][0] = t * a.x * a.z + s * a.y;	result.m[2][1] = t * a.y * a.z - s * a.x;	result.m[2][2] = t * a.z * a.z + c;			result.m[2][3] = 0;
-			result.m[3][0] = 0;							result.m[3][1] = 0;							result.m[3][2] = 0;							result.m[3][3] = 1;
+			result.m[0][0] = t * a.x * a.x + c;			result.m[0][1] = t * a.x * a.y + s * a.z;	result.m[0][2] = t * a.x * a.z - s * a.y;	result.m[0][3] = T(0);
+			result.m[1][0] = t * a.x * a.y - s * a.z;	result.m[1][1] = t * a.y * a.y + c;			result.m[1][2] = t * a.y * a.z + s * a.x;	result.m[1][3] = T(0);
+			result.m[2][0] = t * a.x * a.z + s * a.y;	result.m[2][1] = t * a.y * a.z - s * a.x;	result.m[2][2] = t * a.z * a.z + c;			result.m[2][3] = T(0);
+			result.m[3][0] = T(0);						result.m[3][1] = T(0);						result.m[3][2] = T(0);						result.m[3][3] = T(1);
 
 			return result;
 		}
 
-		static inline mat4 perspective(float fovy, float aspect, float zNear, float zFar) {
-			mat4 result;
+		static inline tmat4 perspective(T fovy, T aspect, T zNear, T zFar) {
+			tmat4 result;
 			identity(result);
 
-			float range = tanf(DEGTORAD(fovy / 2.0f)) * zNear;
-			float left = -range * aspect;
-			float right = range * aspect;
-			float bottom = -range;
-			float top = range;
+			T range = math_tan(radians(fovy / T(2))) * zNear;
+			T left = -range * aspect;
+			T right = range * aspect;
+			T bottom = -range;
+			T top = range;
 
-			result.m[0][0] = (2.0f * zNear) / (right - left);
-			result.m[1][1] = (2.0f * zNear) / (top - bottom);
+			result.m[0][0] = (T(2) * zNear) / (right - left);
+			result.m[1][1] = (T(2) * zNear) / (top - bottom);
 			result.m[2][2] = -(zFar + zNear) / (zFar - zNear);
-			result.m[2][3] = -1.0f;
-			result.m[3][2] = -(2.0f * zFar * zNear) / (zFar - zNear);
-			result.m[3][3] = 0;
+			result.m[2][3] = T(-1);
+			result.m[3][2] = -(T(2) * zFar * zNear) / (zFar - zNear);
+			result.m[3][3] = T(0);
 
 			return result;
 		}
 
-		static inline mat4 look_at(vec3 position, vec3 target, vec3 world_up);
-		static inline mat4 ortho(float left, float right, float top, float bottom);
+		static inline tmat4 look_at(tvec3<T> position, tvec3<T> target, tvec3<T> world_up);
+		static inline tmat4 ortho(T left, T right, T top, T bottom);
 	};
 
-	static vec4 operator*(const mat4& m, const vec4& v) {
-		vec4 result;
+	typedef tmat4<float> mat4;
+	typedef tmat4<double> dmat4;
+	typedef tmat4<fixed> xmat4;
+
+#if defined(HOMATH_SSE)
+	template<>
+	inline mat4::tmat4() {
+		rows[0] = rows[1] = rows[2] = rows[3] = _mm_setzero_ps();
+	}
+
+	template<>
+	inline void mat4::identity(mat4& mat) {
+		mat.rows[0] = _mm_setr_ps(1.0f, 0.0f, 0.0f, 0.0f);
+		mat.rows[1] = _mm_setr_ps(0.0f, 1.0f, 0.0f, 0.0f);
+		mat.rows[2] = _mm_setr_ps(0.0f, 0.0f, 1.0f, 0.0f);
+		mat.rows[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+#endif
+
+	template<typename T>
+	static tvec4<T> operator*(const tmat4<T>& m, const tvec4<T>& v) {
+		tvec4<T> result;
 		result.x = m.m[0][0] * v.x + m.m[0][1] * v.y + m.m[0][2] * v.z + m.m[0][3] * v.w;
 		result.y = m.m[1][0] * v.x + m.m[1][1] * v.y + m.m[1][2] * v.z + m.m[1][3] * v.w;
 		result.z = m.m[2][0] * v.x + m.m[2][1] * v.y + m.m[2][2] * v.z + m.m[2][3] * v.w;
 		result.w = m.m[3][0] * v.x + m.m[3][1] * v.y + m.m[3][2] * v.z + m.m[3][3] * v.w;
 		return result;
 	}
+	// With AVX the compiler vectorizes the template above across the vectors of a loop, which beats
+	// any one vector at a time kernel (test/homath_bench.cpp: template 1060 M/s, transpose 630,
+	// hadd of 256 bit row pairs 365)
+#if defined(HOMATH_SSE) && !defined(HOMATH_AVX)
+	static vec4 operator*(const mat4& m, const vec4& v) {
+		vec4 result;
+		// Weight the columns by the components of v, the transpose is hoisted out of loops over vectors
+		__m128 c0 = m.rows[0], c1 = m.rows[1], c2 = m.rows[2], c3 = m.rows[3];
+		_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+		__m128 r = _mm_mul_ps(c0, _mm_shuffle_ps(v.simd, v.simd, 0x00));
+		r = simd_madd(c1, _mm_shuffle_ps(v.simd, v.simd, 0x55), r);
+		r = simd_madd(c2, _mm_shuffle_ps(v.simd, v.simd, 0xaa), r);
+		result.simd = simd_madd(c3, _mm_shuffle_ps(v.simd, v.simd, 0xff), r);
+		return result;
+	}
+#endif
+#if defined(HOMATH_AVX)
+	static dvec4 operator*(const dmat4& m, const dvec4& v) {
+		dvec4 result;
+		__m256d vv = _mm256_loadu_pd(&v.x);
+		__m256d x = _mm256_mul_pd(_mm256_loadu_pd(m.m[0]), vv);
+		__m256d y = _mm256_mul_pd(_mm256_loadu_pd(m.m[1]), vv);
+		__m256d z = _mm256_mul_pd(_mm256_loadu_pd(m.m[2]), vv);
+		__m256d w = _mm256_mul_pd(_mm256_loadu_pd(m.m[3]), vv);
+		// (x0+x1 y0+y1 x2+x3 y2+y3) and (z0+z1 w0+w1 z2+z3 w2+w3), then add the 128 bit halves
+		__m256d xy = _mm256_hadd_pd(x, y);
+		__m256d zw = _mm256_hadd_pd(z, w);
+		_mm256_storeu_pd(&result.x, _mm256_add_pd(_mm256_permute2f128_pd(xy, zw, 0x20), _mm256_permute2f128_pd(xy, zw, 0x31)));
+		return result;
+	}
+#endif
 
-	static vec3 operator*(const mat4& m, const vec3& v) {
-		vec3 result;
-		result.x = m.m[0][0] * v.x + m.m[0][1] * v.y + m.m[0][2] * v.z + m.m[0][3] * 1.0f;
-		result.y = m.m[1][0] * v.x + m.m[1][1] * v.y + m.m[1][2] * v.z + m.m[1][3] * 1.0f;
-		result.z = m.m[2][0] * v.x + m.m[2][1] * v.y + m.m[2][2] * v.z + m.m[2][3] * 1.0f;
+	template<typename T>
+	static tvec3<T> operator*(const tmat4<T>& m, const tvec3<T>& v) {
+		tvec3<T> result;
+		result.x = m.m[0][0] * v.x + m.m[0][1] * v.y + m.m[0][2] * v.z + m.m[0][3];
+		result.y = m.m[1][0] * v.x + m.m[1][1] * v.y + m.m[1][2] * v.z + m.m[1][3];
+		result.z = m.m[2][0] * v.x + m.m[2][1] * v.y + m.m[2][2] * v.z + m.m[2][3];
 		return result;
 	}
 
+	template<typename T>
+	static tmat4<T> operator*(const tmat4<T>& left, const tmat4<T>& right) {
+		tmat4<T> r;
+		for (int i = 0; i < 4; ++i) {
+			r.m[i][0] = left.m[i][0] * right.m[0][0] + left.m[i][1] * right.m[1][0] + left.m[i][2] * right.m[2][0] + left.m[i][3] * right.m[3][0];
+			r.m[i][1] = left.m[i][0] * right.m[0][1] + left.m[i][1] * right.m[1][1] + left.m[i][2] * right.m[2][1] + left.m[i][3] * right.m[3][1];
+			r.m[i][2] = left.m[i][0] * right.m[0][2] + left.m[i][1] * right.m[1][2] + left.m[i][2] * right.m[2][2] + left.m[i][3] * right.m[3][2];
+			r.m[i][3] = left.m[i][0] * right.m[0][3] + left.m[i][1] * right.m[1][3] + left.m[i][2] * right.m[2][3] + left.m[i][3] * right.m[3][3];
+		}
+		return r;
+	}
+#if defined(HOMATH_SSE)
 	static mat4 operator*(const mat4& left, const mat4& right) {
 		mat4 r;
 
-		r.m[0][0] = left.m[0][0] * right.m[0][0] + left.m[0][1] * right.m[1][0] + left.m[0][2] * right.m[2][0] + left.m[0][3] * right.m[3][0];
-		r.m[0][1] = left.m[0][0] * right.m[0][1] + left.m[0][1] * right.m[1][1] + left.m[0][2] * right.m[2][1] + left.m[0][3] * right.m[3][1];
-		r.m[0][2] = left.m[0][0] * right.m[0][2] + left.m[0][1] * right.m[1][2] + left.m[0][2] * right.m[2][2] + left.m[0][3] * right.m[3][2];
-		r.m[0][3] = left.m[0][0] * right.m[0][3] + left.m[0][1] * right.m[1][3] + left.m[0][2] * right.m[2][3] + left.m[0][3] * right.m[3][3];
-
-		r.m[1][0] = left.m[1][0] * right.m[0][0] + left.m[1][1] * right.m[1][0] + left.m[1][2] * right.m[2][0] + left.m[1][3] * right.m[3][0];
-		r.m[1][1] = left.m[1][0] * right.m[0][1] + left.m[1][1] * right.m[1][1] + left.m[1][2] * right.m[2][1] + left.m[1][3] * right.m[3][1];
-		r.m[1][2] = left.m[1][0] * right.m[0][2] + left.m[1][1] * right.m[1][2] + left.m[1][2] * right.m[2][2] + left.m[1][3] * right.m[3][2];
-		r.m[1][3] = left.m[1][0] * right.m[0][3] + left.m[1][1] * right.m[1][3] + left.m[1][2] * right.m[2][3] + left.m[1][3] * right.m[3][3];
-
-		r.m[2][0] = left.m[2][0] * right.m[0][0] + left.m[2][1] * right.m[1][0] + left.m[2][2] * right.m[2][0] + left.m[2][3] * right.m[3][0];
-		r.m[2][1] = left.m[2][0] * right.m[0][1] + left.m[2][1] * right.m[1][1] + left.m[2][2] * right.m[2][1] + left.m[2][3] * right.m[3][1];
-		r.m[2][2] = left.m[2][0] * right.m[0][2] + left.m[2][1] * right.m[1][2] + left.m[2][2] * right.m[2][2] + left.m[2][3] * right.m[3][2];
-		r.m[2][3] = left.m[2][0] * right.m[0][3] + left.m[2][1] * right.m[1][3] + left.m[2][2] * right.m[2][3] + left.m[2][3] * right.m[3][3];
-
-		r.m[3][0] = left.m[3][0] * right.m[0][0] + left.m[3][1] * right.m[1][0] + left.m[3][2] * right.m[2][0] + left.m[3][3] * right.m[3][0];
-		r.m[3][1] = left.m[3][0] * right.m[0][1] + left.m[3][1] * right.m[1][1] + left.m[3][2] * right.m[2][1] + left.m[3][3] * right.m[3][1];
-		r.m[3][2] = left.m[3][0] * right.m[0][2] + left.m[3][1] * right.m[1][2] + left.m[3][2] * right.m[2][2] + left.m[3][3] * right.m[3][2];
-		r.m[3][3] = left.m[3][0] * right.m[0][3] + left.m[3][1] * right.m[1][3] + left.m[3][2] * right.m[2][3] + left.m[3][3] * right.m[3][3];
+#if defined(HOMATH_AVX)
+		// Two rows at a time, each row of the result is the rows of 'right' weighted by a row of 'left'
+		__m256 l01 = _mm256_loadu_ps(left.data);
+		__m256 l23 = _mm256_loadu_ps(left.data + 8);
+		__m256 b0 = _mm256_broadcast_ps(&right.rows[0]);
+		__m256 b1 = _mm256_broadcast_ps(&right.rows[1]);
+		__m256 b2 = _mm256_broadcast_ps(&right.rows[2]);
+		__m256 b3 = _mm256_broadcast_ps(&right.rows[3]);
+
+		__m256 r01 = _mm256_mul_ps(_mm256_shuffle_ps(l01, l01, 0x00), b0);
+		r01 = simd_madd(_mm256_shuffle_ps(l01, l01, 0x55), b1, r01);
+		r01 = simd_madd(_mm256_shuffle_ps(l01, l01, 0xaa), b2, r01);
+		r01 = simd_madd(_mm256_shuffle_ps(l01, l01, 0xff), b3, r01);
+		__m256 r23 = _mm256_mul_ps(_mm256_shuffle_ps(l23, l23, 0x00), b0);
+		r23 = simd_madd(_mm256_shuffle_ps(l23, l23, 0x55), b1, r23);
+		r23 = simd_madd(_mm256_shuffle_ps(l23, l23, 0xaa), b2, r23);
+		r23 = simd_madd(_mm256_shuffle_ps(l23, l23, 0xff), b3, r23);
+
+		_mm256_storeu_ps(r.data, r01);
+		_mm256_storeu_ps(r.data + 8, r23);
+#else
+		for (int i = 0; i < 4; ++i) {
+			__m128 row = left.rows[i];
+			__m128 result = _mm_mul_ps(_mm_shuffle_ps(row, row, 0x00), right.rows[0]);
+			result = simd_madd(_mm_shuffle_ps(row, row, 0x55), right.rows[1], result);
+			result = simd_madd(_mm_shuffle_ps(row, row, 0xaa), right.rows[2], result);
+			result = simd_madd(_mm_shuffle_ps(row, row, 0xff), right.rows[3], result);
+			r.rows[i] = result;
+		}
+#endif
 
 		return r;
 	}
+#endif
+#if defined(HOMATH_AVX)
+	static dmat4 operator*(const dmat4& left, const dmat4& right) {
+		dmat4 r;
+		__m256d b0 = _mm256_loadu_pd(right.m[0]);
+		__m256d b1 = _mm256_loadu_pd(right.m[1]);
+		__m256d b2 = _mm256_loadu_pd(right.m[2]);
+		__m256d b3 = _mm256_loadu_pd(right.m[3]);
+		for (int i = 0; i < 4; ++i) {
+			__m256d result = _mm256_mul_pd(_mm256_broadcast_sd(&left.m[i][0]), b0);
+			result = simd_madd(_mm256_broadcast_sd(&left.m[i][1]), b1, result);
+			result = simd_madd(_mm256_broadcast_sd(&left.m[i][2]), b2, result);
+			result = simd_madd(_mm256_broadcast_sd(&left.m[i][3]), b3, result);
+			_mm256_storeu_pd(r.m[i], result);
+		}
+		return r;
+	}
+#endif
 
-	static void transpose(mat4& m) {
-		mat4 temp = m;
+	template<typename T>
+	static void transpose(tmat4<T>& m) {
+		tmat4<T> temp = m;
 
 		m.m[0][1] = temp.m[1][0];	m.m[0][2] = temp.m[2][0];	m.m[0][3] = temp.m[3][0];
 		m.m[1][0] = temp.m[0][1];								m.m[1][2] = temp.m[2][1];	m.m[1][3] = temp.m[3][1];
@@ -389,39 +952,248 @@ namespace hm {
 		m.m[3][0] = temp.m[0][3];	m.m[3][1] = temp.m[1][3];	m.m[3][2] = temp.m[2][3];
 	}
 
+	template<typename T>
+	static tmat4<T> get_transpose(tmat4<T>& m) {
+		tmat4<T> res = m;
+		transpose(res);
+		return res;
+	}
+#if defined(HOMATH_SSE)
+	static void transpose(mat4& m) {
+		_MM_TRANSPOSE4_PS(m.rows[0], m.rows[1], m.rows[2], m.rows[3]);
+	}
+
 	static mat4 get_transpose(mat4& m) {
-		mat4 temp = m;
 		mat4 res = m;
+		_MM_TRANSPOSE4_PS(res.rows[0], res.rows[1], res.rows[2], res.rows[3]);
+		return res;
+	}
+#endif
 
-		res.m[0][1] = temp.m[1][0];	res.m[0][2] = temp.m[2][0];	res.m[0][3] = temp.m[3][0];
-		res.m[1][0] = temp.m[0][1];								res.m[1][2] = temp.m[2][1];	res.m[1][3] = temp.m[3][1];
-		res.m[2][0] = temp.m[0][2];	res.m[2][1] = temp.m[1][2];								res.m[2][3] = temp.m[3][2];
-		res.m[3][0] = temp.m[0][3];	res.m[3][1] = temp.m[1][3];	res.m[3][2] = temp.m[2][3];
+	template<typename T>
+	static T determinant(const tmat4<T>& m) {
+		const T* a = m.data;
+		T c0 = a[10] * a[15] - a[11] * a[14];
+		T c1 = a[9] * a[15] - a[11] * a[13];
+		T c2 = a[9] * a[14] - a[10] * a[13];
+		T c3 = a[8] * a[15] - a[11] * a[12];
+		T c4 = a[8] * a[14] - a[10] * a[12];
+		T c5 = a[8] * a[13] - a[9] * a[12];
+		return a[0] * (a[5] * c0 - a[6] * c1 + a[7] * c2)
+			- a[1] * (a[4] * c0 - a[6] * c3 + a[7] * c4)
+			+ a[2] * (a[4] * c1 - a[5] * c3 + a[7] * c5)
+			- a[3] * (a[4] * c2 - a[5] * c4 + a[6] * c5);
+	}
 
-		return res;
+	// General inverse, a singular matrix gives infinities/NaNs
+	template<typename T>
+	static tmat4<T> get_inverse(const tmat4<T>& m) {
+		tmat4<T> r;
+		const T* a = m.data;
+		T* inv = r.data;
+
+		// Cofactors of each element, transposed
+		inv[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+		inv[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+		inv[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+		inv[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+		inv[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+		inv[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+		inv[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+		inv[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+		inv[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+		inv[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+		inv[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+		inv[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+		inv[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+		inv[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+		inv[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+		inv[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+		T rdet = T(1) / (a[0] * inv[0] + a[1] * inv[4] + a[2] * inv[8] + a[3] * inv[12]);
+		for (int i = 0; i < 16; ++i) {
+			inv[i] *= rdet;
+		}
+		return r;
 	}
+#if defined(HOMATH_SSE)
+	static mat4 get_inverse(const mat4& m) {
+		mat4 r;
+		// Blockwise inversion on the 2x2 submatrices | A B |, each one stored in a register as (m00 m01 m10 m11)
+		//                                           | C D |
+#define HOMATH_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps((a), (b), _MM_SHUFFLE((w), (z), (y), (x)))
+		struct mat2 {
+			static inline __m128 mul(__m128 a, __m128 b) {
+				return _mm_add_ps(_mm_mul_ps(a, HOMATH_SHUFFLE(b, b, 0, 3, 0, 3)), _mm_mul_ps(HOMATH_SHUFFLE(a, a, 1, 0, 3, 2), HOMATH_SHUFFLE(b, b, 2, 1, 2, 1)));
+			}
+			// adjugate(a) * b
+			static inline __m128 adj_mul(__m128 a, __m128 b) {
+				return _mm_sub_ps(_mm_mul_ps(HOMATH_SHUFFLE(a, a, 3, 3, 0, 0), b), _mm_mul_ps(HOMATH_SHUFFLE(a, a, 1, 1, 2, 2), HOMATH_SHUFFLE(b, b, 2, 3, 0, 1)));
+			}
+			// a * adjugate(b)
+			static inline __m128 mul_adj(__m128 a, __m128 b) {
+				return _mm_sub_ps(_mm_mul_ps(a, HOMATH_SHUFFLE(b, b, 3, 0, 3, 0)), _mm_mul_ps(HOMATH_SHUFFLE(a, a, 1, 0, 3, 2), HOMATH_SHUFFLE(b, b, 2, 1, 2, 1)));
+			}
+		};
+
+		__m128 A = _mm_movelh_ps(m.rows[0], m.rows[1]);
+		__m128 B = _mm_movehl_ps(m.rows[1], m.rows[0]);
+		__m128 C = _mm_movelh_ps(m.rows[2], m.rows[3]);
+		__m128 D = _mm_movehl_ps(m.rows[3], m.rows[2]);
+
+		// (|A| |B| |C| |D|)
+		__m128 det_sub = _mm_sub_ps(
+			_mm_mul_ps(HOMATH_SHUFFLE(m.rows[0], m.rows[2], 0, 2, 0, 2), HOMATH_SHUFFLE(m.rows[1], m.rows[3], 1, 3, 1, 3)),
+			_mm_mul_ps(HOMATH_SHUFFLE(m.rows[0], m.rows[2], 1, 3, 1, 3), HOMATH_SHUFFLE(m.rows[1], m.rows[3], 0, 2, 0, 2)));
+		__m128 det_a = HOMATH_SHUFFLE(det_sub, det_sub, 0, 0, 0, 0);
+		__m128 det_b = HOMATH_SHUFFLE(det_sub, det_sub, 1, 1, 1, 1);
+		__m128 det_c = HOMATH_SHUFFLE(det_sub, det_sub, 2, 2, 2, 2);
+		__m128 det_d = HOMATH_SHUFFLE(det_sub, det_sub, 3, 3, 3, 3);
+
+		__m128 d_c = mat2::adj_mul(D, C);
+		__m128 a_b = mat2::adj_mul(A, B);
+		__m128 x = _mm_sub_ps(_mm_mul_ps(det_d, A), mat2::mul(B, d_c));
+		__m128 w = _mm_sub_ps(_mm_mul_ps(det_a, D), mat2::mul(C, a_b));
+		__m128 y = _mm_sub_ps(_mm_mul_ps(det_b, C), mat2::mul_adj(D, a_b));
+		__m128 z = _mm_sub_ps(_mm_mul_ps(det_c, B), mat2::mul_adj(A, d_c));
+
+		// |M| = |A||D| + |B||C| - trace((A#B)(D#C))
+		__m128 tr = _mm_mul_ps(a_b, HOMATH_SHUFFLE(d_c, d_c, 0, 2, 1, 3));
+		tr = _mm_add_ps(tr, HOMATH_SHUFFLE(tr, tr, 2, 3, 0, 1));
+		tr = _mm_add_ps(tr, HOMATH_SHUFFLE(tr, tr, 1, 0, 3, 2));
+		__m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+		__m128 rdet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det);
+
+		x = _mm_mul_ps(x, rdet);
+		y = _mm_mul_ps(y, rdet);
+		z = _mm_mul_ps(z, rdet);
+		w = _mm_mul_ps(w, rdet);
+
+		// Adjugate of each block and back to rows in one shuffle
+		r.rows[0] = HOMATH_SHUFFLE(x, y, 3, 1, 3, 1);
+		r.rows[1] = HOMATH_SHUFFLE(x, y, 2, 0, 2, 0);
+		r.rows[2] = HOMATH_SHUFFLE(z, w, 3, 1, 3, 1);
+		r.rows[3] = HOMATH_SHUFFLE(z, w, 2, 0, 2, 0);
+#undef HOMATH_SHUFFLE
+		return r;
+	}
+#endif
 
-	inline mat4 mat4::look_at(vec3 position, vec3 target, vec3 world_up) {
+	// Inverse of a matrix made only of rotation, scale and translation (no shear or projection),
+	// the 3x3 part is transposed and divided by the squared scale instead of doing a full inverse
+	template<typename T>
+	static tmat4<T> get_inverse_affine(const tmat4<T>& m) {
+		tmat4<T> r;
+		for (int i = 0; i < 3; ++i) {
+			T rscale_sq = T(1) / (m.m[0][i] * m.m[0][i] + m.m[1][i] * m.m[1][i] + m.m[2][i] * m.m[2][i]);
+			r.m[i][0] = m.m[0][i] * rscale_sq;
+			r.m[i][1] = m.m[1][i] * rscale_sq;
+			r.m[i][2] = m.m[2][i] * rscale_sq;
+		}
+		for (int i = 0; i < 3; ++i) {
+			r.m[i][3] = -(r.m[i][0] * m.m[0][3] + r.m[i][1] * m.m[1][3] + r.m[i][2] * m.m[2][3]);
+		}
+		r.m[3][3] = T(1);
+		return r;
+	}
+#if defined(HOMATH_SSE)
+	static mat4 get_inverse_affine(const mat4& m) {
+		mat4 r;
+		__m128 r0 = m.rows[0], r1 = m.rows[1], r2 = m.rows[2];
+		// Squared length of each column of the 3x3 part
+		__m128 scale_sq = simd_madd(r0, r0, simd_madd(r1, r1, _mm_mul_ps(r2, r2)));
+		__m128 rscale_sq = _mm_div_ps(_mm_set1_ps(1.0f), scale_sq);
+		r0 = _mm_mul_ps(r0, rscale_sq);
+		r1 = _mm_mul_ps(r1, rscale_sq);
+		r2 = _mm_mul_ps(r2, rscale_sq);
+
+		// New translation is -(inverse 3x3 * t), the scaled rows are the columns of the inverse
+		__m128 t = _mm_mul_ps(r0, _mm_set1_ps(m.m[0][3]));
+		t = simd_madd(r1, _mm_set1_ps(m.m[1][3]), t);
+		t = simd_madd(r2, _mm_set1_ps(m.m[2][3]), t);
+		t = _mm_sub_ps(_mm_setzero_ps(), t);
+
+		_MM_TRANSPOSE4_PS(r0, r1, r2, t);
+		r.rows[0] = r0;
+		r.rows[1] = r1;
+		r.rows[2] = r2;
+		r.rows[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+		return r;
+	}
+#endif
+
+	// left * right for matrices whose last row is (0, 0, 0, 1), the last row is not computed
+	template<typename T>
+	static tmat4<T> multiply_affine(const tmat4<T>& left, const tmat4<T>& right) {
+		tmat4<T> r;
+		for (int i = 0; i < 3; ++i) {
+			r.m[i][0] = left.m[i][0] * right.m[0][0] + left.m[i][1] * right.m[1][0] + left.m[i][2] * right.m[2][0];
+			r.m[i][1] = left.m[i][0] * right.m[0][1] + left.m[i][1] * right.m[1][1] + left.m[i][2] * right.m[2][1];
+			r.m[i][2] = left.m[i][0] * right.m[0][2] + left.m[i][1] * right.m[1][2] + left.m[i][2] * right.m[2][2];
+			r.m[i][3] = left.m[i][0] * right.m[0][3] + left.m[i][1] * right.m[1][3] + left.m[i][2] * right.m[2][3] + left.m[i][3];
+		}
+		r.m[3][3] = T(1);
+		return r;
+	}
+#if defined(HOMATH_SSE)
+	static mat4 multiply_affine(const mat4& left, const mat4& right) {
+		mat4 r;
+#if defined(HOMATH_AVX)
+		// Same as operator* minus the fourth row of 'right', left's translation seeds the w lane
+		__m256 w_mask = _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1));
+		__m256 l01 = _mm256_loadu_ps(left.data);
+		__m256 l23 = _mm256_loadu_ps(left.data + 8);
+		__m256 b0 = _mm256_broadcast_ps(&right.rows[0]);
+		__m256 b1 = _mm256_broadcast_ps(&right.rows[1]);
+		__m256 b2 = _mm256_broadcast_ps(&right.rows[2]);
+
+		__m256 r01 = simd_madd(_mm256_shuffle_ps(l01, l01, 0x00), b0, _mm256_and_ps(l01, w_mask));
+		r01 = simd_madd(_mm256_shuffle_ps(l01, l01, 0x55), b1, r01);
+		r01 = simd_madd(_mm256_shuffle_ps(l01, l01, 0xaa), b2, r01);
+		__m256 r23 = simd_madd(_mm256_shuffle_ps(l23, l23, 0x00), b0, _mm256_and_ps(l23, w_mask));
+		r23 = simd_madd(_mm256_shuffle_ps(l23, l23, 0x55), b1, r23);
+		r23 = simd_madd(_mm256_shuffle_ps(l23, l23, 0xaa), b2, r23);
+
+		_mm256_storeu_ps(r.data, r01);
+		_mm256_storeu_ps(r.data + 8, r23);
+		r.rows[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+#else
+		// right's last row is (0 0 0 1) so left's translation is only added to the w lane
+		__m128 w_mask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+		for (int i = 0; i < 3; ++i) {
+			__m128 row = left.rows[i];
+			__m128 result = simd_madd(_mm_shuffle_ps(row, row, 0x00), right.rows[0], _mm_and_ps(row, w_mask));
+			result = simd_madd(_mm_shuffle_ps(row, row, 0x55), right.rows[1], result);
+			r.rows[i] = simd_madd(_mm_shuffle_ps(row, row, 0xaa), right.rows[2], result);
+		}
+		r.rows[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+#endif
+		return r;
+	}
+#endif
+
+	template<typename T>
+	inline tmat4<T> tmat4<T>::look_at(tvec3<T> position, tvec3<T> target, tvec3<T> world_up) {
 		// 1. Position = known
 		// 2. Calculate cameraDirection
-		vec3 diff = position - target;
-		vec3 zaxis = vec3::normalize(diff);
+		tvec3<T> diff = position - target;
+		tvec3<T> zaxis = tvec3<T>::normalize(diff);
 		// 3. Get positive right axis vector
-		vec3 normalized_world_up = vec3::normalize(world_up);
-		vec3 cross_nwu_zax = vec3::cross(normalized_world_up, zaxis);
-		vec3 xaxis = vec3::normalize(cross_nwu_zax);
+		tvec3<T> normalized_world_up = tvec3<T>::normalize(world_up);
+		tvec3<T> cross_nwu_zax = tvec3<T>::cross(normalized_world_up, zaxis);
+		tvec3<T> xaxis = tvec3<T>::normalize(cross_nwu_zax);
 		// 4. Calculate camera up vector
-		vec3 yaxis = vec3::cross(zaxis, xaxis);
+		tvec3<T> yaxis = tvec3<T>::cross(zaxis, xaxis);
 
 		// Create translation and rotation matrix
 		// In glm we access elements as mat[col][row] due to column-major layout
-		mat4 translation; // Identity matrix by default
-		mat4::identity(translation);
+		tmat4<T> translation; // Identity matrix by default
+		tmat4<T>::identity(translation);
 		translation.m[3][0] = -position.x; // Third column, first row
 		translation.m[3][1] = -position.y;
 		translation.m[3][2] = -position.z;
-		mat4 rotation;
-		mat4::identity(rotation);
+		tmat4<T> rotation;
+		tmat4<T>::identity(rotation);
 		rotation.m[0][0] = xaxis.x; // First column, first row
 		rotation.m[1][0] = xaxis.y;
 		rotation.m[2][0] = xaxis.z;
@@ -436,37 +1208,39 @@ namespace hm {
 		return translation * rotation; // Remember to read from right to left (first translation then rotation)
 	}
 
-	inline mat4 mat4::ortho(float left, float right, float bottom, float top)
+	template<typename T>
+	inline tmat4<T> tmat4<T>::ortho(T left, T right, T bottom, T top)
 	{
-		float f = 1.0f;
-		float n = -1.0f;
-		mat4 result;
-		result.m[0][0] = 2.0f / (right - left);	result.m[0][1] = 0;						result.m[0][2] = 0;					result.m[0][3] = -(right + left) / (right - left);
-		result.m[1][0] = 0;						result.m[1][1] = 2.0f / (top - bottom);	result.m[1][2] = 0;					result.m[1][3] = -(top + bottom) / (top - bottom);
-		result.m[2][0] = 0;						result.m[2][1] = 0;						result.m[2][2] = 1;					result.m[2][3] = 0;
-		result.m[3][0] = 0;						result.m[3][1] = 0;						result.m[3][2] = 0;					result.m[3][3] = 1;
+		tmat4<T> result;
+		result.m[0][0] = T(2) / (right - left);	result.m[0][1] = T(0);					result.m[0][2] = T(0);				result.m[0][3] = -(right + left) / (right - left);
+		result.m[1][0] = T(0);					result.m[1][1] = T(2) / (top - bottom);	result.m[1][2] = T(0);				result.m[1][3] = -(top + bottom) / (top - bottom);
+		result.m[2][0] = T(0);					result.m[2][1] = T(0);					result.m[2][2] = T(1);				result.m[2][3] = T(0);
+		result.m[3][0] = T(0);					result.m[3][1] = T(0);					result.m[3][2] = T(0);				result.m[3][3] = T(1);
 
 		return result;
 	}
 
-	struct quat
+	template<typename T>
+	struct tquat
 	{
-		float x, y, z, w;
+		typedef T scalar;
+
+		T x, y, z, w;
 
-		quat() : x(0), y(0), z(0), w(0) { }
+		tquat() : x(0), y(0), z(0), w(0) { }
 
-		quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) { }
+		tquat(T x, T y, T z, T w) : x(x), y(y), z(z), w(w) { }
 
-		quat(float angle) {
-			x = sinf(angle) / 2.0f;
-			y = sinf(angle) / 2.0f;
-			z = sinf(angle) / 2.0f;
-			w = cosf(angle) / 2.0f;
+		tquat(T angle) {
+			x = math_sin(angle) / T(2);
+			y = math_sin(angle) / T(2);
+			z = math_sin(angle) / T(2);
+			w = math_cos(angle) / T(2);
 		}
 
-		inline quat operator*(const quat r)
+		inline tquat operator*(const tquat r)
 		{
-			quat res;
+			tquat res;
 			res.w = this->w*r.w - this->x*r.x - this->y*r.y - this->z*r.z;
 			res.x = this->w*r.x + this->x*r.w + this->y*r.z - this->z*r.y;
 			res.y = this->w*r.y + this->y*r.w + this->z*r.x - this->x*r.z;
@@ -475,21 +1249,21 @@ namespace hm {
 			return res;
 		}
 
-		static inline float length(quat& q) {
-			return sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+		static inline T length(tquat& q) {
+			return math_sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
 		}
 
-		static inline void normalize(quat& q) {
-			float len = length(q);
+		static inline void normalize(tquat& q) {
+			T len = length(q);
 			q.x /= len;
 			q.y /= len;
 			q.z /= len;
 			q.w /= len;
 		}
 
-		inline quat normalize() {
-			quat q;
-			float length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+		inline tquat normalize() {
+			tquat q;
+			T length = math_sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
 
 			q.x /= length;
 			q.y /= length;
@@ -499,8 +1273,8 @@ namespace hm {
 			return(q);
 		}
 
-		static inline quat conjugate(quat& q) {
-			quat result;
+		static inline tquat conjugate(tquat& q) {
+			tquat result;
 			result.x = -q.x;
 			result.y = -q.y;
 			result.z = -q.z;
@@ -509,40 +1283,46 @@ namespace hm {
 
 	};
 
-	static inline mat4 quat_rotate(const quat& quat)
+	typedef tquat<float> quat;
+	typedef tquat<double> dquat;
+	typedef tquat<fixed> xquat;
+
+	template<typename T>
+	static inline tmat4<T> quat_rotate(const tquat<T>& quat)
 	{
-		mat4 result;
+		tmat4<T> result;
 
-		result.m[0][0] = 1.0f - 2.0f * quat.y * quat.y - 2.0f * quat.z * quat.z;
-		result.m[1][0] = 2.0f * quat.x * quat.y + 2.0f * quat.w * quat.z;
-		result.m[2][0] = 2.0f * quat.x * quat.z - 2.0f * quat.w * quat.y;
-		result.m[3][0] = 0;
+		result.m[0][0] = T(1) - T(2) * quat.y * quat.y - T(2) * quat.z * quat.z;
+		result.m[1][0] = T(2) * quat.x * quat.y + T(2) * quat.w * quat.z;
+		result.m[2][0] = T(2) * quat.x * quat.z - T(2) * quat.w * quat.y;
+		result.m[3][0] = T(0);
 
-		result.m[0][1] = 2.0f * quat.x * quat.y - 2.0f * quat.w * quat.z;
-		result.m[1][1] = 1.0f - (2.0f * quat.x * quat.x) - (2.0f * quat.z * quat.z);
-		result.m[2][1] = 2.0f * quat.y * quat.z + 2.0f * quat.w * quat.x;
-		result.m[3][1] = 0;
+		result.m[0][1] = T(2) * quat.x * quat.y - T(2) * quat.w * quat.z;
+		result.m[1][1] = T(1) - (T(2) * quat.x * quat.x) - (T(2) * quat.z * quat.z);
+		result.m[2][1] = T(2) * quat.y * quat.z + T(2) * quat.w * quat.x;
+		result.m[3][1] = T(0);
 
-		result.m[0][2] = 2.0f * quat.x * quat.z + 2.0f * quat.w * quat.y;
-		result.m[1][2] = 2.0f * quat.y * quat.z - 2.0f * quat.w * quat.x;
-		result.m[2][2] = 1.0f - (2.0f * quat.x * quat.x) - (2.0f * quat.y * quat.y);
-		result.m[3][2] = 0;
+		result.m[0][2] = T(2) * quat.x * quat.z + T(2) * quat.w * quat.y;
+		result.m[1][2] = T(2) * quat.y * quat.z - T(2) * quat.w * quat.x;
+		result.m[2][2] = T(1) - (T(2) * quat.x * quat.x) - (T(2) * quat.y * quat.y);
+		result.m[3][2] = T(0);
 
-		result.m[0][3] = 0;
-		result.m[1][3] = 0;
-		result.m[2][3] = 0;
-		result.m[3][3] = 1;
+		result.m[0][3] = T(0);
+		result.m[1][3] = T(0);
+		result.m[2][3] = T(0);
+		result.m[3][3] = T(1);
 
 		return(result);
 	}
 
-	static inline quat quat_from_axis_angle(vec3 axis, float angle)
+	template<typename T>
+	static inline tquat<T> quat_from_axis_angle(tvec3<T> axis, typename tquat<T>::scalar angle)
 	{
-		vec3::normalize(axis);
-		float sang = sinf(DEGTORAD(angle) / 2.0f);
+		tvec3<T>::normalize(axis);
+		T sang = math_sin(radians(angle) / T(2));
 
-		quat q;
-		q.w = cosf(DEGTORAD(angle / 2.0f));
+		tquat<T> q;
+		q.w = math_cos(radians(angle / T(2)));
 		q.x = axis.x * sang;
 		q.y = axis.y * sang;
 		q.z = axis.z * sang;
@@ -550,4 +1330,451 @@ namespace hm {
 		return q;
 	}
 
+	// ---------------
+	// --- Batches ---
+	// ---------------
+
+	// Structure of arrays views, element i is (x[i], y[i], z[i]). The arrays don't need to be aligned.
+	// Batches are processed 8 at a time with AVX and 4 at a time with SSE.
+	struct vec3_soa {
+		float* x;
+		float* y;
+		float* z;
+	};
+
+	struct quat_soa {
+		float* x;
+		float* y;
+		float* z;
+		float* w;
+	};
+
+	// out[i] = m * in[i] as points (w = 1), 'out' may be 'in'
+	static void mat4_transform_points(const mat4& m, vec3_soa in, vec3_soa out, int count) {
+		int i = 0;
+#if defined(HOMATH_AVX)
+		{
+			__m256 m00 = _mm256_set1_ps(m.m[0][0]), m01 = _mm256_set1_ps(m.m[0][1]), m02 = _mm256_set1_ps(m.m[0][2]), m03 = _mm256_set1_ps(m.m[0][3]);
+			__m256 m10 = _mm256_set1_ps(m.m[1][0]), m11 = _mm256_set1_ps(m.m[1][1]), m12 = _mm256_set1_ps(m.m[1][2]), m13 = _mm256_set1_ps(m.m[1][3]);
+			__m256 m20 = _mm256_set1_ps(m.m[2][0]), m21 = _mm256_set1_ps(m.m[2][1]), m22 = _mm256_set1_ps(m.m[2][2]), m23 = _mm256_set1_ps(m.m[2][3]);
+			for (; i + 8 <= count; i += 8) {
+				__m256 x = _mm256_loadu_ps(in.x + i);
+				__m256 y = _mm256_loadu_ps(in.y + i);
+				__m256 z = _mm256_loadu_ps(in.z + i);
+				_mm256_storeu_ps(out.x + i, simd_madd(m00, x, simd_madd(m01, y, simd_madd(m02, z, m03))));
+				_mm256_storeu_ps(out.y + i, simd_madd(m10, x, simd_madd(m11, y, simd_madd(m12, z, m13))));
+				_mm256_storeu_ps(out.z + i, simd_madd(m20, x, simd_madd(m21, y, simd_madd(m22, z, m23))));
+			}
+		}
+#endif
+#if defined(HOMATH_SSE)
+		{
+			__m128 m00 = _mm_set1_ps(m.m[0][0]), m01 = _mm_set1_ps(m.m[0][1]), m02 = _mm_set1_ps(m.m[0][2]), m03 = _mm_set1_ps(m.m[0][3]);
+			__m128 m10 = _mm_set1_ps(m.m[1][0]), m11 = _mm_set1_ps(m.m[1][1]), m12 = _mm_set1_ps(m.m[1][2]), m13 = _mm_set1_ps(m.m[1][3]);
+			__m128 m20 = _mm_set1_ps(m.m[2][0]), m21 = _mm_set1_ps(m.m[2][1]), m22 = _mm_set1_ps(m.m[2][2]), m23 = _mm_set1_ps(m.m[2][3]);
+			for (; i + 4 <= count; i += 4) {
+				__m128 x = _mm_loadu_ps(in.x + i);
+				__m128 y = _mm_loadu_ps(in.y + i);
+				__m128 z = _mm_loadu_ps(in.z + i);
+				_mm_storeu_ps(out.x + i, simd_madd(m00, x, simd_madd(m01, y, simd_madd(m02, z, m03))));
+				_mm_storeu_ps(out.y + i, simd_madd(m10, x, simd_madd(m11, y, simd_madd(m12, z, m13))));
+				_mm_storeu_ps(out.z + i, simd_madd(m20, x, simd_madd(m21, y, simd_madd(m22, z, m23))));
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			float x = in.x[i], y = in.y[i], z = in.z[i];
+			out.x[i] = m.m[0][0] * x + m.m[0][1] * y + m.m[0][2] * z + m.m[0][3];
+			out.y[i] = m.m[1][0] * x + m.m[1][1] * y + m.m[1][2] * z + m.m[1][3];
+			out.z[i] = m.m[2][0] * x + m.m[2][1] * y + m.m[2][2] * z + m.m[2][3];
+		}
+	}
+
+	// Same for an array of vec3
+	static void mat4_transform_points(const mat4& m, const vec3* in, vec3* out, int count) {
+		int i = 0;
+#if defined(HOMATH_AVX)
+		{
+			// Same shuffles as below, the low halves hold points 0-3 and the high halves points 4-7
+			__m256 m00 = _mm256_set1_ps(m.m[0][0]), m01 = _mm256_set1_ps(m.m[0][1]), m02 = _mm256_set1_ps(m.m[0][2]), m03 = _mm256_set1_ps(m.m[0][3]);
+			__m256 m10 = _mm256_set1_ps(m.m[1][0]), m11 = _mm256_set1_ps(m.m[1][1]), m12 = _mm256_set1_ps(m.m[1][2]), m13 = _mm256_set1_ps(m.m[1][3]);
+			__m256 m20 = _mm256_set1_ps(m.m[2][0]), m21 = _mm256_set1_ps(m.m[2][1]), m22 = _mm256_set1_ps(m.m[2][2]), m23 = _mm256_set1_ps(m.m[2][3]);
+			for (; i + 8 <= count; i += 8) {
+				const float* p = &in[i].x;
+				__m256 a = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 12), 1);
+				__m256 b = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 16), 1);
+				__m256 c = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 20), 1);
+				__m256 x = _mm256_shuffle_ps(a, _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)), _MM_SHUFFLE(3, 0, 3, 0));
+				__m256 y = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+				__m256 z = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+
+				__m256 rx = simd_madd(m00, x, simd_madd(m01, y, simd_madd(m02, z, m03)));
+				__m256 ry = simd_madd(m10, x, simd_madd(m11, y, simd_madd(m12, z, m13)));
+				__m256 rz = simd_madd(m20, x, simd_madd(m21, y, simd_madd(m22, z, m23)));
+				a = _mm256_shuffle_ps(_mm256_shuffle_ps(rx, ry, _MM_SHUFFLE(0, 0, 0, 0)), _mm256_shuffle_ps(rz, rx, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+				b = _mm256_shuffle_ps(_mm256_shuffle_ps(ry, rz, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_shuffle_ps(rx, ry, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+				c = _mm256_shuffle_ps(_mm256_shuffle_ps(rz, rx, _MM_SHUFFLE(3, 3, 2, 2)), _mm256_shuffle_ps(ry, rz, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+				float* o = &out[i].x;
+				_mm_storeu_ps(o, _mm256_castps256_ps128(a));
+				_mm_storeu_ps(o + 4, _mm256_castps256_ps128(b));
+				_mm_storeu_ps(o + 8, _mm256_castps256_ps128(c));
+				_mm_storeu_ps(o + 12, _mm256_extractf128_ps(a, 1));
+				_mm_storeu_ps(o + 16, _mm256_extractf128_ps(b, 1));
+				_mm_storeu_ps(o + 20, _mm256_extractf128_ps(c, 1));
+			}
+		}
+#endif
+#if defined(HOMATH_SSE)
+		{
+			// Four points are three registers, shuffled to x, y and z lanes and back
+			__m128 m00 = _mm_set1_ps(m.m[0][0]), m01 = _mm_set1_ps(m.m[0][1]), m02 = _mm_set1_ps(m.m[0][2]), m03 = _mm_set1_ps(m.m[0][3]);
+			__m128 m10 = _mm_set1_ps(m.m[1][0]), m11 = _mm_set1_ps(m.m[1][1]), m12 = _mm_set1_ps(m.m[1][2]), m13 = _mm_set1_ps(m.m[1][3]);
+			__m128 m20 = _mm_set1_ps(m.m[2][0]), m21 = _mm_set1_ps(m.m[2][1]), m22 = _mm_set1_ps(m.m[2][2]), m23 = _mm_set1_ps(m.m[2][3]);
+			for (; i + 4 <= count; i += 4) {
+				const float* p = &in[i].x;
+				__m128 a = _mm_loadu_ps(p);     // x0 y0 z0 x1
+				__m128 b = _mm_loadu_ps(p + 4); // y1 z1 x2 y2
+				__m128 c = _mm_loadu_ps(p + 8); // z2 x3 y3 z3
+				__m128 x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)), _MM_SHUFFLE(3, 0, 3, 0));
+				__m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+				__m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+
+				__m128 rx = simd_madd(m00, x, simd_madd(m01, y, simd_madd(m02, z, m03)));
+				__m128 ry = simd_madd(m10, x, simd_madd(m11, y, simd_madd(m12, z, m13)));
+				__m128 rz = simd_madd(m20, x, simd_madd(m21, y, simd_madd(m22, z, m23)));
+				float* o = &out[i].x;
+				_mm_storeu_ps(o, _mm_shuffle_ps(_mm_shuffle_ps(rx, ry, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(rz, rx, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+				_mm_storeu_ps(o + 4, _mm_shuffle_ps(_mm_shuffle_ps(ry, rz, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(rx, ry, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+				_mm_storeu_ps(o + 8, _mm_shuffle_ps(_mm_shuffle_ps(rz, rx, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(ry, rz, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			out[i] = m * in[i];
+		}
+	}
+
+	// out[i] = left[i] * right[i], each product goes through the SSE/AVX operator*
+	static void mat4_multiply_batch(const mat4* left, const mat4* right, mat4* out, int count) {
+		for (int i = 0; i < count; ++i) {
+			out[i] = left[i] * right[i];
+		}
+	}
+
+	static void vec3_normalize_batch(vec3_soa v, int count) {
+		int i = 0;
+#if defined(HOMATH_AVX)
+		for (; i + 8 <= count; i += 8) {
+			__m256 x = _mm256_loadu_ps(v.x + i);
+			__m256 y = _mm256_loadu_ps(v.y + i);
+			__m256 z = _mm256_loadu_ps(v.z + i);
+			__m256 len_sq = simd_madd(x, x, simd_madd(y, y, _mm256_mul_ps(z, z)));
+#if defined(HOMATH_FAST_MATH)
+			__m256 rlen = simd_rsqrt(len_sq);
+			_mm256_storeu_ps(v.x + i, _mm256_mul_ps(x, rlen));
+			_mm256_storeu_ps(v.y + i, _mm256_mul_ps(y, rlen));
+			_mm256_storeu_ps(v.z + i, _mm256_mul_ps(z, rlen));
+#else
+			__m256 len = _mm256_sqrt_ps(len_sq);
+			_mm256_storeu_ps(v.x + i, _mm256_div_ps(x, len));
+			_mm256_storeu_ps(v.y + i, _mm256_div_ps(y, len));
+			_mm256_storeu_ps(v.z + i, _mm256_div_ps(z, len));
+#endif
+		}
+#endif
+#if defined(HOMATH_SSE)
+		for (; i + 4 <= count; i += 4) {
+			__m128 x = _mm_loadu_ps(v.x + i);
+			__m128 y = _mm_loadu_ps(v.y + i);
+			__m128 z = _mm_loadu_ps(v.z + i);
+			__m128 len_sq = simd_madd(x, x, simd_madd(y, y, _mm_mul_ps(z, z)));
+#if defined(HOMATH_FAST_MATH)
+			__m128 rlen = simd_rsqrt(len_sq);
+			_mm_storeu_ps(v.x + i, _mm_mul_ps(x, rlen));
+			_mm_storeu_ps(v.y + i, _mm_mul_ps(y, rlen));
+			_mm_storeu_ps(v.z + i, _mm_mul_ps(z, rlen));
+#else
+			__m128 len = _mm_sqrt_ps(len_sq);
+			_mm_storeu_ps(v.x + i, _mm_div_ps(x, len));
+			_mm_storeu_ps(v.y + i, _mm_div_ps(y, len));
+			_mm_storeu_ps(v.z + i, _mm_div_ps(z, len));
+#endif
+		}
+#endif
+		for (; i < count; ++i) {
+#if defined(HOMATH_FAST_MATH)
+			float rlen = fast_rsqrt(v.x[i] * v.x[i] + v.y[i] * v.y[i] + v.z[i] * v.z[i]);
+			v.x[i] *= rlen;
+			v.y[i] *= rlen;
+			v.z[i] *= rlen;
+#else
+			float len = sqrtf(v.x[i] * v.x[i] + v.y[i] * v.y[i] + v.z[i] * v.z[i]);
+			v.x[i] /= len;
+			v.y[i] /= len;
+			v.z[i] /= len;
+#endif
+		}
+	}
+
+	// s[i] = sin(angles[i]), c[i] = cos(angles[i]) with the fast math polynomials, 's' or 'c' may be 'angles'
+	static void sincos_batch(const float* angles, float* s, float* c, int count) {
+		int i = 0;
+#if defined(HOMATH_AVX) && defined(__AVX2__)
+		for (; i + 8 <= count; i += 8) {
+			__m256 vs, vc;
+			simd_sincos(_mm256_loadu_ps(angles + i), &vs, &vc);
+			_mm256_storeu_ps(s + i, vs);
+			_mm256_storeu_ps(c + i, vc);
+		}
+#endif
+#if defined(HOMATH_SSE)
+		for (; i + 4 <= count; i += 4) {
+			__m128 vs, vc;
+			simd_sincos(_mm_loadu_ps(angles + i), &vs, &vc);
+			_mm_storeu_ps(s + i, vs);
+			_mm_storeu_ps(c + i, vc);
+		}
+#endif
+		for (; i < count; ++i) {
+			fast_sincos(angles[i], s + i, c + i);
+		}
+	}
+
+	// out[i] = quat_rotate(q[i])
+	static void quat_rotate_batch(quat_soa q, mat4* out, int count) {
+		int i = 0;
+#if defined(HOMATH_AVX)
+		// Compute the 3x3 part of 8 matrices in lanes, then write them out one by one
+		float r[9][8];
+		__m256 one = _mm256_set1_ps(1.0f);
+		__m256 two = _mm256_set1_ps(2.0f);
+		for (; i + 8 <= count; i += 8) {
+			__m256 x = _mm256_loadu_ps(q.x + i);
+			__m256 y = _mm256_loadu_ps(q.y + i);
+			__m256 z = _mm256_loadu_ps(q.z + i);
+			__m256 w = _mm256_loadu_ps(q.w + i);
+			__m256 x2 = _mm256_mul_ps(two, x), y2 = _mm256_mul_ps(two, y), z2 = _mm256_mul_ps(two, z);
+			__m256 xx = _mm256_mul_ps(x2, x), yy = _mm256_mul_ps(y2, y), zz = _mm256_mul_ps(z2, z);
+			__m256 xy = _mm256_mul_ps(x2, y), xz = _mm256_mul_ps(x2, z), yz = _mm256_mul_ps(y2, z);
+			__m256 wx = _mm256_mul_ps(x2, w), wy = _mm256_mul_ps(y2, w), wz = _mm256_mul_ps(z2, w);
+
+			_mm256_storeu_ps(r[0], _mm256_sub_ps(_mm256_sub_ps(one, yy), zz));
+			_mm256_storeu_ps(r[1], _mm256_sub_ps(xy, wz));
+			_mm256_storeu_ps(r[2], _mm256_add_ps(xz, wy));
+			_mm256_storeu_ps(r[3], _mm256_add_ps(xy, wz));
+			_mm256_storeu_ps(r[4], _mm256_sub_ps(_mm256_sub_ps(one, xx), zz));
+			_mm256_storeu_ps(r[5], _mm256_sub_ps(yz, wx));
+			_mm256_storeu_ps(r[6], _mm256_sub_ps(xz, wy));
+			_mm256_storeu_ps(r[7], _mm256_add_ps(yz, wx));
+			_mm256_storeu_ps(r[8], _mm256_sub_ps(_mm256_sub_ps(one, xx), yy));
+
+			for (int j = 0; j < 8; ++j) {
+				mat4& result = out[i + j];
+				result.rows[0] = _mm_setr_ps(r[0][j], r[1][j], r[2][j], 0.0f);
+				result.rows[1] = _mm_setr_ps(r[3][j], r[4][j], r[5][j], 0.0f);
+				result.rows[2] = _mm_setr_ps(r[6][j], r[7][j], r[8][j], 0.0f);
+				result.rows[3] = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+			}
+		}
+#endif
+#if defined(HOMATH_SSE)
+		{
+			// Four matrices in lanes, transposing (r0 r1 r2 0) gives the first row of each and so on
+			__m128 one = _mm_set1_ps(1.0f);
+			__m128 two = _mm_set1_ps(2.0f);
+			__m128 last = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+			for (; i + 4 <= count; i += 4) {
+				__m128 x = _mm_loadu_ps(q.x + i);
+				__m128 y = _mm_loadu_ps(q.y + i);
+				__m128 z = _mm_loadu_ps(q.z + i);
+				__m128 w = _mm_loadu_ps(q.w + i);
+				__m128 x2 = _mm_mul_ps(two, x), y2 = _mm_mul_ps(two, y), z2 = _mm_mul_ps(two, z);
+				__m128 xx = _mm_mul_ps(x2, x), yy = _mm_mul_ps(y2, y), zz = _mm_mul_ps(z2, z);
+				__m128 xy = _mm_mul_ps(x2, y), xz = _mm_mul_ps(x2, z), yz = _mm_mul_ps(y2, z);
+				__m128 wx = _mm_mul_ps(x2, w), wy = _mm_mul_ps(y2, w), wz = _mm_mul_ps(z2, w);
+				__m128 rows[3][4] = {
+					{ _mm_sub_ps(_mm_sub_ps(one, yy), zz), _mm_sub_ps(xy, wz), _mm_add_ps(xz, wy), _mm_setzero_ps() },
+					{ _mm_add_ps(xy, wz), _mm_sub_ps(_mm_sub_ps(one, xx), zz), _mm_sub_ps(yz, wx), _mm_setzero_ps() },
+					{ _mm_sub_ps(xz, wy), _mm_add_ps(yz, wx), _mm_sub_ps(_mm_sub_ps(one, xx), yy), _mm_setzero_ps() },
+				};
+				for (int r = 0; r < 3; ++r) {
+					_MM_TRANSPOSE4_PS(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+					for (int j = 0; j < 4; ++j) {
+						out[i + j].rows[r] = rows[r][j];
+					}
+				}
+				for (int j = 0; j < 4; ++j) {
+					out[i + j].rows[3] = last;
+				}
+			}
+		}
+#endif
+		for (; i < count; ++i) {
+			out[i] = quat_rotate(quat(q.x[i], q.y[i], q.z[i], q.w[i]));
+		}
+	}
+
+	// ---------------
+	// --- Culling ---
+	// ---------------
+
+	// Planes are (a, b, c, d) with a * x + b * y + c * z + d >= 0 inside, normalized so that is the distance
+	struct frustum {
+		vec4 planes[6]; // left, right, bottom, top, near, far
+	};
+
+	// Gribb-Hartmann extraction from a view projection laid out like perspective and look_at (m[column][row]),
+	// that is look_at(...) * perspective(...). Transpose a row-major one first.
+	static frustum frustum_from_matrix(const mat4& view_projection) {
+		const mat4& m = view_projection;
+		frustum f;
+		for (int i = 0; i < 3; ++i) {
+			vec4 row(m.m[0][i], m.m[1][i], m.m[2][i], m.m[3][i]);
+			vec4 w(m.m[0][3], m.m[1][3], m.m[2][3], m.m[3][3]);
+			f.planes[i * 2] = vec4(w.x + row.x, w.y + row.y, w.z + row.z, w.w + row.w);
+			f.planes[i * 2 + 1] = vec4(w.x - row.x, w.y - row.y, w.z - row.z, w.w - row.w);
+		}
+		for (int i = 0; i < 6; ++i) {
+			vec4& p = f.planes[i];
+			float rlen = 1.0f / sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+			p = vec4(p.x * rlen, p.y * rlen, p.z * rlen, p.w * rlen);
+		}
+		return f;
+	}
+
+	static bool frustum_test_sphere(const frustum& f, vec3 center, float radius) {
+		for (int i = 0; i < 6; ++i) {
+			const vec4& p = f.planes[i];
+			if (p.x * center.x + p.y * center.y + p.z * center.z + p.w + radius < 0.0f) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Conservative, boxes near a corner of the frustum may pass
+	static bool frustum_test_aabb(const frustum& f, vec3 center, vec3 extent) {
+		for (int i = 0; i < 6; ++i) {
+			const vec4& p = f.planes[i];
+			float d = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+			float e = fabsf(p.x) * extent.x + fabsf(p.y) * extent.y + fabsf(p.z) * extent.z;
+			if (d + e < 0.0f) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Bit i % 32 of visible[i / 32] is set when sphere i intersects the frustum, 'visible' holds (count + 31) / 32 words.
+	// Each lane keeps the smallest plane distance and compares it to the radius once.
+	static void frustum_cull_spheres(const frustum& f, vec3_soa center, const float* radius, unsigned int* visible, int count) {
+		for (int base = 0; base < count; base += 32) {
+			int n = count - base < 32 ? count - base : 32;
+			unsigned int bits = 0;
+			int i = 0;
+#if defined(HOMATH_AVX)
+			for (; i + 8 <= n; i += 8) {
+				__m256 x = _mm256_loadu_ps(center.x + base + i);
+				__m256 y = _mm256_loadu_ps(center.y + base + i);
+				__m256 z = _mm256_loadu_ps(center.z + base + i);
+				__m256 dist = _mm256_set1_ps(INFINITY);
+				for (int p = 0; p < 6; ++p) {
+					const vec4& plane = f.planes[p];
+					__m256 d = simd_madd(_mm256_set1_ps(plane.x), x, simd_madd(_mm256_set1_ps(plane.y), y, simd_madd(_mm256_set1_ps(plane.z), z, _mm256_set1_ps(plane.w))));
+					dist = _mm256_min_ps(dist, d);
+				}
+				__m256 r = _mm256_loadu_ps(radius + base + i);
+				__m256 inside = _mm256_cmp_ps(_mm256_add_ps(dist, r), _mm256_setzero_ps(), _CMP_GE_OQ);
+				bits |= (unsigned int)_mm256_movemask_ps(inside) << i;
+			}
+#endif
+#if defined(HOMATH_SSE)
+			for (; i + 4 <= n; i += 4) {
+				__m128 x = _mm_loadu_ps(center.x + base + i);
+				__m128 y = _mm_loadu_ps(center.y + base + i);
+				__m128 z = _mm_loadu_ps(center.z + base + i);
+				__m128 dist = _mm_set1_ps(INFINITY);
+				for (int p = 0; p < 6; ++p) {
+					const vec4& plane = f.planes[p];
+					__m128 d = simd_madd(_mm_set1_ps(plane.x), x, simd_madd(_mm_set1_ps(plane.y), y, simd_madd(_mm_set1_ps(plane.z), z, _mm_set1_ps(plane.w))));
+					dist = _mm_min_ps(dist, d);
+				}
+				__m128 r = _mm_loadu_ps(radius + base + i);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(dist, r), _mm_setzero_ps());
+				bits |= (unsigned int)_mm_movemask_ps(inside) << i;
+			}
+#endif
+			for (; i < n; ++i) {
+				int j = base + i;
+				if (frustum_test_sphere(f, vec3(center.x[j], center.y[j], center.z[j]), radius[j])) {
+					bits |= 1u << i;
+				}
+			}
+			visible[base / 32] = bits;
+		}
+	}
+
+	// Same for boxes given by center and half extent, with the conservative test of frustum_test_aabb
+	static void frustum_cull_aabbs(const frustum& f, vec3_soa center, vec3_soa extent, unsigned int* visible, int count) {
+#if defined(HOMATH_SSE)
+		float abs_normals[6][3];
+		for (int p = 0; p < 6; ++p) {
+			abs_normals[p][0] = fabsf(f.planes[p].x);
+			abs_normals[p][1] = fabsf(f.planes[p].y);
+			abs_normals[p][2] = fabsf(f.planes[p].z);
+		}
+#endif
+
+		for (int base = 0; base < count; base += 32) {
+			int n = count - base < 32 ? count - base : 32;
+			unsigned int bits = 0;
+			int i = 0;
+#if defined(HOMATH_AVX)
+			for (; i + 8 <= n; i += 8) {
+				__m256 x = _mm256_loadu_ps(center.x + base + i);
+				__m256 y = _mm256_loadu_ps(center.y + base + i);
+				__m256 z = _mm256_loadu_ps(center.z + base + i);
+				__m256 ex = _mm256_loadu_ps(extent.x + base + i);
+				__m256 ey = _mm256_loadu_ps(extent.y + base + i);
+				__m256 ez = _mm256_loadu_ps(extent.z + base + i);
+				__m256 dist = _mm256_set1_ps(INFINITY);
+				for (int p = 0; p < 6; ++p) {
+					const vec4& plane = f.planes[p];
+					__m256 d = simd_madd(_mm256_set1_ps(plane.x), x, simd_madd(_mm256_set1_ps(plane.y), y, simd_madd(_mm256_set1_ps(plane.z), z, _mm256_set1_ps(plane.w))));
+					d = simd_madd(_mm256_set1_ps(abs_normals[p][0]), ex, simd_madd(_mm256_set1_ps(abs_normals[p][1]), ey, simd_madd(_mm256_set1_ps(abs_normals[p][2]), ez, d)));
+					dist = _mm256_min_ps(dist, d);
+				}
+				__m256 inside = _mm256_cmp_ps(dist, _mm256_setzero_ps(), _CMP_GE_OQ);
+				bits |= (unsigned int)_mm256_movemask_ps(inside) << i;
+			}
+#endif
+#if defined(HOMATH_SSE)
+			for (; i + 4 <= n; i += 4) {
+				__m128 x = _mm_loadu_ps(center.x + base + i);
+				__m128 y = _mm_loadu_ps(center.y + base + i);
+				__m128 z = _mm_loadu_ps(center.z + base + i);
+				__m128 ex = _mm_loadu_ps(extent.x + base + i);
+				__m128 ey = _mm_loadu_ps(extent.y + base + i);
+				__m128 ez = _mm_loadu_ps(extent.z + base + i);
+				__m128 dist = _mm_set1_ps(INFINITY);
+				for (int p = 0; p < 6; ++p) {
+					const vec4& plane = f.planes[p];
+					__m128 d = simd_madd(_mm_set1_ps(plane.x), x, simd_madd(_mm_set1_ps(plane.y), y, simd_madd(_mm_set1_ps(plane.z), z, _mm_set1_ps(plane.w))));
+					d = simd_madd(_mm_set1_ps(abs_normals[p][0]), ex, simd_madd(_mm_set1_ps(abs_normals[p][1]), ey, simd_madd(_mm_set1_ps(abs_normals[p][2]), ez, d)));
+					dist = _mm_min_ps(dist, d);
+				}
+				__m128 inside = _mm_cmpge_ps(dist, _mm_setzero_ps());
+				bits |= (unsigned int)_mm_movemask_ps(inside) << i;
+			}
+#endif
+			for (; i < n; ++i) {
+				int j = base + i;
+				if (frustum_test_aabb(f, vec3(center.x[j], center.y[j], center.z[j]), vec3(extent.x[j], extent.y[j], extent.z[j]))) {
+					bits |= 1u << i;
+				}
+			}
+			visible[base / 32] = bits;
+		}
+	}
+
 } // namespace hm
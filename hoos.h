@@ -5,6 +5,11 @@
 #define VC_EXTRALEAN
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#elif defined(__linux__)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/types.h>
 #else
 #error "OS not supported"
 #endif
@@ -47,6 +52,8 @@ typedef struct {
 #define MAX_PATH 260
 #endif
 
+/* Times are in 100 nanosecond intervals since January 1, 1601 (UTC) on every OS. On Linux the */
+/* creation time is the birth time, or the last status change where the filesystem has none. */
 typedef struct {
 	uint64_t creation_time;
 	uint64_t access_time;
@@ -55,6 +62,10 @@ typedef struct {
 	OS_FileAttributes attributes;
 } OS_FileData;
 
+/* Hints for os_file_map */
+#define OS_FILE_MAP_SEQUENTIAL (1 << 0) /* the mapping will be read from start to end */
+#define OS_FILE_MAP_WILLNEED   (1 << 1) /* start reading the file in ahead of time */
+
 /* Timing */
 void     os_datetime(OS_Datetime* systime);
 void     os_time_init();
@@ -81,13 +92,569 @@ const char*       os_file_name_from_path(const char* path);
 const char*       os_file_extension(const char* filename);
 OS_FileAttributes os_file_attributes(const char* filename);
 char*             os_file_fullpath(const char* path);
+/* 'path' is a directory, or a directory followed by a search pattern like *.txt (wildcards are only */
+/* allowed in the last component). */
+/* The returned array ends with an entry with an empty filename, the caller must free it */
 OS_FileData*      os_file_list_dir(const char* path);
 int               os_file_delete(const char* path);
+/* Maps the file read only into memory without copying it, 'flags' are OS_FILE_MAP_* hints. */
+/* Returns 0 if the file could not be mapped or is empty. */
+void*             os_file_map(const char* in_filename, int64_t* out_size, uint32_t flags);
+void              os_file_unmap(void* mem, int64_t size);
+
+/* Streaming files
+   A reader returns the file one chunk at a time from a reused buffer. With OS_FILE_STREAM_READAHEAD
+   the next chunk is read in the background while the caller works on the current one.
+   A writer gathers small writes in its buffer and writes them in large blocks. */
+#define OS_FILE_STREAM_READAHEAD (1 << 0) /* reader: double buffer and read ahead */
+#define OS_FILE_STREAM_APPEND    (1 << 1) /* writer: append to the file instead of truncating it */
+
+typedef struct OS_FileReader_t OS_FileReader;
+typedef struct OS_FileWriter_t OS_FileWriter;
+
+OS_FileReader* os_file_reader_open(const char* filename, uint32_t chunk_size, uint32_t flags);
+/* Returns the next chunk, valid until the next call, or 0 when the file ends */
+void*          os_file_reader_next(OS_FileReader* reader, int64_t* out_size);
+void           os_file_reader_close(OS_FileReader* reader);
+OS_FileWriter* os_file_writer_open(const char* filename, uint32_t buffer_size, uint32_t flags);
+int            os_file_writer_write(OS_FileWriter* writer, const void* mem, uint32_t size);
+int            os_file_writer_flush(OS_FileWriter* writer);
+/* Flushes and closes the file, returns OS_ERROR if any write failed */
+int            os_file_writer_close(OS_FileWriter* writer);
+
+/* Recursive directory walk
+   Lists every file and directory under a path, the root itself is not listed. On Linux the
+   directories are read in parallel with getdents64, on Windows they are read by the calling thread.
+   Only the names are stored, packed in blocks owned by the walk and valid until os_walk_free. Each
+   entry refers to the entry of its directory, os_walk_path builds the full path from them.
+   Without OS_WALK_STAT only the attributes known from the directory entry are filled
+   (directory, device, hidden, normal), with it the size and write time are filled too. */
+#define OS_WALK_STAT (1 << 0)
+#define OS_WALK_ROOT UINT64_MAX /* parent of the entries directly under the walked path */
+
+typedef struct {
+	const char*       name;
+	uint64_t          parent;      /* index of the directory containing the entry, or OS_WALK_ROOT */
+	uint32_t          name_length;
+	OS_FileAttributes attributes;
+	uint64_t          size;
+	uint64_t          write_time;
+} OS_WalkEntry;
+
+typedef struct OS_Walk_t OS_Walk;
+
+/* 'thread_count' 0 uses one thread per processor, symbolic links are not followed. Directories that */
+/* can't be opened are skipped, running out of memory fails the whole walk and returns 0. */
+OS_Walk*      os_walk(const char* path, uint32_t thread_count, uint32_t flags);
+OS_WalkEntry* os_walk_entries(OS_Walk* walk, uint64_t* out_count);
+/* Writes the path of entry 'index', starting with the walked path, to 'out' with a terminator. */
+/* Returns the length of the path, if it is 'out_size' or more nothing is written. */
+uint32_t      os_walk_path(OS_Walk* walk, uint64_t index, char* out, uint32_t out_size);
+void          os_walk_free(OS_Walk* walk);
+
+/* File watching
+   Changes are collected until none arrives for 'debounce_ms' and returned as one batch, with all
+   the changes to the same path merged into a single event. Linux uses inotify, with
+   OS_WATCH_RECURSIVE every subdirectory is watched, including the ones created later.
+   Windows uses ReadDirectoryChangesW and can watch at most 32 directories. */
+#define OS_WATCH_RECURSIVE (1 << 0)
+
+typedef enum {
+	OS_WATCH_CREATED    = 0x1,
+	OS_WATCH_MODIFIED   = 0x2,
+	OS_WATCH_DELETED    = 0x4,
+	OS_WATCH_ATTRIBUTES = 0x8,
+	OS_WATCH_OVERFLOW   = 0x10, /* changes were lost, the path is empty, rescan everything */
+} OS_WatchEventType;
+
+typedef struct {
+	const char* path;   /* stored at the end of the caller's buffer */
+	uint32_t    events; /* every OS_WatchEventType that happened to the path in this batch */
+} OS_WatchEvent;
+
+typedef struct OS_Watch_t OS_Watch;
+
+OS_Watch* os_watch_create();
+void      os_watch_destroy(OS_Watch* watch);
+/* Watches a file or a directory, 'flags' are OS_WATCH_* flags */
+int       os_watch_add(OS_Watch* watch, const char* path, uint32_t flags);
+/* Waits up to 'timeout_ms' (-1 forever) for changes and writes them to 'buffer' (aligned to 8 bytes)
+   as an array of OS_WatchEvent. Returns how many events were written, 0 on timeout or OS_ERROR.
+   Changes that don't fit in the buffer are returned by the next call. Each event needs
+   sizeof(OS_WatchEvent) plus its path and terminator, OS_ERROR is also returned when the first
+   one doesn't fit and it is kept for a call with a larger buffer. */
+int64_t   os_watch_wait(OS_Watch* watch, void* buffer, uint64_t buffer_size, int32_t timeout_ms, uint32_t debounce_ms);
+
+/* Asynchronous IO
+   Requests are submitted in batches and completed out of order. On Linux they are
+   executed by io_uring, or by a pool of threads (link with -pthread) if io_uring is not
+   available or OS_IO_THREADS is given. On Windows they are executed when submitted.
+   A request must stay alive and untouched until it is returned as completed. */
+
+/* os_io_create flags */
+#define OS_IO_THREADS (1 << 0) /* don't use io_uring */
+
+/* os_io_open flags */
+#define OS_IO_OPEN_READ   (1 << 0)
+#define OS_IO_OPEN_WRITE  (1 << 1)
+#define OS_IO_OPEN_CREATE (1 << 2) /* create the file if it doesn't exist, truncate it otherwise */
+#define OS_IO_OPEN_DIRECT (1 << 3) /* bypass the OS cache, buffers, sizes and offsets must be aligned to the sector size */
+
+typedef enum {
+	OS_IO_READ = 0,
+	OS_IO_WRITE = 1,
+} OS_IoOperation;
+
+typedef struct {
+	OS_IoOperation operation;
+	int32_t        buffer_index; /* index of the registered buffer containing 'buffer', -1 if it is not registered */
+	int64_t        file;         /* returned by os_io_open */
+	void*          buffer;
+	uint32_t       size;
+	uint64_t       offset;
+	void*          user_data;
+	int64_t        result;       /* bytes transferred, set when the request completes */
+	int32_t        error;        /* OS_OK, or OS_ERROR if the transfer failed after 'result' bytes */
+} OS_IoRequest;
+
+typedef struct OS_Io_t OS_Io;
+
+/* Creates a queue that holds up to 'queue_depth' requests in flight */
+OS_Io*   os_io_create(uint32_t queue_depth, uint32_t flags);
+void     os_io_destroy(OS_Io* io);
+int64_t  os_io_open(const char* filename, uint32_t flags);
+void     os_io_close(int64_t file);
+/* Registers buffers with the OS once so that requests using them skip mapping them each time */
+int      os_io_register_buffers(OS_Io* io, void** buffers, uint64_t* sizes, uint32_t count);
+/* Returns how many requests were submitted, less than 'count' if the queue is full or the OS */
+/* accepted fewer, the rest are still the caller's. Returns OS_ERROR if the OS refused them all. */
+int64_t  os_io_submit(OS_Io* io, OS_IoRequest** requests, uint32_t count);
+/* Writes up to 'max_count' completed requests to 'out_completed' without blocking. */
+/* Short reads and writes are continued until the whole size is transferred or the file ends. */
+/* A request that fails part way keeps the bytes transferred before it in 'result'. */
+uint32_t os_io_poll(OS_Io* io, OS_IoRequest** out_completed, uint32_t max_count);
+/* Same as os_io_poll, but blocks until at least 'min_count' requests are completed. */
+/* Returns OS_ERROR if waiting failed before any request completed. */
+int64_t  os_io_wait(OS_Io* io, OS_IoRequest** out_completed, uint32_t min_count, uint32_t max_count);
+
+/* Task scheduler
+   Each worker thread owns a work stealing deque, tasks spawned by a worker go to its own deque
+   and idle workers steal from the others. The thread that creates the scheduler is worker 0 and
+   runs tasks while it waits, other threads may spawn and wait too. Waiting on a task group runs
+   other tasks until every task of the group is done, and sleeps while there are none to run. */
+#define OS_SCHEDULER_PIN_THREADS (1 << 0) /* pin worker i to processor i, the calling thread included */
+#ifndef OS_SCHEDULER_DEQUE_SIZE
+#define OS_SCHEDULER_DEQUE_SIZE 4096      /* tasks spawned into a full deque run immediately */
+#endif
+
+typedef void (*OS_TaskProc)(void* data);
+typedef void (*OS_ParallelForProc)(void* data, uint64_t start, uint64_t end);
+
+/* Initialize to zero, a group can be reused once os_task_wait returns */
+typedef struct {
+	int64_t pending;
+} OS_TaskGroup;
+
+typedef struct OS_Scheduler_t OS_Scheduler;
+
+/* 'thread_count' includes the calling thread, 0 uses one thread per processor */
+OS_Scheduler* os_scheduler_create(uint32_t thread_count, uint32_t flags);
+void          os_scheduler_destroy(OS_Scheduler* scheduler);
+uint32_t      os_scheduler_thread_count(OS_Scheduler* scheduler);
+void          os_task_spawn(OS_Scheduler* scheduler, OS_TaskGroup* group, OS_TaskProc proc, void* data);
+void          os_task_wait(OS_Scheduler* scheduler, OS_TaskGroup* group);
+/* Calls 'proc' on pieces of [start, end) of at most 'grain' elements (0 picks one) in parallel and waits for all */
+void          os_parallel_for(OS_Scheduler* scheduler, uint64_t start, uint64_t end, uint64_t grain, OS_ParallelForProc proc, void* data);
+
+/* Profiling
+   Zones are timed with the CPU timestamp counter. PROFILE_BEGIN/PROFILE_END compile to nothing
+   unless HO_OS_PROFILE is defined. Every thread keeps its own zone totals and a ring buffer of the
+   last OS_PROFILE_RING_SIZE zones (must be a power of two), so recording never takes a lock.
+   When a thread exits its state, with what it recorded, is kept and reused by the next thread
+   that starts profiling, so up to OS_PROFILE_MAX_THREADS threads can profile at the same time.
+   Zone names must be string literals, os_profile_zones, os_profile_export_chrome and
+   os_profile_reset should be called while the profiled threads are not inside any zone. */
+#ifndef OS_PROFILE_RING_SIZE
+#define OS_PROFILE_RING_SIZE (1 << 16)
+#endif
+#define OS_PROFILE_MAX_ZONES   1024
+#define OS_PROFILE_MAX_DEPTH   64
+#define OS_PROFILE_MAX_THREADS 64
+
+typedef struct {
+	const char* name;
+	uint64_t    hit_count;
+	uint64_t    inclusive_ticks; /* time between begin and end, recursive calls are counted once */
+	uint64_t    self_ticks;      /* inclusive time minus the time spent in nested zones */
+} OS_ProfileZone;
+
+uint64_t os_profile_ticks();
+/* Measures the timestamp counter frequency against os_time_us the first time it is called */
+double   os_profile_ticks_per_us();
+void     os_profile_begin(const char* name);
+void     os_profile_end();
+/* Writes the totals of each zone summed over all threads, returns how many zones were written */
+uint32_t os_profile_zones(OS_ProfileZone* out_zones, uint32_t max_count);
+/* Writes the recorded zones as a Chrome trace (chrome://tracing, Perfetto) */
+int      os_profile_export_chrome(const char* filename);
+void     os_profile_reset();
+
+#if defined(HO_OS_PROFILE)
+#define PROFILE_BEGIN(name) os_profile_begin(name)
+#define PROFILE_END() os_profile_end()
+#else
+#define PROFILE_BEGIN(name)
+#define PROFILE_END()
+#endif
+
+#if defined(HO_OS_IMPLEMENT)
+#include <string.h>
+
+/* Runs a scheduler worker, called by the thread entry of each OS */
+static void os_scheduler_run_worker(void* worker);
+
+/* Directory walk storage shared by every OS, each walking thread fills its own list.
+   Until os_walk_finish gathers the lists, a parent is the index of its list shifted by
+   OS_WALK_LIST_SHIFT plus its index in that list. */
+#define OS_WALK_BLOCK_SIZE (1 << 20)
+#define OS_WALK_LIST_SHIFT 48
+
+typedef struct OS_WalkBlock_t {
+	struct OS_WalkBlock_t* next;
+	uint32_t used;
+	uint32_t capacity;
+} OS_WalkBlock;
+
+typedef struct {
+	OS_WalkBlock* blocks;
+	OS_WalkEntry* entries;
+	uint64_t      count;
+	uint64_t      capacity;
+	uint64_t      first;    /* index of the first entry once the lists are gathered */
+} OS_WalkList;
+
+struct OS_Walk_t {
+	OS_WalkList*  lists;
+	uint32_t      list_count;
+	OS_WalkEntry* entries;
+	uint64_t      count;
+	char*         root;
+	uint32_t      root_length;
+	char          separator;
+};
+
+/* Adds an entry for 'name' in the directory 'parent', returns 0 if out of memory */
+static OS_WalkEntry* os_walk_push(OS_WalkList* list, uint64_t parent, const char* name, uint32_t name_length)
+{
+	uint32_t size = name_length + 1;
+	OS_WalkEntry* entry;
+	char* copy;
+
+	if (list->count == list->capacity)
+	{
+		uint64_t capacity = (list->capacity) ? list->capacity * 2 : 1024;
+		OS_WalkEntry* entries = (OS_WalkEntry*)realloc(list->entries, capacity * sizeof(OS_WalkEntry));
+		if (!entries)
+			return 0;
+		list->entries = entries;
+		list->capacity = capacity;
+	}
+	if (!list->blocks || list->blocks->capacity - list->blocks->used < size)
+	{
+		uint32_t capacity = (size > OS_WALK_BLOCK_SIZE) ? size : OS_WALK_BLOCK_SIZE;
+		OS_WalkBlock* block = (OS_WalkBlock*)malloc(sizeof(OS_WalkBlock) + capacity);
+		if (!block)
+			return 0;
+		block->next = list->blocks;
+		block->used = 0;
+		block->capacity = capacity;
+		list->blocks = block;
+	}
+	copy = (char*)(list->blocks + 1) + list->blocks->used;
+	list->blocks->used += size;
+	memcpy(copy, name, name_length);
+	copy[name_length] = 0;
+
+	entry = list->entries + list->count++;
+	memset(entry, 0, sizeof(OS_WalkEntry));
+	entry->name = copy;
+	entry->name_length = name_length;
+	entry->parent = parent;
+	return entry;
+}
+
+/* Builds the path of entries[index] like os_walk_path, the parents must be indices in 'entries' */
+static uint32_t os_walk_build_path(const char* root, uint32_t root_length, char separator, const OS_WalkEntry* entries, uint64_t index, char* out, uint32_t out_size)
+{
+	uint32_t root_separator = (root_length > 0 && root[root_length - 1] != separator);
+	uint32_t length = root_length + root_separator - 1;
+	uint32_t end;
+
+	// Measure first, then fill in from the end
+	for (uint64_t i = index; i != OS_WALK_ROOT; i = entries[i].parent)
+		length += entries[i].name_length + 1;
+	if (length >= out_size)
+		return length;
+
+	end = length;
+	out[end] = 0;
+	for (uint64_t i = index; i != OS_WALK_ROOT; i = entries[i].parent)
+	{
+		end -= entries[i].name_length;
+		memcpy(out + end, entries[i].name, entries[i].name_length);
+		if (end > root_length)
+			out[--end] = separator;
+	}
+	memcpy(out, root, root_length);
+	return length;
+}
+
+static void os_walk_free_lists(OS_WalkList* lists, uint32_t list_count)
+{
+	for (uint32_t i = 0; i < list_count; ++i)
+	{
+		while (lists[i].blocks)
+		{
+			OS_WalkBlock* next = lists[i].blocks->next;
+			free(lists[i].blocks);
+			lists[i].blocks = next;
+		}
+		free(lists[i].entries);
+	}
+	free(lists);
+}
+
+/* Takes ownership of 'lists' and gathers their entries in a single array, with the parents
+   turned into indices in that array */
+static OS_Walk* os_walk_finish(OS_WalkList* lists, uint32_t list_count, const char* root, char separator)
+{
+	OS_Walk* walk = (OS_Walk*)calloc(1, sizeof(OS_Walk));
+	uint64_t count = 0;
+	uint32_t root_length = (uint32_t)strlen(root);
+	if (walk)
+		walk->root = (char*)malloc(root_length + 1);
+	if (!walk || !walk->root)
+	{
+		os_walk_free_lists(lists, list_count);
+		free(walk);
+		return 0;
+	}
+	memcpy(walk->root, root, root_length + 1);
+	walk->root_length = root_length;
+	walk->separator = separator;
+	walk->lists = lists;
+	walk->list_count = list_count;
+
+	for (uint32_t i = 0; i < list_count; ++i)
+		count += lists[i].count;
+	if (list_count == 1)
+	{
+		// Nothing to gather, the parents in list 0 already are indices
+		walk->entries = lists[0].entries;
+		lists[0].entries = 0;
+	}
+	else if (count > 0 && (walk->entries = (OS_WalkEntry*)malloc(count * sizeof(OS_WalkEntry))) != 0)
+	{
+		count = 0;
+		for (uint32_t i = 0; i < list_count; ++i)
+		{
+			memcpy(walk->entries + count, lists[i].entries, lists[i].count * sizeof(OS_WalkEntry));
+			lists[i].first = count;
+			count += lists[i].count;
+			free(lists[i].entries);
+			lists[i].entries = 0;
+		}
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			uint64_t parent = walk->entries[i].parent;
+			if (parent != OS_WALK_ROOT)
+				walk->entries[i].parent = lists[parent >> OS_WALK_LIST_SHIFT].first + (parent & (((uint64_t)1 << OS_WALK_LIST_SHIFT) - 1));
+		}
+	}
+	else if (count > 0)
+	{
+		os_walk_free(walk);
+		return 0;
+	}
+	walk->count = (walk->entries) ? count : 0;
+	return walk;
+}
+
+uint32_t os_walk_path(OS_Walk* walk, uint64_t index, char* out, uint32_t out_size)
+{
+	return os_walk_build_path(walk->root, walk->root_length, walk->separator, walk->entries, index, out, out_size);
+}
+
+OS_WalkEntry* os_walk_entries(OS_Walk* walk, uint64_t* out_count)
+{
+	if (out_count) *out_count = walk->count;
+	return walk->entries;
+}
+
+void os_walk_free(OS_Walk* walk)
+{
+	os_walk_free_lists(walk->lists, walk->list_count);
+	free(walk->entries);
+	free(walk->root);
+	free(walk);
+}
+
+/* Changes waiting to be returned by os_watch_wait, merged by path */
+typedef struct {
+	uint32_t path_offset;
+	uint32_t path_length;
+	uint32_t hash;
+	uint32_t events;
+} OS_WatchPending;
+
+typedef struct {
+	OS_WatchPending* pending;
+	uint32_t         count;
+	uint32_t         capacity;
+	uint32_t*        index;          /* open addressing, pending index + 1, 0 if empty */
+	uint32_t         index_capacity; /* power of 2, at least twice 'count' */
+	char*            paths;
+	uint32_t         paths_used;
+	uint32_t         paths_capacity;
+	uint64_t         size;           /* bytes os_watch_queue_emit needs for every pending change */
+} OS_WatchQueue;
+
+static int os_watch_queue_reindex(OS_WatchQueue* queue, uint32_t index_capacity)
+{
+	uint32_t* index = (uint32_t*)calloc(index_capacity, sizeof(uint32_t));
+	if (!index)
+		return OS_ERROR;
+	for (uint32_t i = 0; i < queue->count; ++i)
+	{
+		uint32_t slot = queue->pending[i].hash & (index_capacity - 1);
+		while (index[slot])
+			slot = (slot + 1) & (index_capacity - 1);
+		index[slot] = i + 1;
+	}
+	free(queue->index);
+	queue->index = index;
+	queue->index_capacity = index_capacity;
+	return OS_OK;
+}
+
+static int os_watch_queue_add(OS_WatchQueue* queue, const char* dir, uint32_t dir_length, const char* name, uint32_t name_length, uint32_t events, char separator)
+{
+	uint32_t hash = 2166136261u;
+	uint32_t length = dir_length + ((dir_length > 0 && name_length > 0) ? 1 : 0) + name_length;
+	uint32_t slot;
+	OS_WatchPending* pending;
+	char* path;
+
+	if (queue->paths_capacity - queue->paths_used < length + 1)
+	{
+		uint32_t capacity = (queue->paths_capacity) ? queue->paths_capacity * 2 : 4096;
+		while (capacity - queue->paths_used < length + 1)
+			capacity *= 2;
+		path = (char*)realloc(queue->paths, capacity);
+		if (!path)
+			return OS_ERROR;
+		queue->paths = path;
+		queue->paths_capacity = capacity;
+	}
+	if (queue->count * 2 >= queue->index_capacity && os_watch_queue_reindex(queue, (queue->index_capacity) ? queue->index_capacity * 2 : 64) != OS_OK)
+		return OS_ERROR;
+
+	// Build the path at the end of the paths, it is only kept if it is new
+	path = queue->paths + queue->paths_used;
+	memcpy(path, dir, dir_length);
+	if (length > dir_length + name_length)
+		path[dir_length++] = separator;
+	memcpy(path + dir_length, name, name_length);
+	path[length] = 0;
+	for (uint32_t i = 0; i < length; ++i)
+		hash = (hash ^ (uint8_t)path[i]) * 16777619u;
+
+	slot = hash & (queue->index_capacity - 1);
+	while (queue->index[slot])
+	{
+		pending = queue->pending + queue->index[slot] - 1;
+		if (pending->hash == hash && pending->path_length == length && memcmp(queue->paths + pending->path_offset, path, length) == 0)
+		{
+			pending->events |= events;
+			return OS_OK;
+		}
+		slot = (slot + 1) & (queue->index_capacity - 1);
+	}
+
+	if (queue->count == queue->capacity)
+	{
+		uint32_t capacity = (queue->capacity) ? queue->capacity * 2 : 64;
+		pending = (OS_WatchPending*)realloc(queue->pending, capacity * sizeof(OS_WatchPending));
+		if (!pending)
+			return OS_ERROR;
+		queue->pending = pending;
+		queue->capacity = capacity;
+	}
+	pending = queue->pending + queue->count;
+	pending->path_offset = queue->paths_used;
+	pending->path_length = length;
+	pending->hash = hash;
+	pending->events = events;
+	queue->index[slot] = ++queue->count;
+	queue->paths_used += length + 1;
+	queue->size += sizeof(OS_WatchEvent) + length + 1;
+	return OS_OK;
+}
+
+/* Events go at the start of the buffer and their paths at the end. Fails if not even the
+   first change fits, it stays queued so a larger buffer can still get it. */
+static int64_t os_watch_queue_emit(OS_WatchQueue* queue, void* buffer, uint64_t buffer_size)
+{
+	OS_WatchEvent* events = (OS_WatchEvent*)buffer;
+	char* end = (char*)buffer + buffer_size;
+	uint32_t count = 0;
+
+	for (; count < queue->count; ++count)
+	{
+		OS_WatchPending* pending = queue->pending + count;
+		uint64_t needed = (count + 1) * sizeof(OS_WatchEvent) + pending->path_length + 1;
+		if ((uint64_t)(end - (char*)buffer) < needed)
+			break;
+		end -= pending->path_length + 1;
+		memcpy(end, queue->paths + pending->path_offset, pending->path_length + 1);
+		events[count].path = end;
+		events[count].events = pending->events;
+		queue->size -= sizeof(OS_WatchEvent) + pending->path_length + 1;
+	}
+
+	if (count == 0 && queue->count > 0)
+		return OS_ERROR;
+	if (count == queue->count)
+	{
+		queue->count = 0;
+		queue->paths_used = 0;
+		queue->size = 0;
+		memset(queue->index, 0, queue->index_capacity * sizeof(uint32_t));
+	}
+	else if (count > 0)
+	{
+		// Keep the rest for the next call, their paths stay where they are
+		memmove(queue->pending, queue->pending + count, (queue->count - count) * sizeof(OS_WatchPending));
+		queue->count -= count;
+		if (os_watch_queue_reindex(queue, queue->index_capacity) != OS_OK)
+			return OS_ERROR;
+	}
+	return count;
+}
+
+static void os_watch_queue_free(OS_WatchQueue* queue)
+{
+	free(queue->pending);
+	free(queue->index);
+	free(queue->paths);
+}
+#endif
 
 #if defined(_WIN32) || defined(_WIN64)
 #if defined(HO_OS_IMPLEMENT)
 
 void* __cdecl memcpy(void* dst, void const* src, size_t size);
+void* __cdecl memset(void* dst, int value, size_t size);
 
 /* Timing */
 static int64_t perf_frequency;
@@ -122,43 +689,7 @@ double os_time_sec()
 
 void os_datetime(OS_Datetime* systime)
 {
-	GetSystemTime((SYSTEMTIME*)&systime);
-}
-
-OS_Timer os_timer_new(int start)
-{
-	return (OS_Timer)
-	{
-		.start = (start) ? os_time_ns() : 0,
-		.elapsed = 0
-	};
-}
-void os_timer_reset(OS_Timer* timer)
-{
-	timer->start = 0;
-	timer->elapsed = 0;
-}
-
-void os_timer_stop(OS_Timer* timer)
-{
-	timer->elapsed = os_time_ns() - timer->start;
-	timer->start = 0;
-}
-void os_timer_start(OS_Timer* timer)
-{
-	timer->start = os_time_ns();
-}
-double os_timer_elapsed_ms(OS_Timer* timer)
-{
-	return (timer->start) ? (os_time_ns() - timer->start + timer->elapsed) / 1000000.0 : timer->elapsed / 1000000.0;
-}
-double os_timer_elapsed_us(OS_Timer* timer)
-{
-	return (timer->start) ? (os_time_ns() - timer->start + timer->elapsed) / 1000.0 : timer->elapsed / 1000.0;
-}
-double os_timer_elapsed_ns(OS_Timer* timer)
-{
-	return (timer->start) ? (os_time_ns() - timer->start + timer->elapsed) : timer->elapsed;
+	GetSystemTime((SYSTEMTIME*)systime);
 }
 
 /* Files */
@@ -182,34 +713,6 @@ int64_t os_file_size(const char* in_filename)
 	}
 }
 
-const char* os_file_name_from_path(const char* path)
-{
-	int sep_index = 0;
-	const char* at = path;
-	while (*at)
-	{
-		char c = *at;
-		if (c == '\\' || c == '/')
-			sep_index = (int)(at - path + 1);
-		at++;
-	}
-	return path + sep_index;
-}
-
-const char* os_file_extension(const char* filename)
-{
-	int dot_index = 0;
-	const char* at = filename;
-	while (*at)
-	{
-		char c = *at;
-		if (c == '.')
-			dot_index = (int)(at - filename + 1);
-		at++;
-	}
-	return filename + dot_index;
-}
-
 OS_FileAttributes os_file_attributes(const char* filename)
 {
 	return GetFileAttributesA(filename);
@@ -273,6 +776,17 @@ OS_FileData* os_file_list_dir(const char* path)
 			++index;
 		} while (FindNextFileA(search_handle, &find_data));
 		FindClose(search_handle);
+
+		// Terminate the array with an empty entry
+		if (index >= capacity)
+		{
+			void* new_array = realloc(data_array, (capacity + 1) * sizeof(OS_FileData));
+			if (new_array)
+				data_array = new_array;
+			else
+				index--;
+		}
+		memset(data_array + index, 0, sizeof(OS_FileData));
 	}
 	return data_array;
 }
@@ -319,7 +833,7 @@ uint64_t os_file_read_to_mem(const char* in_filename, int64_t in_size, void* in_
 	if (fhandle != INVALID_HANDLE_VALUE)
 	{
 		uint64_t file_size = in_size;
-		const max_chunk = 0xffffffff;
+		const uint32_t max_chunk = 0xffffffff;
 		if (in_memory)
 		{
 			if (file_size > max_chunk)
@@ -330,7 +844,7 @@ uint64_t os_file_read_to_mem(const char* in_filename, int64_t in_size, void* in_
 					uint32_t chunk_size = (to_read > max_chunk) ? max_chunk : (uint32_t)to_read;
 					uint32_t bytes_read;
 
-					if (ReadFile(fhandle, in_memory, chunk_size, &bytes_read, 0))
+					if (ReadFile(fhandle, (char*)in_memory + total_read, chunk_size, &bytes_read, 0) && bytes_read > 0)
 					{
 						to_read -= bytes_read;
 						total_read += bytes_read;
@@ -364,7 +878,7 @@ void* os_file_read(const char* in_filename, int64_t* out_size)
 		uint64_t file_size = 0;
 		GetFileSizeEx(fhandle, (LARGE_INTEGER*)&file_size);
 		void* mem = calloc(1, file_size);
-		const max_chunk = 0xffffffff;
+		const uint32_t max_chunk = 0xffffffff;
 		if (mem)
 		{
 			if (file_size > max_chunk)
@@ -375,7 +889,8 @@ void* os_file_read(const char* in_filename, int64_t* out_size)
 					uint32_t chunk_size = (to_read > max_chunk) ? max_chunk : (uint32_t)to_read;
 					uint32_t bytes_read;
 
-					if (ReadFile(fhandle, mem, chunk_size, &bytes_read, 0))
+					// A failed read or the end of a file truncated while reading stops short of file_size
+					if (ReadFile(fhandle, (char*)mem + total_read, chunk_size, &bytes_read, 0) && bytes_read > 0)
 					{
 						to_read -= bytes_read;
 						total_read += bytes_read;
@@ -383,29 +898,3004 @@ void* os_file_read(const char* in_filename, int64_t* out_size)
 					else
 						break;
 				} while (to_read > 0);
-				if (out_size) *out_size = (int64_t)total_read;
-				CloseHandle(fhandle);
-				return mem;
+				if (total_read == file_size)
+				{
+					if (out_size) *out_size = (int64_t)total_read;
+					CloseHandle(fhandle);
+					return mem;
+				}
 			}
 			else
 			{
 				uint32_t bytes_read;
-				if (ReadFile(fhandle, mem, (uint32_t)file_size, &bytes_read, 0))
+				if (ReadFile(fhandle, mem, (uint32_t)file_size, &bytes_read, 0) && bytes_read == file_size)
 				{
 					if (out_size) *out_size = bytes_read;
 					CloseHandle(fhandle);
 					return mem;
 				}
-				CloseHandle(fhandle);
 			}
+			free(mem);
 		}
+		CloseHandle(fhandle);
 	}
 	return 0;
 }
+
+void* os_file_map(const char* in_filename, int64_t* out_size, uint32_t flags)
+{
+	void* result = 0;
+	uint32_t file_flags = FILE_ATTRIBUTE_NORMAL | ((flags & OS_FILE_MAP_SEQUENTIAL) ? FILE_FLAG_SEQUENTIAL_SCAN : 0);
+	void* fhandle = CreateFileA(in_filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, file_flags, 0);
+	if (fhandle != INVALID_HANDLE_VALUE)
+	{
+		uint64_t file_size = 0;
+		GetFileSizeEx(fhandle, (LARGE_INTEGER*)&file_size);
+		if (file_size > 0)
+		{
+			void* mapping = CreateFileMappingA(fhandle, 0, PAGE_READONLY, 0, 0, 0);
+			if (mapping)
+			{
+				// The view keeps the mapping alive after its handle is closed
+				result = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(mapping);
+#if _WIN32_WINNT >= 0x0602
+				if (result && (flags & OS_FILE_MAP_WILLNEED))
+				{
+					// Start paging the view in, same as madvise(MADV_WILLNEED)
+					WIN32_MEMORY_RANGE_ENTRY range;
+					range.VirtualAddress = result;
+					range.NumberOfBytes = (SIZE_T)file_size;
+					PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+				}
 #endif
+			}
+		}
+		if (out_size) *out_size = (result) ? (int64_t)file_size : 0;
+		CloseHandle(fhandle);
+	}
+	return result;
+}
 
-#else
-#error "OS not supported"
+void os_file_unmap(void* mem, int64_t size)
+{
+	(void)size;
+	UnmapViewOfFile(mem);
+}
+
+/* Streaming files, read ahead is done with overlapped reads */
+struct OS_FileReader_t {
+	void*      file;
+	void*      event;
+	OVERLAPPED overlapped;
+	char*      buffers[2];
+	uint32_t   chunk_size;
+	uint64_t   offset;
+	int        current;
+	int        pending;
+	int        readahead;
+	int        done;
+};
+
+static void os_file_reader_issue(OS_FileReader* reader)
+{
+	memset(&reader->overlapped, 0, sizeof(reader->overlapped));
+	reader->overlapped.Offset = (uint32_t)reader->offset;
+	reader->overlapped.OffsetHigh = (uint32_t)(reader->offset >> 32);
+	reader->overlapped.hEvent = reader->event;
+	reader->pending = ReadFile(reader->file, reader->buffers[reader->current], reader->chunk_size, 0, &reader->overlapped) || GetLastError() == ERROR_IO_PENDING;
+}
+
+OS_FileReader* os_file_reader_open(const char* filename, uint32_t chunk_size, uint32_t flags)
+{
+	OS_FileReader* reader = calloc(1, sizeof(OS_FileReader));
+	if (!reader)
+		return 0;
+
+	reader->chunk_size = chunk_size;
+	reader->readahead = (flags & OS_FILE_STREAM_READAHEAD) != 0;
+	reader->buffers[0] = malloc((reader->readahead) ? 2 * (size_t)chunk_size : chunk_size);
+	reader->buffers[1] = reader->buffers[0] + chunk_size;
+	reader->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN | ((reader->readahead) ? FILE_FLAG_OVERLAPPED : 0), 0);
+	if (reader->readahead)
+		reader->event = CreateEventA(0, TRUE, FALSE, 0);
+
+	if (!reader->buffers[0] || reader->file == INVALID_HANDLE_VALUE || (reader->readahead && !reader->event))
+	{
+		if (reader->file != INVALID_HANDLE_VALUE) CloseHandle(reader->file);
+		if (reader->event) CloseHandle(reader->event);
+		free(reader->buffers[0]);
+		free(reader);
+		return 0;
+	}
+	if (reader->readahead)
+		os_file_reader_issue(reader);
+	return reader;
+}
+
+void* os_file_reader_next(OS_FileReader* reader, int64_t* out_size)
+{
+	uint32_t bytes_read = 0;
+	char* chunk = reader->buffers[reader->current];
+
+	if (reader->done)
+	{
+		if (out_size) *out_size = 0;
+		return 0;
+	}
+	if (reader->readahead)
+	{
+		if (!reader->pending || !GetOverlappedResult(reader->file, &reader->overlapped, &bytes_read, TRUE))
+			bytes_read = 0;
+		reader->pending = 0;
+		reader->offset += bytes_read;
+		if (bytes_read == reader->chunk_size)
+		{
+			reader->current ^= 1;
+			os_file_reader_issue(reader);
+		}
+	}
+	else if (!ReadFile(reader->file, chunk, reader->chunk_size, &bytes_read, 0))
+	{
+		bytes_read = 0;
+	}
+
+	if (bytes_read < reader->chunk_size)
+		reader->done = 1;
+	if (out_size) *out_size = bytes_read;
+	return (bytes_read > 0) ? chunk : 0;
+}
+
+void os_file_reader_close(OS_FileReader* reader)
+{
+	if (reader->pending)
+	{
+		uint32_t bytes_read;
+		CancelIo(reader->file);
+		GetOverlappedResult(reader->file, &reader->overlapped, &bytes_read, TRUE);
+	}
+	if (reader->event) CloseHandle(reader->event);
+	CloseHandle(reader->file);
+	free(reader->buffers[0]);
+	free(reader);
+}
+
+static int64_t os_file_stream_open(const char* filename, int append)
+{
+	void* fhandle = CreateFileA(filename, (append) ? FILE_APPEND_DATA : GENERIC_WRITE, FILE_SHARE_READ, 0,
+		(append) ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+	return (fhandle == INVALID_HANDLE_VALUE) ? OS_ERROR : (int64_t)fhandle;
+}
+
+static int os_file_stream_write(int64_t file, const void* mem, uint32_t size)
+{
+	uint32_t written = 0;
+	return (WriteFile((void*)file, mem, size, &written, 0) && written == size) ? OS_OK : OS_ERROR;
+}
+
+static void os_file_stream_close(int64_t file)
+{
+	CloseHandle((void*)file);
+}
+
+/* Directory walk, the directories found are themselves the queue of directories to read */
+OS_Walk* os_walk(const char* path, uint32_t thread_count, uint32_t flags)
+{
+	OS_WalkList* list = calloc(1, sizeof(OS_WalkList));
+	char* pattern = malloc(32768);
+	uint32_t path_length = (uint32_t)strlen(path);
+	uint32_t dir_length = path_length;
+	uint64_t parent = OS_WALK_ROOT;
+	uint64_t next = 0;
+	(void)thread_count;
+	(void)flags;
+
+	if (!list || !pattern)
+	{
+		free(list);
+		free(pattern);
+		return 0;
+	}
+	for (;;)
+	{
+		WIN32_FIND_DATAA find_data;
+		void* search_handle;
+		if (dir_length + 3 <= 32768)
+		{
+			if (parent == OS_WALK_ROOT)
+				memcpy(pattern, path, dir_length);
+			memcpy(pattern + dir_length, "\\*", 3);
+			search_handle = FindFirstFileExA(pattern, FindExInfoBasic, &find_data, FindExSearchNameMatch, 0, FIND_FIRST_EX_LARGE_FETCH);
+			if (search_handle != INVALID_HANDLE_VALUE)
+			{
+				do {
+					const char* name = find_data.cFileName;
+					OS_WalkEntry* entry;
+					if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+						continue;
+					entry = os_walk_push(list, parent, name, (uint32_t)strlen(name));
+					if (!entry)
+					{
+						FindClose(search_handle);
+						free(pattern);
+						os_walk_free_lists(list, 1);
+						return 0;
+					}
+					entry->attributes = (OS_FileAttributes)find_data.dwFileAttributes;
+					entry->size = ((uint64_t)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow;
+					entry->write_time = *(uint64_t*)&find_data.ftLastWriteTime;
+				} while (FindNextFileA(search_handle, &find_data));
+				FindClose(search_handle);
+			}
+		}
+
+		// Don't follow junctions and symbolic links
+		while (next < list->count && (!(list->entries[next].attributes & OS_FILE_ATTRIBUTE_DIRECTORY) ||
+			(list->entries[next].attributes & FILE_ATTRIBUTE_REPARSE_POINT)))
+			++next;
+		if (next == list->count)
+			break;
+		// Too long paths come back longer than the buffer and are skipped above
+		parent = next++;
+		dir_length = os_walk_build_path(path, path_length, '\\', list->entries, parent, pattern, 32768);
+	}
+	free(pattern);
+	return os_walk_finish(list, 1, path, '\\');
+}
+
+/* File watching */
+typedef struct {
+	void*      handle;
+	OVERLAPPED overlapped;
+	char*      path;
+	uint32_t   length;
+	int        recursive;
+	int        attributes; /* only watches attribute changes, they are reported as modifications */
+	uint64_t   buffer[8192];
+} OS_WatchDir;
+
+struct OS_Watch_t {
+	OS_WatchDir*  dirs[MAXIMUM_WAIT_OBJECTS];
+	void*         events[MAXIMUM_WAIT_OBJECTS];
+	uint32_t      count;
+	OS_WatchQueue queue;
+};
+
+static int os_watch_issue(OS_WatchDir* dir)
+{
+	uint32_t filter = (dir->attributes) ? FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SECURITY :
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_CREATION;
+	ResetEvent(dir->overlapped.hEvent);
+	return ReadDirectoryChangesW(dir->handle, dir->buffer, sizeof(dir->buffer), dir->recursive, filter, 0, &dir->overlapped, 0) ? OS_OK : OS_ERROR;
+}
+
+static OS_WatchDir* os_watch_open(const char* path, uint32_t length, uint32_t flags, int attributes)
+{
+	OS_WatchDir* dir = calloc(1, sizeof(OS_WatchDir));
+	if (!dir)
+		return 0;
+	dir->path = malloc(length + 1);
+	dir->length = length;
+	dir->recursive = (flags & OS_WATCH_RECURSIVE) != 0;
+	dir->attributes = attributes;
+	dir->overlapped.hEvent = CreateEventA(0, TRUE, FALSE, 0);
+	dir->handle = CreateFileA(path, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, 0);
+	if (!dir->path || !dir->overlapped.hEvent || dir->handle == INVALID_HANDLE_VALUE || os_watch_issue(dir) != OS_OK)
+	{
+		if (dir->handle != INVALID_HANDLE_VALUE && dir->handle) CloseHandle(dir->handle);
+		if (dir->overlapped.hEvent) CloseHandle(dir->overlapped.hEvent);
+		free(dir->path);
+		free(dir);
+		return 0;
+	}
+	memcpy(dir->path, path, length + 1);
+	return dir;
+}
+
+static void os_watch_close(OS_WatchDir* dir)
+{
+	uint32_t bytes;
+	CancelIo(dir->handle);
+	GetOverlappedResult(dir->handle, &dir->overlapped, &bytes, TRUE);
+	CloseHandle(dir->overlapped.hEvent);
+	CloseHandle(dir->handle);
+	free(dir->path);
+	free(dir);
+}
+
+OS_Watch* os_watch_create()
+{
+	return calloc(1, sizeof(OS_Watch));
+}
+
+void os_watch_destroy(OS_Watch* watch)
+{
+	for (uint32_t i = 0; i < watch->count; ++i)
+		os_watch_close(watch->dirs[i]);
+	os_watch_queue_free(&watch->queue);
+	free(watch);
+}
+
+int os_watch_add(OS_Watch* watch, const char* path, uint32_t flags)
+{
+	// Modifications don't tell attribute changes apart, so those get a second handle of their own
+	uint32_t length = (uint32_t)strlen(path);
+	OS_WatchDir* dir;
+	OS_WatchDir* attributes;
+	if (watch->count + 2 > MAXIMUM_WAIT_OBJECTS)
+		return OS_ERROR;
+
+	dir = os_watch_open(path, length, flags, 0);
+	if (!dir)
+		return OS_ERROR;
+	attributes = os_watch_open(path, length, flags, 1);
+	if (!attributes)
+	{
+		os_watch_close(dir);
+		return OS_ERROR;
+	}
+
+	watch->events[watch->count] = dir->overlapped.hEvent;
+	watch->dirs[watch->count++] = dir;
+	watch->events[watch->count] = attributes->overlapped.hEvent;
+	watch->dirs[watch->count++] = attributes;
+	return OS_OK;
+}
+
+static int os_watch_read(OS_Watch* watch, OS_WatchDir* dir)
+{
+	uint32_t bytes = 0;
+	char name[MAX_PATH * 4];
+	if (!GetOverlappedResult(dir->handle, &dir->overlapped, &bytes, FALSE))
+		return OS_OK;
+
+	if (bytes == 0)
+	{
+		// The changes didn't fit in the buffer
+		if (os_watch_queue_add(&watch->queue, "", 0, "", 0, OS_WATCH_OVERFLOW, '\\') != OS_OK)
+			return OS_ERROR;
+	}
+	for (uint32_t offset = 0; bytes > 0;)
+	{
+		FILE_NOTIFY_INFORMATION* info = (FILE_NOTIFY_INFORMATION*)((char*)dir->buffer + offset);
+		int length = WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), name, sizeof(name), 0, 0);
+		uint32_t events = (dir->attributes) ? OS_WATCH_ATTRIBUTES : OS_WATCH_MODIFIED;
+		if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+			events = OS_WATCH_CREATED;
+		else if (info->Action == FILE_ACTION_REMOVED || info->Action == FILE_ACTION_RENAMED_OLD_NAME)
+			events = OS_WATCH_DELETED;
+		if (length > 0 && os_watch_queue_add(&watch->queue, dir->path, dir->length, name, (uint32_t)length, events, '\\') != OS_OK)
+			return OS_ERROR;
+
+		if (info->NextEntryOffset == 0)
+			break;
+		offset += info->NextEntryOffset;
+	}
+	return os_watch_issue(dir);
+}
+
+int64_t os_watch_wait(OS_Watch* watch, void* buffer, uint64_t buffer_size, int32_t timeout_ms, uint32_t debounce_ms)
+{
+	uint32_t wait;
+	if (watch->count == 0)
+		return OS_ERROR;
+
+	wait = (watch->queue.count > 0) ? WAIT_OBJECT_0 : WaitForMultipleObjects(watch->count, watch->events, FALSE, (timeout_ms < 0) ? INFINITE : (uint32_t)timeout_ms);
+	if (wait == WAIT_TIMEOUT)
+		return 0;
+	if (wait == WAIT_FAILED)
+		return OS_ERROR;
+
+	// Keep reading until the changes settle or they fill the buffer
+	do {
+		for (uint32_t i = 0; i < watch->count; ++i)
+		{
+			if (WaitForSingleObject(watch->events[i], 0) == WAIT_OBJECT_0 && os_watch_read(watch, watch->dirs[i]) != OS_OK)
+				return OS_ERROR;
+		}
+	} while (watch->queue.size < buffer_size &&
+		WaitForMultipleObjects(watch->count, watch->events, FALSE, debounce_ms) < WAIT_OBJECT_0 + watch->count);
+
+	return os_watch_queue_emit(&watch->queue, buffer, buffer_size);
+}
+
+/* Threads for the task scheduler */
+typedef void* OS_Thread;
+
+typedef struct {
+	SRWLOCK            lock;
+	CONDITION_VARIABLE cond;
+} OS_Sleeper;
+
+static unsigned long __stdcall os_thread_entry(void* arg)
+{
+	os_scheduler_run_worker(arg);
+	return 0;
+}
+
+static int os_thread_create(OS_Thread* thread, void* arg)
+{
+	*thread = CreateThread(0, 0, os_thread_entry, arg, 0, 0);
+	return (*thread) ? OS_OK : OS_ERROR;
+}
+
+static void os_thread_join(OS_Thread thread)
+{
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+}
+
+static OS_Thread os_thread_current()
+{
+	return GetCurrentThread();
+}
+
+static void os_thread_pin(OS_Thread thread, uint32_t processor)
+{
+	SetThreadAffinityMask(thread, (DWORD_PTR)1 << (processor % (sizeof(DWORD_PTR) * 8)));
+}
+
+/* Profiling, the fiber local storage callback tells when a profiled thread exits */
+static void os_profile_thread_exit(void* state);
+static INIT_ONCE os_profile_exit_once = INIT_ONCE_STATIC_INIT;
+static unsigned long os_profile_exit_index = FLS_OUT_OF_INDEXES;
+
+static void __stdcall os_profile_fls_callback(void* state)
+{
+	if (state)
+		os_profile_thread_exit(state);
+}
+
+static BOOL __stdcall os_profile_exit_index_create(INIT_ONCE* once, void* param, void** context)
+{
+	(void)once; (void)param; (void)context;
+	os_profile_exit_index = FlsAlloc(os_profile_fls_callback);
+	return TRUE;
+}
+
+static void os_profile_notify_exit(void* state)
+{
+	InitOnceExecuteOnce(&os_profile_exit_once, os_profile_exit_index_create, 0, 0);
+	if (os_profile_exit_index != FLS_OUT_OF_INDEXES)
+		FlsSetValue(os_profile_exit_index, state);
+}
+
+static uint32_t os_processor_count()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (info.dwNumberOfProcessors > 0) ? info.dwNumberOfProcessors : 1;
+}
+
+static void os_sleeper_init(OS_Sleeper* sleeper)
+{
+	InitializeSRWLock(&sleeper->lock);
+	InitializeConditionVariable(&sleeper->cond);
+}
+
+static void os_sleeper_destroy(OS_Sleeper* sleeper)
+{
+	(void)sleeper;
+}
+
+static void os_sleeper_lock(OS_Sleeper* sleeper)
+{
+	AcquireSRWLockExclusive(&sleeper->lock);
+}
+
+static void os_sleeper_unlock(OS_Sleeper* sleeper)
+{
+	ReleaseSRWLockExclusive(&sleeper->lock);
+}
+
+static void os_sleeper_wait(OS_Sleeper* sleeper)
+{
+	SleepConditionVariableSRW(&sleeper->cond, &sleeper->lock, INFINITE, 0);
+}
+
+static void os_sleeper_wake_all(OS_Sleeper* sleeper)
+{
+	WakeAllConditionVariable(&sleeper->cond);
+}
+
+
+/* Asynchronous IO, executed synchronously at submission */
+struct OS_Io_t {
+	OS_IoRequest** done;
+	uint32_t       done_head;
+	uint32_t       done_count;
+	uint32_t       queue_depth;
+};
+
+OS_Io* os_io_create(uint32_t queue_depth, uint32_t flags)
+{
+	OS_Io* io = calloc(1, sizeof(OS_Io));
+	(void)flags;
+	if (io)
+	{
+		io->queue_depth = (queue_depth) ? queue_depth : 1;
+		io->done = calloc(io->queue_depth, sizeof(OS_IoRequest*));
+		if (!io->done)
+		{
+			free(io);
+			io = 0;
+		}
+	}
+	return io;
+}
+
+void os_io_destroy(OS_Io* io)
+{
+	free(io->done);
+	free(io);
+}
+
+int64_t os_io_open(const char* filename, uint32_t flags)
+{
+	uint32_t access = 0;
+	uint32_t attributes = FILE_ATTRIBUTE_NORMAL;
+	if (flags & OS_IO_OPEN_READ) access |= GENERIC_READ;
+	if (flags & OS_IO_OPEN_WRITE) access |= GENERIC_WRITE;
+	if (flags & OS_IO_OPEN_DIRECT) attributes |= FILE_FLAG_NO_BUFFERING;
+
+	void* fhandle = CreateFileA(filename, access, FILE_SHARE_READ, 0, (flags & OS_IO_OPEN_CREATE) ? CREATE_ALWAYS : OPEN_EXISTING, attributes, 0);
+	if (fhandle == INVALID_HANDLE_VALUE)
+		return OS_ERROR;
+	return (int64_t)fhandle;
+}
+
+void os_io_close(int64_t file)
+{
+	CloseHandle((void*)file);
+}
+
+int os_io_register_buffers(OS_Io* io, void** buffers, uint64_t* sizes, uint32_t count)
+{
+	(void)io; (void)buffers; (void)sizes; (void)count;
+	return OS_OK;
+}
+
+int64_t os_io_submit(OS_Io* io, OS_IoRequest** requests, uint32_t count)
+{
+	uint32_t submitted = 0;
+	for (; submitted < count && io->done_count < io->queue_depth; ++submitted)
+	{
+		OS_IoRequest* request = requests[submitted];
+		OVERLAPPED overlapped = { 0 };
+		uint32_t transferred = 0;
+		int ok;
+
+		overlapped.Offset = (uint32_t)request->offset;
+		overlapped.OffsetHigh = (uint32_t)(request->offset >> 32);
+		if (request->operation == OS_IO_READ)
+			ok = ReadFile((void*)request->file, request->buffer, request->size, &transferred, &overlapped);
+		else
+			ok = WriteFile((void*)request->file, request->buffer, request->size, &transferred, &overlapped);
+		request->result = transferred;
+		request->error = (ok) ? OS_OK : OS_ERROR;
+
+		io->done[(io->done_head + io->done_count) % io->queue_depth] = request;
+		io->done_count++;
+	}
+	return submitted;
+}
+
+uint32_t os_io_poll(OS_Io* io, OS_IoRequest** out_completed, uint32_t max_count)
+{
+	uint32_t count = 0;
+	for (; count < max_count && io->done_count > 0; ++count)
+	{
+		out_completed[count] = io->done[io->done_head];
+		io->done_head = (io->done_head + 1) % io->queue_depth;
+		io->done_count--;
+	}
+	return count;
+}
+
+int64_t os_io_wait(OS_Io* io, OS_IoRequest** out_completed, uint32_t min_count, uint32_t max_count)
+{
+	// Everything submitted is already completed
+	(void)min_count;
+	return os_io_poll(io, out_completed, max_count);
+}
+#endif
+
+#elif defined(__linux__)
+#if defined(HO_OS_IMPLEMENT)
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <linux/io_uring.h>
+
+/* Timing */
+static double os_time_monotonic(double scale)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * scale + (double)ts.tv_nsec * (scale / 1000000000.0);
+}
+void os_time_init()
+{
+	// CLOCK_MONOTONIC needs no initialization
+}
+double os_time_ns()
+{
+	return os_time_monotonic(1000000000.0);
+}
+double os_time_us()
+{
+	return os_time_monotonic(1000000.0);
+}
+double os_time_ms()
+{
+	return os_time_monotonic(1000.0);
+}
+double os_time_sec()
+{
+	return os_time_monotonic(1.0);
+}
+
+void os_datetime(OS_Datetime* systime)
+{
+	struct timespec ts;
+	struct tm t;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	gmtime_r(&ts.tv_sec, &t);
+
+	systime->year = (uint16_t)(t.tm_year + 1900);
+	systime->month = (uint16_t)(t.tm_mon + 1);
+	systime->day_week = (uint16_t)t.tm_wday;
+	systime->day = (uint16_t)t.tm_mday;
+	systime->hour = (uint16_t)t.tm_hour;
+	systime->minute = (uint16_t)t.tm_min;
+	systime->second = (uint16_t)t.tm_sec;
+	systime->milliseconds = (uint16_t)(ts.tv_nsec / 1000000);
+}
+
+/* Files */
+static uint64_t os_file_time(struct timespec ts)
+{
+	// Same units and epoch as a Windows FILETIME
+	return ((uint64_t)ts.tv_sec + 11644473600ull) * 10000000ull + (uint64_t)ts.tv_nsec / 100;
+}
+
+static uint64_t os_file_statx_time(struct statx_timestamp t)
+{
+	struct timespec ts;
+	ts.tv_sec = t.tv_sec;
+	ts.tv_nsec = t.tv_nsec;
+	return os_file_time(ts);
+}
+
+// Read only is decided from the mode bits for the effective user and group instead of calling
+// access() for every file, so ACLs, supplementary groups and read only mounts are not considered
+static OS_FileAttributes os_file_attributes_from_mode(const char* name, uint32_t mode, uint32_t uid, uint32_t gid, uid_t euid, gid_t egid)
+{
+	uint32_t attributes = 0;
+	uint32_t write_bit = (uid == euid) ? S_IWUSR : (gid == egid) ? S_IWGRP : S_IWOTH;
+	if (S_ISDIR(mode))
+		attributes |= OS_FILE_ATTRIBUTE_DIRECTORY;
+	else if (S_ISCHR(mode) || S_ISBLK(mode))
+		attributes |= OS_FILE_ATTRIBUTE_DEVICE;
+	if (name[0] == '.')
+		attributes |= OS_FILE_ATTRIBUTE_HIDDEN;
+	if (euid != 0 && !(mode & write_bit))
+		attributes |= OS_FILE_ATTRIBUTE_READONLY;
+	if (attributes == 0)
+		attributes = OS_FILE_ATTRIBUTE_NORMAL;
+	return (OS_FileAttributes)attributes;
+}
+
+int os_file_exists(const char* in_filename)
+{
+	return (access(in_filename, F_OK) == 0);
+}
+
+int64_t os_file_size(const char* in_filename)
+{
+	struct stat st;
+	if (stat(in_filename, &st) == 0)
+		return (int64_t)st.st_size;
+	return -1;
+}
+
+OS_FileAttributes os_file_attributes(const char* filename)
+{
+	struct stat st;
+	if (stat(filename, &st) != 0)
+		return (OS_FileAttributes)0xffffffff;
+	return os_file_attributes_from_mode(os_file_name_from_path(filename), st.st_mode, st.st_uid, st.st_gid, geteuid(), getegid());
+}
+
+char* os_file_fullpath(const char* path)
+{
+	return realpath(path, 0);
+}
+
+int os_file_delete(const char* path)
+{
+	if (unlink(path) == 0)
+		return OS_OK;
+	return OS_ERROR;
+}
+
+OS_FileData* os_file_list_dir(const char* path)
+{
+	int capacity = 4;
+	int index = 0;
+	OS_FileData* data_array = (OS_FileData*)calloc(capacity, sizeof(OS_FileData));
+	char dirpath[PATH_MAX];
+	const char* pattern = 0;
+	char* name;
+	size_t dirlen = strlen(path);
+	uid_t euid = geteuid();
+	gid_t egid = getegid();
+	DIR* dir;
+
+	if (!data_array || dirlen >= PATH_MAX)
+		return data_array;
+
+	// Accept the same "dir/*.txt" search patterns as the Windows version, a path without
+	// wildcards in its last component lists that directory
+	memcpy(dirpath, path, dirlen + 1);
+	name = strrchr(dirpath, '/');
+	name = (name) ? name + 1 : dirpath;
+	if (strpbrk(name, "*?["))
+	{
+		pattern = path + (name - dirpath);
+		*name = 0;
+		// On Windows "*.*" also matches names without a dot
+		if (strcmp(pattern, "*.*") == 0)
+			pattern = "*";
+	}
+	if (dirpath[0] == 0)
+		strcpy(dirpath, ".");
+
+	dir = opendir(dirpath);
+	if (dir)
+	{
+		struct dirent* entry;
+		while ((entry = readdir(dir)) != 0)
+		{
+			struct statx stx;
+			if (pattern && fnmatch(pattern, entry->d_name, 0) != 0)
+				continue;
+			// Leave room for the empty entry at the end
+			if (index + 1 >= capacity)
+			{
+				capacity *= 2;
+				OS_FileData* new_array = (OS_FileData*)realloc(data_array, capacity * sizeof(OS_FileData));
+				if (new_array)
+					data_array = new_array;
+				else
+					break;
+			}
+			memset(data_array + index, 0, sizeof(OS_FileData));
+			// Stat relative to the open directory, the kernel doesn't walk the path again
+			if (statx(dirfd(dir), entry->d_name, 0, STATX_BASIC_STATS | STATX_BTIME, &stx) == 0)
+			{
+				data_array[index].access_time = os_file_statx_time(stx.stx_atime);
+				// Filesystems that don't record a birth time give the last status change instead
+				data_array[index].creation_time = os_file_statx_time((stx.stx_mask & STATX_BTIME) ? stx.stx_btime : stx.stx_ctime);
+				data_array[index].write_time = os_file_statx_time(stx.stx_mtime);
+				data_array[index].attributes = os_file_attributes_from_mode(entry->d_name, stx.stx_mode, stx.stx_uid, stx.stx_gid, euid, egid);
+			}
+			// d_name is at most NAME_MAX (255) bytes, it always fits
+			strncpy(data_array[index].filename, entry->d_name, MAX_PATH - 1);
+
+			++index;
+		}
+		closedir(dir);
+	}
+	memset(data_array + index, 0, sizeof(OS_FileData));
+	return data_array;
+}
+
+static int64_t os_file_write_all(int fd, const void* mem, int64_t size)
+{
+	int64_t total = 0;
+	while (total < size)
+	{
+		ssize_t written = write(fd, (const char*)mem + total, (size_t)(size - total));
+		if (written < 0)
+		{
+			if (errno == EINTR) continue;
+			break;
+		}
+		total += written;
+	}
+	return total;
+}
+
+static int64_t os_file_read_all(int fd, void* mem, int64_t size)
+{
+	int64_t total = 0;
+	while (total < size)
+	{
+		ssize_t bytes_read = read(fd, (char*)mem + total, (size_t)(size - total));
+		if (bytes_read < 0)
+		{
+			if (errno == EINTR) continue;
+			break;
+		}
+		if (bytes_read == 0)
+			break;
+		total += bytes_read;
+	}
+	return total;
+}
+
+uint32_t os_file_write(const char* filename, void* mem, uint32_t size)
+{
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd != -1)
+	{
+		uint32_t written = (uint32_t)os_file_write_all(fd, mem, size);
+		close(fd);
+		return written;
+	}
+	return 0;
+}
+
+uint32_t os_file_append(const char* filename, void* mem, uint32_t size)
+{
+	int fd = open(filename, O_WRONLY | O_APPEND);
+	if (fd != -1)
+	{
+		uint32_t written = (uint32_t)os_file_write_all(fd, mem, size);
+		close(fd);
+		return written;
+	}
+	return 0;
+}
+
+uint64_t os_file_read_to_mem(const char* in_filename, int64_t in_size, void* in_memory)
+{
+	int fd;
+	uint64_t bytes_read = 0;
+	if (!in_memory)
+		return 0;
+
+	fd = open(in_filename, O_RDONLY);
+	if (fd != -1)
+	{
+		bytes_read = (uint64_t)os_file_read_all(fd, in_memory, in_size);
+		close(fd);
+	}
+	return bytes_read;
+}
+
+void* os_file_read(const char* in_filename, int64_t* out_size)
+{
+	void* mem = 0;
+	int fd = open(in_filename, O_RDONLY);
+	if (fd != -1)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0)
+		{
+			mem = calloc(1, (size_t)st.st_size + 1);
+			if (mem)
+			{
+				// A read error or a file truncated while reading is a failure, not a shorter file
+				int64_t bytes_read = os_file_read_all(fd, mem, (int64_t)st.st_size);
+				if (bytes_read == (int64_t)st.st_size)
+				{
+					if (out_size) *out_size = bytes_read;
+				}
+				else
+				{
+					free(mem);
+					mem = 0;
+				}
+			}
+		}
+		close(fd);
+	}
+	return mem;
+}
+
+void* os_file_map(const char* in_filename, int64_t* out_size, uint32_t flags)
+{
+	void* result = 0;
+	int fd = open(in_filename, O_RDONLY);
+	if (fd != -1)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			result = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (result == MAP_FAILED)
+			{
+				result = 0;
+			}
+			else
+			{
+				if (flags & OS_FILE_MAP_SEQUENTIAL)
+					madvise(result, (size_t)st.st_size, MADV_SEQUENTIAL);
+				if (flags & OS_FILE_MAP_WILLNEED)
+					madvise(result, (size_t)st.st_size, MADV_WILLNEED);
+			}
+		}
+		if (out_size) *out_size = (result) ? (int64_t)st.st_size : 0;
+		// The mapping stays valid after the file is closed
+		close(fd);
+	}
+	return result;
+}
+
+void os_file_unmap(void* mem, int64_t size)
+{
+	munmap(mem, (size_t)size);
+}
+
+/* Streaming files, read ahead is done by a thread filling the two buffers in turn */
+struct OS_FileReader_t {
+	int             fd;
+	uint32_t        chunk_size;
+	char*           buffers[2];
+	int64_t         sizes[2];
+	int             filled[2];
+	int             current;  /* next buffer handed to the caller */
+	int             held;     /* buffer the caller is using, -1 if none */
+	int             done;
+	int             readahead;
+	int             stop;
+	pthread_t       thread;
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+};
+
+static void* os_file_reader_thread(void* arg)
+{
+	OS_FileReader* reader = (OS_FileReader*)arg;
+	int index = 0;
+	for (;;)
+	{
+		int64_t size;
+		pthread_mutex_lock(&reader->lock);
+		while (reader->filled[index] && !reader->stop)
+			pthread_cond_wait(&reader->cond, &reader->lock);
+		if (reader->stop)
+		{
+			pthread_mutex_unlock(&reader->lock);
+			break;
+		}
+		pthread_mutex_unlock(&reader->lock);
+
+		size = os_file_read_all(reader->fd, reader->buffers[index], reader->chunk_size);
+
+		pthread_mutex_lock(&reader->lock);
+		reader->sizes[index] = size;
+		reader->filled[index] = 1;
+		pthread_cond_broadcast(&reader->cond);
+		pthread_mutex_unlock(&reader->lock);
+
+		if (size < reader->chunk_size)
+			break;
+		index ^= 1;
+	}
+	return 0;
+}
+
+OS_FileReader* os_file_reader_open(const char* filename, uint32_t chunk_size, uint32_t flags)
+{
+	OS_FileReader* reader = (OS_FileReader*)calloc(1, sizeof(OS_FileReader));
+	if (!reader)
+		return 0;
+
+	reader->chunk_size = chunk_size;
+	reader->held = -1;
+	reader->readahead = (flags & OS_FILE_STREAM_READAHEAD) != 0;
+	reader->buffers[0] = (char*)malloc((reader->readahead) ? 2 * (size_t)chunk_size : chunk_size);
+	reader->buffers[1] = reader->buffers[0] + chunk_size;
+	reader->fd = open(filename, O_RDONLY);
+	if (!reader->buffers[0] || reader->fd == -1)
+	{
+		if (reader->fd != -1) close(reader->fd);
+		free(reader->buffers[0]);
+		free(reader);
+		return 0;
+	}
+	posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	if (reader->readahead)
+	{
+		pthread_mutex_init(&reader->lock, 0);
+		pthread_cond_init(&reader->cond, 0);
+		if (pthread_create(&reader->thread, 0, os_file_reader_thread, reader) != 0)
+		{
+			pthread_mutex_destroy(&reader->lock);
+			pthread_cond_destroy(&reader->cond);
+			reader->readahead = 0;
+		}
+	}
+	return reader;
+}
+
+void* os_file_reader_next(OS_FileReader* reader, int64_t* out_size)
+{
+	int64_t size = 0;
+	char* chunk = 0;
+
+	if (!reader->done)
+	{
+		if (reader->readahead)
+		{
+			pthread_mutex_lock(&reader->lock);
+			if (reader->held >= 0)
+			{
+				reader->filled[reader->held] = 0;
+				pthread_cond_broadcast(&reader->cond);
+			}
+			while (!reader->filled[reader->current])
+				pthread_cond_wait(&reader->cond, &reader->lock);
+			size = reader->sizes[reader->current];
+			chunk = reader->buffers[reader->current];
+			reader->held = reader->current;
+			reader->current ^= 1;
+			pthread_mutex_unlock(&reader->lock);
+		}
+		else
+		{
+			size = os_file_read_all(reader->fd, reader->buffers[0], reader->chunk_size);
+			chunk = reader->buffers[0];
+		}
+		// The reader thread stops after a short chunk
+		if (size < reader->chunk_size)
+			reader->done = 1;
+	}
+
+	if (out_size) *out_size = size;
+	return (size > 0) ? chunk : 0;
+}
+
+void os_file_reader_close(OS_FileReader* reader)
+{
+	if (reader->readahead)
+	{
+		pthread_mutex_lock(&reader->lock);
+		reader->stop = 1;
+		pthread_cond_broadcast(&reader->cond);
+		pthread_mutex_unlock(&reader->lock);
+		pthread_join(reader->thread, 0);
+		pthread_mutex_destroy(&reader->lock);
+		pthread_cond_destroy(&reader->cond);
+	}
+	close(reader->fd);
+	free(reader->buffers[0]);
+	free(reader);
+}
+
+static int64_t os_file_stream_open(const char* filename, int append)
+{
+	int fd = open(filename, O_WRONLY | O_CREAT | ((append) ? O_APPEND : O_TRUNC), 0644);
+	return (fd == -1) ? OS_ERROR : fd;
+}
+
+static int os_file_stream_write(int64_t file, const void* mem, uint32_t size)
+{
+	return (os_file_write_all((int)file, mem, size) == size) ? OS_OK : OS_ERROR;
+}
+
+static void os_file_stream_close(int64_t file)
+{
+	close((int)file);
+}
+
+/* Directory walk, threads take directories from a shared stack and push the subdirectories they find */
+typedef struct {
+	uint64_t ino;
+	int64_t  off;
+	uint16_t reclen;
+	uint8_t  type;
+	char     name[1];
+} OS_Dirent64;
+
+/* A directory to read, its path is allocated until it is read */
+typedef struct {
+	char*    path;
+	uint32_t length;
+	uint64_t entry;  /* parent of what it contains */
+} OS_WalkDir;
+
+typedef struct {
+	OS_WalkList*    lists;
+	uint32_t        flags;
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+	OS_WalkDir*     pending;
+	uint64_t        pending_count;
+	uint64_t        pending_capacity;
+	uint32_t        active;   /* threads reading a directory, which may push more */
+	int             failed;   /* out of memory, the walk is incomplete and the workers stop */
+} OS_WalkShared;
+
+typedef struct {
+	OS_WalkShared* shared;
+	uint32_t       index;
+} OS_WalkWorker;
+
+/* Returns OS_ERROR if an entry couldn't be stored, a directory that can't be opened is skipped */
+static int os_walk_read_dir(OS_WalkList* list, OS_WalkDir dir, uint32_t flags, void* buffer, uint32_t buffer_size)
+{
+	int fd = open(dir.path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	long size;
+	if (fd == -1)
+		return OS_OK;
+
+	while ((size = syscall(SYS_getdents64, fd, buffer, buffer_size)) > 0)
+	{
+		for (long offset = 0; offset < size;)
+		{
+			OS_Dirent64* dirent = (OS_Dirent64*)((char*)buffer + offset);
+			const char* name = dirent->name;
+			uint32_t type = dirent->type;
+			uint32_t attributes = 0;
+			OS_WalkEntry* entry;
+
+			offset += dirent->reclen;
+			if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+				continue;
+			entry = os_walk_push(list, dir.entry, name, (uint32_t)strlen(name));
+			if (!entry)
+			{
+				close(fd);
+				return OS_ERROR;
+			}
+
+			// Stat relative to the directory, the kernel doesn't walk the path again
+			if ((flags & OS_WALK_STAT) || type == DT_UNKNOWN)
+			{
+				struct statx stx;
+				if (statx(fd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, STATX_TYPE | STATX_SIZE | STATX_MTIME, &stx) == 0)
+				{
+					type = IFTODT(stx.stx_mode);
+					entry->size = stx.stx_size;
+					entry->write_time = os_file_statx_time(stx.stx_mtime);
+				}
+			}
+
+			if (type == DT_DIR)
+				attributes |= OS_FILE_ATTRIBUTE_DIRECTORY;
+			else if (type == DT_CHR || type == DT_BLK)
+				attributes |= OS_FILE_ATTRIBUTE_DEVICE;
+			if (name[0] == '.')
+				attributes |= OS_FILE_ATTRIBUTE_HIDDEN;
+			entry->attributes = (OS_FileAttributes)((attributes) ? attributes : (uint32_t)OS_FILE_ATTRIBUTE_NORMAL);
+		}
+	}
+	close(fd);
+	return OS_OK;
+}
+
+static void* os_walk_worker(void* arg)
+{
+	OS_WalkWorker* worker = (OS_WalkWorker*)arg;
+	OS_WalkShared* shared = worker->shared;
+	OS_WalkList* list = shared->lists + worker->index;
+	uint64_t buffer[4096];
+
+	pthread_mutex_lock(&shared->lock);
+	for (;;)
+	{
+		OS_WalkDir dir;
+		uint64_t first;
+		uint32_t separator;
+		int result;
+		while (!shared->failed && shared->pending_count == 0 && shared->active > 0)
+			pthread_cond_wait(&shared->cond, &shared->lock);
+		// Nothing left and nobody can find more, or the walk already failed
+		if (shared->failed || shared->pending_count == 0)
+			break;
+
+		dir = shared->pending[--shared->pending_count];
+		shared->active++;
+		pthread_mutex_unlock(&shared->lock);
+
+		first = list->count;
+		result = os_walk_read_dir(list, dir, shared->flags, buffer, sizeof(buffer));
+		separator = (dir.length > 0 && dir.path[dir.length - 1] != '/');
+
+		pthread_mutex_lock(&shared->lock);
+		if (result != OS_OK)
+			shared->failed = 1;
+		for (uint64_t i = first; i < list->count && !shared->failed; ++i)
+		{
+			OS_WalkEntry* entry = list->entries + i;
+			OS_WalkDir* pending;
+			if (!(entry->attributes & OS_FILE_ATTRIBUTE_DIRECTORY))
+				continue;
+			if (shared->pending_count == shared->pending_capacity)
+			{
+				uint64_t capacity = shared->pending_capacity * 2;
+				pending = (OS_WalkDir*)realloc(shared->pending, capacity * sizeof(OS_WalkDir));
+				if (!pending)
+				{
+					shared->failed = 1;
+					break;
+				}
+				shared->pending = pending;
+				shared->pending_capacity = capacity;
+			}
+			// Only the directories waiting to be read keep a full path
+			pending = shared->pending + shared->pending_count;
+			pending->length = dir.length + separator + entry->name_length;
+			pending->path = (char*)malloc(pending->length + 1);
+			if (!pending->path)
+			{
+				shared->failed = 1;
+				break;
+			}
+			memcpy(pending->path, dir.path, dir.length);
+			if (separator)
+				pending->path[dir.length] = '/';
+			memcpy(pending->path + dir.length + separator, entry->name, entry->name_length + 1);
+			pending->entry = ((uint64_t)worker->index << OS_WALK_LIST_SHIFT) | i;
+			shared->pending_count++;
+		}
+		free(dir.path);
+		shared->active--;
+		pthread_cond_broadcast(&shared->cond);
+	}
+	pthread_mutex_unlock(&shared->lock);
+	return 0;
+}
+
+OS_Walk* os_walk(const char* path, uint32_t thread_count, uint32_t flags)
+{
+	OS_WalkShared shared;
+	OS_WalkWorker* workers;
+	pthread_t* threads;
+	uint32_t started = 1;
+
+	if (thread_count == 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = (cpus < 1) ? 1 : (uint32_t)cpus;
+	}
+
+	memset(&shared, 0, sizeof(shared));
+	shared.flags = flags;
+	shared.pending_capacity = 256;
+	shared.pending = (OS_WalkDir*)malloc(shared.pending_capacity * sizeof(OS_WalkDir));
+	shared.lists = (OS_WalkList*)calloc(thread_count, sizeof(OS_WalkList));
+	workers = (OS_WalkWorker*)calloc(thread_count, sizeof(OS_WalkWorker));
+	threads = (pthread_t*)calloc(thread_count, sizeof(pthread_t));
+	if (!shared.pending || !shared.lists || !workers || !threads)
+	{
+		free(shared.pending);
+		free(shared.lists);
+		free(workers);
+		free(threads);
+		return 0;
+	}
+	shared.pending[0].length = (uint32_t)strlen(path);
+	shared.pending[0].path = (char*)malloc(shared.pending[0].length + 1);
+	shared.pending[0].entry = OS_WALK_ROOT;
+	if (!shared.pending[0].path)
+	{
+		free(shared.pending);
+		free(shared.lists);
+		free(workers);
+		free(threads);
+		return 0;
+	}
+	memcpy(shared.pending[0].path, path, shared.pending[0].length + 1);
+	shared.pending_count = 1;
+	pthread_mutex_init(&shared.lock, 0);
+	pthread_cond_init(&shared.cond, 0);
+
+	// The calling thread is the first worker
+	for (uint32_t i = 0; i < thread_count; ++i)
+	{
+		workers[i].shared = &shared;
+		workers[i].index = i;
+	}
+	for (; started < thread_count; ++started)
+	{
+		if (pthread_create(&threads[started], 0, os_walk_worker, &workers[started]) != 0)
+			break;
+	}
+	os_walk_worker(&workers[0]);
+	for (uint32_t i = 1; i < started; ++i)
+		pthread_join(threads[i], 0);
+
+	pthread_mutex_destroy(&shared.lock);
+	pthread_cond_destroy(&shared.cond);
+	// The workers stopped early, the directories still waiting were never read
+	for (uint64_t i = 0; i < shared.pending_count; ++i)
+		free(shared.pending[i].path);
+	free(shared.pending);
+	free(workers);
+	free(threads);
+	if (shared.failed)
+	{
+		os_walk_free_lists(shared.lists, thread_count);
+		return 0;
+	}
+	return os_walk_finish(shared.lists, thread_count, path, '/');
+}
+
+/* File watching */
+#define OS_WATCH_MASK (IN_CREATE | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_ATTRIB | IN_DELETE_SELF)
+
+typedef struct {
+	char*    path;
+	uint32_t length;
+	int      recursive;
+} OS_WatchDir;
+
+struct OS_Watch_t {
+	int           fd;
+	OS_WatchDir*  dirs;      /* indexed by the inotify watch descriptor */
+	uint32_t      dir_capacity;
+	OS_WatchQueue queue;
+};
+
+OS_Watch* os_watch_create()
+{
+	OS_Watch* watch = (OS_Watch*)calloc(1, sizeof(OS_Watch));
+	if (watch)
+	{
+		watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (watch->fd == -1)
+		{
+			free(watch);
+			watch = 0;
+		}
+	}
+	return watch;
+}
+
+void os_watch_destroy(OS_Watch* watch)
+{
+	close(watch->fd);
+	for (uint32_t i = 0; i < watch->dir_capacity; ++i)
+		free(watch->dirs[i].path);
+	free(watch->dirs);
+	os_watch_queue_free(&watch->queue);
+	free(watch);
+}
+
+static int os_watch_add_one(OS_Watch* watch, const char* path, uint32_t length, int recursive)
+{
+	int wd = inotify_add_watch(watch->fd, path, OS_WATCH_MASK);
+	char* copy;
+	if (wd < 0)
+		return OS_ERROR;
+
+	if ((uint32_t)wd >= watch->dir_capacity)
+	{
+		uint32_t capacity = (watch->dir_capacity) ? watch->dir_capacity : 64;
+		OS_WatchDir* dirs;
+		while (capacity <= (uint32_t)wd)
+			capacity *= 2;
+		dirs = (OS_WatchDir*)realloc(watch->dirs, capacity * sizeof(OS_WatchDir));
+		if (!dirs)
+			return OS_ERROR;
+		memset(dirs + watch->dir_capacity, 0, (capacity - watch->dir_capacity) * sizeof(OS_WatchDir));
+		watch->dirs = dirs;
+		watch->dir_capacity = capacity;
+	}
+	copy = (char*)malloc(length + 1);
+	if (!copy)
+		return OS_ERROR;
+	memcpy(copy, path, length + 1);
+
+	// The same directory added twice keeps one watch descriptor
+	free(watch->dirs[wd].path);
+	watch->dirs[wd].path = copy;
+	watch->dirs[wd].length = length;
+	watch->dirs[wd].recursive |= recursive;
+	return OS_OK;
+}
+
+static int os_watch_add_tree(OS_Watch* watch, const char* path, uint32_t length)
+{
+	OS_Walk* walk;
+	OS_WalkEntry* entries;
+	uint64_t count;
+	uint32_t buffer_size = PATH_MAX;
+	char* buffer;
+
+	if (os_watch_add_one(watch, path, length, 1) != OS_OK)
+		return OS_ERROR;
+	walk = os_walk(path, 1, 0);
+	buffer = (char*)malloc(buffer_size);
+	if (!walk || !buffer)
+	{
+		if (walk) os_walk_free(walk);
+		free(buffer);
+		return OS_ERROR;
+	}
+	entries = os_walk_entries(walk, &count);
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		uint32_t path_length;
+		if (!(entries[i].attributes & OS_FILE_ATTRIBUTE_DIRECTORY))
+			continue;
+		path_length = os_walk_path(walk, i, buffer, buffer_size);
+		if (path_length >= buffer_size)
+		{
+			char* bigger = (char*)realloc(buffer, path_length + 1);
+			if (!bigger)
+				continue;
+			buffer = bigger;
+			buffer_size = path_length + 1;
+			os_walk_path(walk, i, buffer, buffer_size);
+		}
+		// Directories removed in the meantime are not an error
+		os_watch_add_one(watch, buffer, path_length, 1);
+	}
+	free(buffer);
+	os_walk_free(walk);
+	return OS_OK;
+}
+
+int os_watch_add(OS_Watch* watch, const char* path, uint32_t flags)
+{
+	if (flags & OS_WATCH_RECURSIVE)
+		return os_watch_add_tree(watch, path, (uint32_t)strlen(path));
+	return os_watch_add_one(watch, path, (uint32_t)strlen(path), 0);
+}
+
+static int os_watch_read(OS_Watch* watch)
+{
+	uint64_t buffer[2048];
+	ssize_t size;
+	while ((size = read(watch->fd, buffer, sizeof(buffer))) > 0)
+	{
+		for (ssize_t offset = 0; offset < size;)
+		{
+			struct inotify_event* event = (struct inotify_event*)((char*)buffer + offset);
+			OS_WatchDir* dir = ((uint32_t)event->wd < watch->dir_capacity) ? watch->dirs + event->wd : 0;
+			uint32_t name_length = (event->len) ? (uint32_t)strlen(event->name) : 0;
+			uint32_t events = 0;
+			offset += sizeof(struct inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				if (os_watch_queue_add(&watch->queue, "", 0, "", 0, OS_WATCH_OVERFLOW, '/') != OS_OK)
+					return OS_ERROR;
+				continue;
+			}
+			if (!dir || !dir->path)
+				continue;
+			if (event->mask & IN_IGNORED)
+			{
+				free(dir->path);
+				memset(dir, 0, sizeof(OS_WatchDir));
+				continue;
+			}
+
+			if (event->mask & (IN_CREATE | IN_MOVED_TO)) events |= OS_WATCH_CREATED;
+			if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE)) events |= OS_WATCH_MODIFIED;
+			if (event->mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF)) events |= OS_WATCH_DELETED;
+			if (event->mask & IN_ATTRIB) events |= OS_WATCH_ATTRIBUTES;
+			if (os_watch_queue_add(&watch->queue, dir->path, dir->length, event->name, name_length, events, '/') != OS_OK)
+				return OS_ERROR;
+
+			// Watch new directories and everything already inside them
+			if (dir->recursive && (event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+			{
+				uint32_t length = dir->length + 1 + name_length;
+				char* path = (char*)malloc(length + 1);
+				if (!path)
+					return OS_ERROR;
+				memcpy(path, dir->path, dir->length);
+				path[dir->length] = '/';
+				memcpy(path + dir->length + 1, event->name, name_length + 1);
+				os_watch_add_tree(watch, path, length);
+				free(path);
+			}
+		}
+	}
+	if (size < 0 && errno != EAGAIN && errno != EINTR)
+		return OS_ERROR;
+	return OS_OK;
+}
+
+int64_t os_watch_wait(OS_Watch* watch, void* buffer, uint64_t buffer_size, int32_t timeout_ms, uint32_t debounce_ms)
+{
+	struct pollfd pfd;
+	pfd.fd = watch->fd;
+	pfd.events = POLLIN;
+
+	if (watch->queue.count == 0)
+	{
+		int ready = poll(&pfd, 1, timeout_ms);
+		if (ready < 0 && errno != EINTR)
+			return OS_ERROR;
+		if (ready <= 0)
+			return 0;
+	}
+
+	// Keep reading until the changes settle or they fill the buffer
+	do {
+		if (os_watch_read(watch) != OS_OK)
+			return OS_ERROR;
+	} while (watch->queue.size < buffer_size && poll(&pfd, 1, (int)debounce_ms) > 0);
+
+	return os_watch_queue_emit(&watch->queue, buffer, buffer_size);
+}
+
+/* Threads for the task scheduler */
+typedef pthread_t OS_Thread;
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+} OS_Sleeper;
+
+static void* os_thread_entry(void* arg)
+{
+	os_scheduler_run_worker(arg);
+	return 0;
+}
+
+static int os_thread_create(OS_Thread* thread, void* arg)
+{
+	return (pthread_create(thread, 0, os_thread_entry, arg) == 0) ? OS_OK : OS_ERROR;
+}
+
+static void os_thread_join(OS_Thread thread)
+{
+	pthread_join(thread, 0);
+}
+
+static OS_Thread os_thread_current()
+{
+	return pthread_self();
+}
+
+static void os_thread_pin(OS_Thread thread, uint32_t processor)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(processor % CPU_SETSIZE, &set);
+	pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+/* Profiling, the destructor of a thread specific key tells when a profiled thread exits */
+static void os_profile_thread_exit(void* state);
+static pthread_once_t os_profile_exit_once = PTHREAD_ONCE_INIT;
+static pthread_key_t os_profile_exit_key;
+
+static void os_profile_exit_key_create()
+{
+	pthread_key_create(&os_profile_exit_key, os_profile_thread_exit);
+}
+
+static void os_profile_notify_exit(void* state)
+{
+	pthread_once(&os_profile_exit_once, os_profile_exit_key_create);
+	pthread_setspecific(os_profile_exit_key, state);
+}
+
+static uint32_t os_processor_count()
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return (cpus < 1) ? 1 : (uint32_t)cpus;
+}
+
+static void os_sleeper_init(OS_Sleeper* sleeper)
+{
+	pthread_mutex_init(&sleeper->lock, 0);
+	pthread_cond_init(&sleeper->cond, 0);
+}
+
+static void os_sleeper_destroy(OS_Sleeper* sleeper)
+{
+	pthread_mutex_destroy(&sleeper->lock);
+	pthread_cond_destroy(&sleeper->cond);
+}
+
+static void os_sleeper_lock(OS_Sleeper* sleeper)
+{
+	pthread_mutex_lock(&sleeper->lock);
+}
+
+static void os_sleeper_unlock(OS_Sleeper* sleeper)
+{
+	pthread_mutex_unlock(&sleeper->lock);
+}
+
+static void os_sleeper_wait(OS_Sleeper* sleeper)
+{
+	pthread_cond_wait(&sleeper->cond, &sleeper->lock);
+}
+
+static void os_sleeper_wake_all(OS_Sleeper* sleeper)
+{
+	pthread_cond_broadcast(&sleeper->cond);
+}
+
+
+/* Asynchronous IO */
+struct OS_Io_t {
+	uint32_t       queue_depth;
+	uint32_t       in_flight;     /* submitted and not yet returned by poll/wait */
+
+	/* io_uring, ring_fd is -1 when the thread pool is used */
+	int            ring_fd;
+	void*          sq_ring;
+	size_t         sq_ring_size;
+	void*          cq_ring;
+	size_t         cq_ring_size;
+	struct io_uring_sqe* sqes;
+	size_t         sqes_size;
+	uint32_t*      sq_head;
+	uint32_t*      sq_tail;
+	uint32_t*      sq_mask;
+	uint32_t*      sq_array;
+	uint32_t*      cq_head;
+	uint32_t*      cq_tail;
+	uint32_t*      cq_mask;
+	struct io_uring_cqe* cqes;
+	OS_IoRequest** retry;         /* short transfers continued by os_io_reap */
+
+	/* thread pool */
+	pthread_t*      threads;
+	uint32_t        thread_count;
+	pthread_mutex_t lock;
+	pthread_cond_t  pending_cond;
+	pthread_cond_t  done_cond;
+	OS_IoRequest**  pending;
+	uint32_t        pending_head;
+	uint32_t        pending_count;
+	OS_IoRequest**  done;
+	uint32_t        done_head;
+	uint32_t        done_count;
+	int             stop;
+};
+
+static int os_io_uring_init(OS_Io* io)
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	io->ring_fd = (int)syscall(__NR_io_uring_setup, io->queue_depth, &params);
+	if (io->ring_fd < 0)
+		return OS_ERROR;
+
+	io->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+	io->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (io->cq_ring_size > io->sq_ring_size)
+			io->sq_ring_size = io->cq_ring_size;
+		io->cq_ring_size = io->sq_ring_size;
+	}
+
+	io->sq_ring = mmap(0, io->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ring_fd, IORING_OFF_SQ_RING);
+	if (io->sq_ring == MAP_FAILED)
+	{
+		close(io->ring_fd);
+		return OS_ERROR;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		io->cq_ring = io->sq_ring;
+	}
+	else
+	{
+		io->cq_ring = mmap(0, io->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ring_fd, IORING_OFF_CQ_RING);
+		if (io->cq_ring == MAP_FAILED)
+		{
+			munmap(io->sq_ring, io->sq_ring_size);
+			close(io->ring_fd);
+			return OS_ERROR;
+		}
+	}
+	io->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	io->sqes = (struct io_uring_sqe*)mmap(0, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ring_fd, IORING_OFF_SQES);
+	if (io->sqes == MAP_FAILED)
+	{
+		if (io->cq_ring != io->sq_ring)
+			munmap(io->cq_ring, io->cq_ring_size);
+		munmap(io->sq_ring, io->sq_ring_size);
+		close(io->ring_fd);
+		return OS_ERROR;
+	}
+
+	io->sq_head = (uint32_t*)((char*)io->sq_ring + params.sq_off.head);
+	io->sq_tail = (uint32_t*)((char*)io->sq_ring + params.sq_off.tail);
+	io->sq_mask = (uint32_t*)((char*)io->sq_ring + params.sq_off.ring_mask);
+	io->sq_array = (uint32_t*)((char*)io->sq_ring + params.sq_off.array);
+	io->cq_head = (uint32_t*)((char*)io->cq_ring + params.cq_off.head);
+	io->cq_tail = (uint32_t*)((char*)io->cq_ring + params.cq_off.tail);
+	io->cq_mask = (uint32_t*)((char*)io->cq_ring + params.cq_off.ring_mask);
+	io->cqes = (struct io_uring_cqe*)((char*)io->cq_ring + params.cq_off.cqes);
+
+	// The kernel may round the queue up, but the completion ring is always at least as big
+	io->queue_depth = params.sq_entries;
+	io->retry = (OS_IoRequest**)calloc(io->queue_depth, sizeof(OS_IoRequest*));
+	if (!io->retry)
+	{
+		munmap(io->sqes, io->sqes_size);
+		if (io->cq_ring != io->sq_ring)
+			munmap(io->cq_ring, io->cq_ring_size);
+		munmap(io->sq_ring, io->sq_ring_size);
+		close(io->ring_fd);
+		return OS_ERROR;
+	}
+	return OS_OK;
+}
+
+// Writes the entry for the part of 'request' not transferred yet, request->result holds
+// the bytes transferred so far while it is in flight
+static void os_io_uring_queue(OS_Io* io, OS_IoRequest* request, uint32_t tail)
+{
+	uint32_t index = tail & *io->sq_mask;
+	struct io_uring_sqe* sqe = io->sqes + index;
+	uint64_t done = (uint64_t)request->result;
+
+	memset(sqe, 0, sizeof(*sqe));
+	if (request->buffer_index >= 0)
+	{
+		sqe->opcode = (request->operation == OS_IO_READ) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+		sqe->buf_index = (uint16_t)request->buffer_index;
+	}
+	else
+	{
+		sqe->opcode = (request->operation == OS_IO_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+	}
+	sqe->fd = (int)request->file;
+	sqe->addr = (uint64_t)(uintptr_t)request->buffer + done;
+	sqe->len = request->size - (uint32_t)done;
+	sqe->off = request->offset + done;
+	sqe->user_data = (uint64_t)(uintptr_t)request;
+	io->sq_array[index] = index;
+}
+
+// Hands the 'count' entries written after the head to the kernel and returns how many it took,
+// or OS_ERROR if it took none. The ones it didn't take are removed from the ring again: without
+// SQPOLL the kernel only reads the ring inside io_uring_enter, so moving the tail back is safe.
+static int64_t os_io_uring_flush(OS_Io* io, uint32_t count)
+{
+	uint32_t head = *io->sq_head;
+	uint32_t accepted;
+	long entered;
+
+	__atomic_store_n(io->sq_tail, head + count, __ATOMIC_RELEASE);
+	do {
+		entered = syscall(__NR_io_uring_enter, io->ring_fd, count, 0, 0, 0, 0);
+	} while (entered < 0 && errno == EINTR);
+
+	accepted = __atomic_load_n(io->sq_head, __ATOMIC_ACQUIRE) - head;
+	__atomic_store_n(io->sq_tail, head + accepted, __ATOMIC_RELEASE);
+	if (entered < 0 && accepted == 0 && errno != EAGAIN && errno != EBUSY)
+		return OS_ERROR;
+	return accepted;
+}
+
+static void os_io_execute(OS_IoRequest* request)
+{
+	int64_t total = 0;
+	request->error = OS_OK;
+	while (total < request->size)
+	{
+		ssize_t r;
+		if (request->operation == OS_IO_READ)
+			r = pread((int)request->file, (char*)request->buffer + total, request->size - total, request->offset + total);
+		else
+			r = pwrite((int)request->file, (char*)request->buffer + total, request->size - total, request->offset + total);
+		if (r < 0)
+		{
+			if (errno == EINTR) continue;
+			request->error = OS_ERROR;
+			break;
+		}
+		if (r == 0)
+			break;
+		total += r;
+	}
+	request->result = total;
+}
+
+static void* os_io_worker(void* arg)
+{
+	OS_Io* io = (OS_Io*)arg;
+	pthread_mutex_lock(&io->lock);
+	for (;;)
+	{
+		OS_IoRequest* request;
+		while (!io->stop && io->pending_count == 0)
+			pthread_cond_wait(&io->pending_cond, &io->lock);
+		if (io->stop)
+			break;
+
+		request = io->pending[io->pending_head];
+		io->pending_head = (io->pending_head + 1) % io->queue_depth;
+		io->pending_count--;
+
+		pthread_mutex_unlock(&io->lock);
+		os_io_execute(request);
+		pthread_mutex_lock(&io->lock);
+
+		io->done[(io->done_head + io->done_count) % io->queue_depth] = request;
+		io->done_count++;
+		pthread_cond_broadcast(&io->done_cond);
+	}
+	pthread_mutex_unlock(&io->lock);
+	return 0;
+}
+
+static int os_io_threads_init(OS_Io* io)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	io->ring_fd = -1;
+	io->thread_count = (cpus < 1) ? 1 : (cpus > 8) ? 8 : (uint32_t)cpus;
+	io->threads = (pthread_t*)calloc(io->thread_count, sizeof(pthread_t));
+	io->pending = (OS_IoRequest**)calloc(io->queue_depth, sizeof(OS_IoRequest*));
+	io->done = (OS_IoRequest**)calloc(io->queue_depth, sizeof(OS_IoRequest*));
+	if (!io->threads || !io->pending || !io->done)
+		return OS_ERROR;
+
+	pthread_mutex_init(&io->lock, 0);
+	pthread_cond_init(&io->pending_cond, 0);
+	pthread_cond_init(&io->done_cond, 0);
+	for (uint32_t i = 0; i < io->thread_count; ++i)
+	{
+		if (pthread_create(&io->threads[i], 0, os_io_worker, io) != 0)
+		{
+			io->thread_count = i;
+			return (i > 0) ? OS_OK : OS_ERROR;
+		}
+	}
+	return OS_OK;
+}
+
+OS_Io* os_io_create(uint32_t queue_depth, uint32_t flags)
+{
+	OS_Io* io = (OS_Io*)calloc(1, sizeof(OS_Io));
+	if (io)
+	{
+		io->queue_depth = (queue_depth) ? queue_depth : 1;
+		if ((flags & OS_IO_THREADS) || os_io_uring_init(io) != OS_OK)
+		{
+			if (os_io_threads_init(io) != OS_OK)
+			{
+				os_io_destroy(io);
+				io = 0;
+			}
+		}
+	}
+	return io;
+}
+
+void os_io_destroy(OS_Io* io)
+{
+	if (io->ring_fd >= 0)
+	{
+		free(io->retry);
+		munmap(io->sqes, io->sqes_size);
+		if (io->cq_ring != io->sq_ring)
+			munmap(io->cq_ring, io->cq_ring_size);
+		munmap(io->sq_ring, io->sq_ring_size);
+		close(io->ring_fd);
+	}
+	else
+	{
+		if (io->thread_count > 0)
+		{
+			pthread_mutex_lock(&io->lock);
+			io->stop = 1;
+			pthread_cond_broadcast(&io->pending_cond);
+			pthread_mutex_unlock(&io->lock);
+			for (uint32_t i = 0; i < io->thread_count; ++i)
+				pthread_join(io->threads[i], 0);
+			pthread_mutex_destroy(&io->lock);
+			pthread_cond_destroy(&io->pending_cond);
+			pthread_cond_destroy(&io->done_cond);
+		}
+		free(io->threads);
+		free(io->pending);
+		free(io->done);
+	}
+	free(io);
+}
+
+int64_t os_io_open(const char* filename, uint32_t flags)
+{
+	int oflags = 0;
+	if ((flags & OS_IO_OPEN_READ) && (flags & OS_IO_OPEN_WRITE)) oflags = O_RDWR;
+	else if (flags & OS_IO_OPEN_WRITE) oflags = O_WRONLY;
+	else oflags = O_RDONLY;
+	if (flags & OS_IO_OPEN_CREATE) oflags |= O_CREAT | O_TRUNC;
+	if (flags & OS_IO_OPEN_DIRECT) oflags |= O_DIRECT;
+
+	int fd = open(filename, oflags, 0644);
+	return (fd < 0) ? OS_ERROR : fd;
+}
+
+void os_io_close(int64_t file)
+{
+	close((int)file);
+}
+
+int os_io_register_buffers(OS_Io* io, void** buffers, uint64_t* sizes, uint32_t count)
+{
+	int result = OS_OK;
+	if (io->ring_fd >= 0)
+	{
+		struct iovec* iovecs = (struct iovec*)calloc(count, sizeof(struct iovec));
+		if (!iovecs)
+			return OS_ERROR;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			iovecs[i].iov_base = buffers[i];
+			iovecs[i].iov_len = sizes[i];
+		}
+		if (syscall(__NR_io_uring_register, io->ring_fd, IORING_REGISTER_BUFFERS, iovecs, count) < 0)
+			result = OS_ERROR;
+		free(iovecs);
+	}
+	return result;
+}
+
+int64_t os_io_submit(OS_Io* io, OS_IoRequest** requests, uint32_t count)
+{
+	uint32_t submitted = 0;
+
+	// Never have more in flight than the completion queue can hold
+	if (count > io->queue_depth - io->in_flight)
+		count = io->queue_depth - io->in_flight;
+
+	if (io->ring_fd >= 0)
+	{
+		// The ring is empty between calls, entries the kernel doesn't take are removed again
+		uint32_t head = *io->sq_head;
+		int64_t accepted;
+
+		for (; submitted < count; ++submitted)
+		{
+			requests[submitted]->result = 0;
+			requests[submitted]->error = OS_OK;
+			os_io_uring_queue(io, requests[submitted], head + submitted);
+		}
+		if (submitted > 0)
+		{
+			accepted = os_io_uring_flush(io, submitted);
+			if (accepted < 0)
+				return OS_ERROR;
+			submitted = (uint32_t)accepted;
+		}
+	}
+	else
+	{
+		pthread_mutex_lock(&io->lock);
+		for (; submitted < count; ++submitted)
+		{
+			io->pending[(io->pending_head + io->pending_count) % io->queue_depth] = requests[submitted];
+			io->pending_count++;
+		}
+		pthread_cond_broadcast(&io->pending_cond);
+		pthread_mutex_unlock(&io->lock);
+	}
+
+	io->in_flight += submitted;
+	return submitted;
+}
+
+static uint32_t os_io_reap(OS_Io* io, OS_IoRequest** out_completed, uint32_t max_count)
+{
+	uint32_t count = 0;
+	if (io->ring_fd >= 0)
+	{
+		uint32_t head = *io->cq_head;
+		uint32_t tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+		uint32_t mask = *io->cq_mask;
+		uint32_t retry_count = 0;
+		int64_t accepted = 0;
+
+		// A retry keeps the request in flight, so it can't overfill the queues. Retries that the
+		// kernel refuses complete as failed, leave room for them in 'out_completed'.
+		for (; count + retry_count < max_count && head != tail; ++head)
+		{
+			struct io_uring_cqe* cqe = io->cqes + (head & mask);
+			OS_IoRequest* request = (OS_IoRequest*)(uintptr_t)cqe->user_data;
+			if (cqe->res < 0)
+			{
+				request->error = OS_ERROR;
+			}
+			else
+			{
+				request->result += cqe->res;
+				// Continue short transfers like the thread pool does, 0 bytes means end of file
+				if (cqe->res > 0 && request->result < request->size)
+				{
+					io->retry[retry_count++] = request;
+					continue;
+				}
+			}
+			out_completed[count++] = request;
+		}
+		__atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+
+		if (retry_count > 0)
+		{
+			uint32_t sq_head = *io->sq_head;
+			for (uint32_t i = 0; i < retry_count; ++i)
+				os_io_uring_queue(io, io->retry[i], sq_head + i);
+			accepted = os_io_uring_flush(io, retry_count);
+			// The kernel takes entries in order, the ones after it stopped fail
+			for (uint32_t i = (accepted < 0) ? 0 : (uint32_t)accepted; i < retry_count; ++i)
+			{
+				io->retry[i]->error = OS_ERROR;
+				out_completed[count++] = io->retry[i];
+			}
+		}
+	}
+	else
+	{
+		for (; count < max_count && io->done_count > 0; ++count)
+		{
+			out_completed[count] = io->done[io->done_head];
+			io->done_head = (io->done_head + 1) % io->queue_depth;
+			io->done_count--;
+		}
+	}
+	io->in_flight -= count;
+	return count;
+}
+
+uint32_t os_io_poll(OS_Io* io, OS_IoRequest** out_completed, uint32_t max_count)
+{
+	uint32_t count;
+	if (io->ring_fd >= 0)
+		return os_io_reap(io, out_completed, max_count);
+
+	pthread_mutex_lock(&io->lock);
+	count = os_io_reap(io, out_completed, max_count);
+	pthread_mutex_unlock(&io->lock);
+	return count;
+}
+
+int64_t os_io_wait(OS_Io* io, OS_IoRequest** out_completed, uint32_t min_count, uint32_t max_count)
+{
+	uint32_t count = 0;
+
+	if (min_count > max_count) min_count = max_count;
+	if (min_count > io->in_flight) min_count = io->in_flight;
+
+	if (io->ring_fd >= 0)
+	{
+		count = os_io_reap(io, out_completed, max_count);
+		while (count < min_count)
+		{
+			if (syscall(__NR_io_uring_enter, io->ring_fd, 0, min_count - count, IORING_ENTER_GETEVENTS, 0, 0) < 0 && errno != EINTR)
+			{
+				// The completed requests are already taken off the ring, they must be returned
+				if (count == 0)
+					return OS_ERROR;
+				break;
+			}
+			count += os_io_reap(io, out_completed + count, max_count - count);
+		}
+	}
+	else
+	{
+		pthread_mutex_lock(&io->lock);
+		while (io->done_count < min_count)
+			pthread_cond_wait(&io->done_cond, &io->lock);
+		count = os_io_reap(io, out_completed, max_count);
+		pthread_mutex_unlock(&io->lock);
+	}
+	return count;
+}
+#endif
+
+#else
+#error "OS not supported"
+#endif
+
+#if defined(HO_OS_IMPLEMENT)
+/* Portable code */
+#include <stdio.h>
+#include <string.h>
+OS_Timer os_timer_new(int start)
+{
+	OS_Timer timer;
+	timer.start = (start) ? os_time_ns() : 0;
+	timer.elapsed = 0;
+	return timer;
+}
+void os_timer_reset(OS_Timer* timer)
+{
+	timer->start = 0;
+	timer->elapsed = 0;
+}
+
+void os_timer_stop(OS_Timer* timer)
+{
+	timer->elapsed = os_time_ns() - timer->start;
+	timer->start = 0;
+}
+void os_timer_start(OS_Timer* timer)
+{
+	timer->start = os_time_ns();
+}
+double os_timer_elapsed_ms(OS_Timer* timer)
+{
+	return (timer->start) ? (os_time_ns() - timer->start + timer->elapsed) / 1000000.0 : timer->elapsed / 1000000.0;
+}
+double os_timer_elapsed_us(OS_Timer* timer)
+{
+	return (timer->start) ? (os_time_ns() - timer->start + timer->elapsed) / 1000.0 : timer->elapsed / 1000.0;
+}
+double os_timer_elapsed_ns(OS_Timer* timer)
+{
+	return (timer->start) ? (os_time_ns() - timer->start + timer->elapsed) : timer->elapsed;
+}
+
+/* Buffered writer, built on the os_file_stream_* functions of each OS */
+struct OS_FileWriter_t {
+	int64_t  file;
+	char*    buffer;
+	uint32_t capacity;
+	uint32_t used;
+	int      error;
+};
+
+OS_FileWriter* os_file_writer_open(const char* filename, uint32_t buffer_size, uint32_t flags)
+{
+	OS_FileWriter* writer = (OS_FileWriter*)calloc(1, sizeof(OS_FileWriter));
+	if (!writer)
+		return 0;
+
+	writer->capacity = buffer_size;
+	writer->buffer = (char*)malloc(buffer_size);
+	writer->file = os_file_stream_open(filename, (flags & OS_FILE_STREAM_APPEND) != 0);
+	if (!writer->buffer || writer->file == OS_ERROR)
+	{
+		if (writer->file != OS_ERROR) os_file_stream_close(writer->file);
+		free(writer->buffer);
+		free(writer);
+		return 0;
+	}
+	return writer;
+}
+
+int os_file_writer_flush(OS_FileWriter* writer)
+{
+	if (writer->used > 0)
+	{
+		if (os_file_stream_write(writer->file, writer->buffer, writer->used) != OS_OK)
+			writer->error = 1;
+		writer->used = 0;
+	}
+	return (writer->error) ? OS_ERROR : OS_OK;
+}
+
+int os_file_writer_write(OS_FileWriter* writer, const void* mem, uint32_t size)
+{
+	if (size > writer->capacity - writer->used)
+	{
+		os_file_writer_flush(writer);
+		// Too big to be worth copying
+		if (size >= writer->capacity)
+		{
+			if (os_file_stream_write(writer->file, mem, size) != OS_OK)
+				writer->error = 1;
+			return (writer->error) ? OS_ERROR : OS_OK;
+		}
+	}
+	memcpy(writer->buffer + writer->used, mem, size);
+	writer->used += size;
+	return (writer->error) ? OS_ERROR : OS_OK;
+}
+
+int os_file_writer_close(OS_FileWriter* writer)
+{
+	int result = os_file_writer_flush(writer);
+	os_file_stream_close(writer->file);
+	free(writer->buffer);
+	free(writer);
+	return result;
+}
+
+/* Profiling */
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define OS_THREAD_LOCAL __declspec(thread)
+#else
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#define OS_THREAD_LOCAL __thread
+#endif
+
+#define OS_PROFILE_NO_ZONE 0xffffffff
+
+typedef struct {
+	const char* name;
+	uint64_t    start;
+	uint64_t    ticks;
+} OS_ProfileEvent;
+
+typedef struct {
+	const char* name;
+	uint32_t    zone;
+	uint64_t    start;
+	uint64_t    child_ticks;
+} OS_ProfileOpenZone;
+
+typedef struct {
+	OS_ProfileZone     zones[OS_PROFILE_MAX_ZONES];        /* open addressing on the name pointer */
+	uint32_t           zone_depth[OS_PROFILE_MAX_ZONES];   /* how many times each zone is open, for recursion */
+	OS_ProfileOpenZone stack[OS_PROFILE_MAX_DEPTH];
+	uint32_t           depth;
+	uint32_t           overflow;                           /* zones begun past OS_PROFILE_MAX_DEPTH */
+	uint32_t           thread_index;
+	uint32_t           in_use;                             /* 0 once the thread using it exited */
+	uint64_t           event_count;
+	OS_ProfileEvent    events[OS_PROFILE_RING_SIZE];
+} OS_ProfileThread;
+
+static OS_ProfileThread* os_profile_threads[OS_PROFILE_MAX_THREADS];
+static uint32_t os_profile_thread_count;
+static double os_profile_rate;
+static OS_THREAD_LOCAL OS_ProfileThread* os_profile_thread;
+static OS_THREAD_LOCAL int os_profile_disabled;
+
+uint64_t os_profile_ticks()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return (uint64_t)os_time_ns();
+#endif
+}
+
+double os_profile_ticks_per_us()
+{
+	if (os_profile_rate == 0.0)
+	{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+		double start_us, elapsed_us;
+		uint64_t start_ticks;
+		os_time_init();
+		start_us = os_time_us();
+		start_ticks = __rdtsc();
+		do {
+			elapsed_us = os_time_us() - start_us;
+		} while (elapsed_us < 10000.0);
+		os_profile_rate = (double)(__rdtsc() - start_ticks) / elapsed_us;
+#else
+		os_profile_rate = 1000.0;
+#endif
+	}
+	return os_profile_rate;
+}
+
+static void os_profile_thread_exit(void* state)
+{
+#if defined(_MSC_VER)
+	_InterlockedExchange((long volatile*)&((OS_ProfileThread*)state)->in_use, 0);
+#else
+	__atomic_store_n(&((OS_ProfileThread*)state)->in_use, 0, __ATOMIC_RELEASE);
+#endif
+}
+
+// Takes over the state of a thread that exited, it keeps its totals and events
+static OS_ProfileThread* os_profile_thread_reuse()
+{
+	uint32_t thread_count = (os_profile_thread_count < OS_PROFILE_MAX_THREADS) ? os_profile_thread_count : OS_PROFILE_MAX_THREADS;
+	for (uint32_t t = 0; t < thread_count; ++t)
+	{
+#if defined(_MSC_VER)
+		OS_ProfileThread* thread = (OS_ProfileThread*)_InterlockedCompareExchangePointer((void* volatile*)&os_profile_threads[t], 0, 0);
+		if (thread && _InterlockedCompareExchange((long volatile*)&thread->in_use, 1, 0) == 0)
+#else
+		OS_ProfileThread* thread = __atomic_load_n(&os_profile_threads[t], __ATOMIC_ACQUIRE);
+		uint32_t free_slot = 0;
+		if (thread && __atomic_compare_exchange_n(&thread->in_use, &free_slot, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+#endif
+		{
+			// The thread may have exited inside zones
+			memset(thread->zone_depth, 0, sizeof(thread->zone_depth));
+			thread->depth = 0;
+			thread->overflow = 0;
+			return thread;
+		}
+	}
+	return 0;
+}
+
+static OS_ProfileThread* os_profile_thread_get()
+{
+	OS_ProfileThread* thread;
+	uint32_t index;
+	if (os_profile_thread || os_profile_disabled)
+		return os_profile_thread;
+
+	thread = os_profile_thread_reuse();
+	if (!thread)
+	{
+#if defined(_MSC_VER)
+		index = (uint32_t)_InterlockedIncrement((long volatile*)&os_profile_thread_count) - 1;
+#else
+		index = __atomic_fetch_add(&os_profile_thread_count, 1, __ATOMIC_ACQ_REL);
+#endif
+		if (index >= OS_PROFILE_MAX_THREADS || !(thread = (OS_ProfileThread*)calloc(1, sizeof(OS_ProfileThread))))
+		{
+			os_profile_disabled = 1;
+			return 0;
+		}
+		thread->thread_index = index;
+		thread->in_use = 1;
+#if defined(_MSC_VER)
+		_InterlockedExchangePointer((void* volatile*)&os_profile_threads[index], thread);
+#else
+		__atomic_store_n(&os_profile_threads[index], thread, __ATOMIC_RELEASE);
+#endif
+	}
+	os_profile_thread = thread;
+	os_profile_notify_exit(thread);
+	return thread;
+}
+
+static uint32_t os_profile_zone_index(OS_ProfileThread* thread, const char* name)
+{
+	uint32_t index = (uint32_t)((((uintptr_t)name) * 0x9E3779B97F4A7C15ull) >> 40) & (OS_PROFILE_MAX_ZONES - 1);
+	for (uint32_t i = 0; i < OS_PROFILE_MAX_ZONES; ++i)
+	{
+		OS_ProfileZone* zone = thread->zones + index;
+		if (zone->name == name)
+			return index;
+		if (!zone->name)
+		{
+			zone->name = name;
+			return index;
+		}
+		index = (index + 1) & (OS_PROFILE_MAX_ZONES - 1);
+	}
+	return OS_PROFILE_NO_ZONE;
+}
+
+void os_profile_begin(const char* name)
+{
+	OS_ProfileThread* thread = os_profile_thread_get();
+	OS_ProfileOpenZone* open;
+	if (!thread)
+		return;
+	if (thread->depth == OS_PROFILE_MAX_DEPTH)
+	{
+		thread->overflow++;
+		return;
+	}
+
+	open = thread->stack + thread->depth++;
+	open->name = name;
+	open->zone = os_profile_zone_index(thread, name);
+	open->child_ticks = 0;
+	if (open->zone != OS_PROFILE_NO_ZONE)
+		thread->zone_depth[open->zone]++;
+	// Read the counter last so the bookkeeping above is not part of the zone
+	open->start = os_profile_ticks();
+}
+
+void os_profile_end()
+{
+	uint64_t end = os_profile_ticks();
+	OS_ProfileThread* thread = os_profile_thread;
+	OS_ProfileOpenZone* open;
+	OS_ProfileEvent* event;
+	uint64_t elapsed;
+
+	if (!thread || (thread->overflow == 0 && thread->depth == 0))
+		return;
+	if (thread->overflow > 0)
+	{
+		thread->overflow--;
+		return;
+	}
+
+	open = thread->stack + --thread->depth;
+	elapsed = end - open->start;
+	if (open->zone != OS_PROFILE_NO_ZONE)
+	{
+		OS_ProfileZone* zone = thread->zones + open->zone;
+		zone->hit_count++;
+		zone->self_ticks += elapsed - open->child_ticks;
+		if (--thread->zone_depth[open->zone] == 0)
+			zone->inclusive_ticks += elapsed;
+	}
+	if (thread->depth > 0)
+		thread->stack[thread->depth - 1].child_ticks += elapsed;
+
+	event = thread->events + (thread->event_count++ & (OS_PROFILE_RING_SIZE - 1));
+	event->name = open->name;
+	event->start = open->start;
+	event->ticks = elapsed;
+}
+
+uint32_t os_profile_zones(OS_ProfileZone* out_zones, uint32_t max_count)
+{
+	uint32_t count = 0;
+	uint32_t thread_count = (os_profile_thread_count < OS_PROFILE_MAX_THREADS) ? os_profile_thread_count : OS_PROFILE_MAX_THREADS;
+	for (uint32_t t = 0; t < thread_count; ++t)
+	{
+		OS_ProfileThread* thread = os_profile_threads[t];
+		if (!thread)
+			continue;
+		for (uint32_t z = 0; z < OS_PROFILE_MAX_ZONES; ++z)
+		{
+			OS_ProfileZone* zone = thread->zones + z;
+			uint32_t i = 0;
+			if (!zone->name)
+				continue;
+
+			// The same literal may have a different address in each compilation unit
+			while (i < count && strcmp(out_zones[i].name, zone->name) != 0)
+				++i;
+			if (i == count)
+			{
+				if (count == max_count)
+					continue;
+				memset(out_zones + count, 0, sizeof(OS_ProfileZone));
+				out_zones[count++].name = zone->name;
+			}
+			out_zones[i].hit_count += zone->hit_count;
+			out_zones[i].inclusive_ticks += zone->inclusive_ticks;
+			out_zones[i].self_ticks += zone->self_ticks;
+		}
+	}
+	return count;
+}
+
+// Copies 'name' escaped for a JSON string to 'out', cut short to fit 'size' bytes without
+// splitting a utf8 sequence
+static void os_profile_json_escape(char* out, size_t size, const char* name)
+{
+	size_t n = 0;
+	for (; *name; ++name)
+	{
+		unsigned char c = (unsigned char)*name;
+		if (c == '"' || c == '\\')
+		{
+			if (n + 2 >= size) break;
+			out[n++] = '\\';
+			out[n++] = (char)c;
+		}
+		else if (c < 0x20)
+		{
+			if (n + 6 >= size) break;
+			n += (size_t)snprintf(out + n, 7, "\\u%04x", c);
+		}
+		else
+		{
+			if (n + 1 >= size) break;
+			out[n++] = (char)c;
+		}
+	}
+	if (*name)
+	{
+		while (n > 0 && ((unsigned char)out[n - 1] & 0xC0) == 0x80)
+			n--;
+		if (n > 0 && (unsigned char)out[n - 1] >= 0xC0)
+			n--;
+	}
+	out[n] = 0;
+}
+
+int os_profile_export_chrome(const char* filename)
+{
+	double rate = os_profile_ticks_per_us();
+	uint64_t epoch = UINT64_MAX;
+	uint32_t thread_count = (os_profile_thread_count < OS_PROFILE_MAX_THREADS) ? os_profile_thread_count : OS_PROFILE_MAX_THREADS;
+	const char* separator = "";
+	char line[512];
+	char name[400];
+	int length;
+	OS_FileWriter* writer = os_file_writer_open(filename, 1 << 16, 0);
+	if (!writer)
+		return OS_ERROR;
+
+	// Timestamps start at the earliest recorded zone
+	for (uint32_t t = 0; t < thread_count; ++t)
+	{
+		OS_ProfileThread* thread = os_profile_threads[t];
+		uint64_t first = (thread && thread->event_count > OS_PROFILE_RING_SIZE) ? thread->event_count - OS_PROFILE_RING_SIZE : 0;
+		for (uint64_t e = first; thread && e < thread->event_count; ++e)
+		{
+			uint64_t start = thread->events[e & (OS_PROFILE_RING_SIZE - 1)].start;
+			if (start < epoch) epoch = start;
+		}
+	}
+
+	os_file_writer_write(writer, "{\"traceEvents\":[", 16);
+	for (uint32_t t = 0; t < thread_count; ++t)
+	{
+		OS_ProfileThread* thread = os_profile_threads[t];
+		uint64_t first = (thread && thread->event_count > OS_PROFILE_RING_SIZE) ? thread->event_count - OS_PROFILE_RING_SIZE : 0;
+		for (uint64_t e = first; thread && e < thread->event_count; ++e)
+		{
+			OS_ProfileEvent* event = thread->events + (e & (OS_PROFILE_RING_SIZE - 1));
+			os_profile_json_escape(name, sizeof(name), event->name);
+			length = snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				separator, name, thread->thread_index, (double)(event->start - epoch) / rate, (double)event->ticks / rate);
+			os_file_writer_write(writer, line, (uint32_t)length);
+			separator = ",";
+		}
+	}
+	os_file_writer_write(writer, "\n]}\n", 4);
+	return os_file_writer_close(writer);
+}
+
+void os_profile_reset()
+{
+	uint32_t thread_count = (os_profile_thread_count < OS_PROFILE_MAX_THREADS) ? os_profile_thread_count : OS_PROFILE_MAX_THREADS;
+	for (uint32_t t = 0; t < thread_count; ++t)
+	{
+		OS_ProfileThread* thread = os_profile_threads[t];
+		if (!thread)
+			continue;
+		memset(thread->zones, 0, sizeof(thread->zones));
+		memset(thread->zone_depth, 0, sizeof(thread->zone_depth));
+		thread->depth = 0;
+		thread->overflow = 0;
+		thread->event_count = 0;
+	}
+}
+
+/* Task scheduler */
+#if defined(_MSC_VER)
+#define os_atomic_load(p)          (*(volatile int64_t*)(p))
+#define os_atomic_store(p, v)      (*(volatile int64_t*)(p) = (v))
+#define os_relaxed_load(p)         (*(p))
+#define os_relaxed_store(p, v)     (*(p) = (v))
+#define os_atomic_add(p, v)        (_InterlockedExchangeAdd64((volatile long long*)(p), (v)) + (v))
+#define os_atomic_cas(p, e, d)     (_InterlockedCompareExchange64((volatile long long*)(p), (d), (e)) == (e))
+#define os_atomic_fence()          MemoryBarrier()
+#define os_cpu_pause()             _mm_pause()
+#else
+#define os_atomic_load(p)          __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define os_atomic_store(p, v)      __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define os_relaxed_load(p)         __atomic_load_n((p), __ATOMIC_RELAXED)
+#define os_relaxed_store(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define os_atomic_add(p, v)        __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define os_atomic_cas(p, e, d)     os_atomic_cas_i64((p), (e), (d))
+#define os_atomic_fence()          __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#if defined(__x86_64__) || defined(__i386__)
+#define os_cpu_pause()             _mm_pause()
+#else
+#define os_cpu_pause()
+#endif
+static int os_atomic_cas_i64(int64_t* p, int64_t expected, int64_t desired)
+{
+	return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+#endif
+
+/* Task ranges are only used by os_parallel_for */
+typedef struct {
+	OS_TaskProc   proc;
+	void*         data;
+	OS_TaskGroup* group;
+	uint64_t      start;
+	uint64_t      end;
+} OS_Task;
+
+typedef struct {
+	OS_ParallelForProc proc;
+	void*              data;
+	uint64_t           grain;
+} OS_ParallelFor;
+
+/* Chase-Lev deque, the owner pushes and pops at the bottom and thieves take from the top.
+   Task fields are read atomically because a thief may read a slot the owner is reusing,
+   the read is thrown away when its compare and swap on 'top' fails. */
+typedef struct {
+	int64_t top;
+	char    padding0[64 - sizeof(int64_t)];
+	int64_t bottom;
+	char    padding1[64 - sizeof(int64_t)];
+	OS_Task tasks[OS_SCHEDULER_DEQUE_SIZE];
+} OS_TaskDeque;
+
+typedef struct {
+	OS_TaskDeque   deque;
+	OS_Scheduler*  scheduler;
+	OS_Thread      thread;
+	uint32_t       index;
+	uint32_t       random;
+} OS_SchedulerWorker;
+
+struct OS_Scheduler_t {
+	OS_SchedulerWorker* workers;
+	uint32_t            worker_count;
+	uint32_t            thread_count;  /* workers whose thread started, the deques of the others stay empty */
+	uint32_t            flags;
+	int64_t             epoch;     /* incremented after every spawn, sleeping workers wait for it to change */
+	int64_t             sleeping;
+	int64_t             waiting;   /* threads sleeping in os_task_wait, woken when a group is done */
+	int64_t             stop;
+	OS_Sleeper          sleeper;   /* also protects the injected tasks */
+	OS_Task*            injected;  /* tasks spawned by threads that are not workers */
+	int64_t             injected_count;
+	uint64_t            injected_capacity;
+};
+
+static OS_THREAD_LOCAL OS_SchedulerWorker* os_scheduler_worker;
+
+static void os_task_write(OS_Task* slot, OS_Task* task)
+{
+	os_relaxed_store(&slot->proc, task->proc);
+	os_relaxed_store(&slot->data, task->data);
+	os_relaxed_store(&slot->group, task->group);
+	os_relaxed_store(&slot->start, task->start);
+	os_relaxed_store(&slot->end, task->end);
+}
+
+static void os_task_read(OS_Task* slot, OS_Task* task)
+{
+	task->proc = os_relaxed_load(&slot->proc);
+	task->data = os_relaxed_load(&slot->data);
+	task->group = os_relaxed_load(&slot->group);
+	task->start = os_relaxed_load(&slot->start);
+	task->end = os_relaxed_load(&slot->end);
+}
+
+static int os_deque_push(OS_TaskDeque* deque, OS_Task* task)
+{
+	int64_t bottom = deque->bottom;
+	int64_t top = os_atomic_load(&deque->top);
+	if (bottom - top >= OS_SCHEDULER_DEQUE_SIZE)
+		return OS_ERROR;
+	os_task_write(deque->tasks + (bottom & (OS_SCHEDULER_DEQUE_SIZE - 1)), task);
+	os_atomic_store(&deque->bottom, bottom + 1);
+	return OS_OK;
+}
+
+static int os_deque_pop(OS_TaskDeque* deque, OS_Task* task)
+{
+	int64_t bottom = deque->bottom - 1;
+	int64_t top;
+	int result = OS_OK;
+
+	os_atomic_store(&deque->bottom, bottom);
+	os_atomic_fence();
+	top = os_atomic_load(&deque->top);
+	if (top > bottom)
+	{
+		os_atomic_store(&deque->bottom, bottom + 1);
+		return OS_ERROR;
+	}
+	os_task_read(deque->tasks + (bottom & (OS_SCHEDULER_DEQUE_SIZE - 1)), task);
+	if (top == bottom)
+	{
+		// Last task, race the thieves for it
+		if (!os_atomic_cas(&deque->top, top, top + 1))
+			result = OS_ERROR;
+		os_atomic_store(&deque->bottom, bottom + 1);
+	}
+	return result;
+}
+
+static int os_deque_steal(OS_TaskDeque* deque, OS_Task* task)
+{
+	int64_t top = os_atomic_load(&deque->top);
+	os_atomic_fence();
+	if (top >= os_atomic_load(&deque->bottom))
+		return OS_ERROR;
+	os_task_read(deque->tasks + (top & (OS_SCHEDULER_DEQUE_SIZE - 1)), task);
+	return os_atomic_cas(&deque->top, top, top + 1) ? OS_OK : OS_ERROR;
+}
+
+static int os_scheduler_find(OS_Scheduler* scheduler, OS_SchedulerWorker* worker, OS_Task* task)
+{
+	uint32_t start = 0;
+	if (worker)
+	{
+		if (os_deque_pop(&worker->deque, task) == OS_OK)
+			return OS_OK;
+		// xorshift to pick where to start stealing
+		worker->random ^= worker->random << 13;
+		worker->random ^= worker->random >> 17;
+		worker->random ^= worker->random << 5;
+		start = worker->random;
+	}
+	for (uint32_t i = 0; i < scheduler->worker_count; ++i)
+	{
+		OS_SchedulerWorker* victim = scheduler->workers + (start + i) % scheduler->worker_count;
+		if (victim != worker && os_deque_steal(&victim->deque, task) == OS_OK)
+			return OS_OK;
+	}
+
+	if (os_atomic_load(&scheduler->injected_count) > 0)
+	{
+		int result = OS_ERROR;
+		os_sleeper_lock(&scheduler->sleeper);
+		if (scheduler->injected_count > 0)
+		{
+			*task = scheduler->injected[scheduler->injected_count - 1];
+			os_atomic_store(&scheduler->injected_count, scheduler->injected_count - 1);
+			result = OS_OK;
+		}
+		os_sleeper_unlock(&scheduler->sleeper);
+		return result;
+	}
+	return OS_ERROR;
+}
+
+static void os_scheduler_push(OS_Scheduler* scheduler, OS_Task* task);
+
+static void os_task_run(OS_Scheduler* scheduler, OS_Task* task)
+{
+	if (task->proc)
+	{
+		task->proc(task->data);
+	}
+	else
+	{
+		// Keep half of the range and leave the other half to be stolen until it is small enough
+		OS_ParallelFor* parallel_for = (OS_ParallelFor*)task->data;
+		while (task->end - task->start > parallel_for->grain)
+		{
+			OS_Task half = *task;
+			half.start = task->start + (task->end - task->start) / 2;
+			task->end = half.start;
+			os_atomic_add(&task->group->pending, 1);
+			os_scheduler_push(scheduler, &half);
+		}
+		parallel_for->proc(parallel_for->data, task->start, task->end);
+	}
+	// Same handshake as the epoch, a thread going to sleep on the group sees it done or is counted
+	if (os_atomic_add(&task->group->pending, -1) == 0 && os_atomic_add(&scheduler->waiting, 0) > 0)
+	{
+		os_sleeper_lock(&scheduler->sleeper);
+		os_sleeper_wake_all(&scheduler->sleeper);
+		os_sleeper_unlock(&scheduler->sleeper);
+	}
+}
+
+static void os_scheduler_push(OS_Scheduler* scheduler, OS_Task* task)
+{
+	OS_SchedulerWorker* worker = os_scheduler_worker;
+	if (worker && worker->scheduler == scheduler)
+	{
+		if (os_deque_push(&worker->deque, task) != OS_OK)
+		{
+			os_task_run(scheduler, task);
+			return;
+		}
+	}
+	else
+	{
+		os_sleeper_lock(&scheduler->sleeper);
+		if ((uint64_t)scheduler->injected_count == scheduler->injected_capacity)
+		{
+			uint64_t capacity = (scheduler->injected_capacity) ? scheduler->injected_capacity * 2 : 64;
+			OS_Task* injected = (OS_Task*)realloc(scheduler->injected, capacity * sizeof(OS_Task));
+			if (!injected)
+			{
+				os_sleeper_unlock(&scheduler->sleeper);
+				os_task_run(scheduler, task);
+				return;
+			}
+			scheduler->injected = injected;
+			scheduler->injected_capacity = capacity;
+		}
+		scheduler->injected[scheduler->injected_count] = *task;
+		os_atomic_store(&scheduler->injected_count, scheduler->injected_count + 1);
+		os_sleeper_unlock(&scheduler->sleeper);
+	}
+
+	// A worker going to sleep either sees the new epoch or is counted in 'sleeping'
+	os_atomic_add(&scheduler->epoch, 1);
+	if (os_atomic_add(&scheduler->sleeping, 0) > 0)
+	{
+		os_sleeper_lock(&scheduler->sleeper);
+		os_sleeper_wake_all(&scheduler->sleeper);
+		os_sleeper_unlock(&scheduler->sleeper);
+	}
+}
+
+static void os_scheduler_run_worker(void* arg)
+{
+	OS_SchedulerWorker* worker = (OS_SchedulerWorker*)arg;
+	OS_Scheduler* scheduler = worker->scheduler;
+	os_scheduler_worker = worker;
+
+	while (!os_atomic_load(&scheduler->stop))
+	{
+		OS_Task task;
+		int64_t epoch = os_atomic_load(&scheduler->epoch);
+		if (os_scheduler_find(scheduler, worker, &task) == OS_OK)
+		{
+			os_task_run(scheduler, &task);
+			continue;
+		}
+		for (int i = 0; i < 64; ++i)
+			os_cpu_pause();
+		if (os_atomic_load(&scheduler->epoch) != epoch)
+			continue;
+
+		os_sleeper_lock(&scheduler->sleeper);
+		os_atomic_add(&scheduler->sleeping, 1);
+		while (os_atomic_add(&scheduler->epoch, 0) == epoch && !os_atomic_load(&scheduler->stop))
+			os_sleeper_wait(&scheduler->sleeper);
+		os_atomic_add(&scheduler->sleeping, -1);
+		os_sleeper_unlock(&scheduler->sleeper);
+	}
+}
+
+OS_Scheduler* os_scheduler_create(uint32_t thread_count, uint32_t flags)
+{
+	OS_Scheduler* scheduler = (OS_Scheduler*)calloc(1, sizeof(OS_Scheduler));
+	if (!scheduler)
+		return 0;
+	if (thread_count == 0)
+		thread_count = os_processor_count();
+
+	scheduler->workers = (OS_SchedulerWorker*)calloc(thread_count, sizeof(OS_SchedulerWorker));
+	if (!scheduler->workers)
+	{
+		free(scheduler);
+		return 0;
+	}
+	scheduler->flags = flags;
+	os_sleeper_init(&scheduler->sleeper);
+	for (uint32_t i = 0; i < thread_count; ++i)
+	{
+		scheduler->workers[i].scheduler = scheduler;
+		scheduler->workers[i].index = i;
+		scheduler->workers[i].random = 2463534242u + i * 7919u;
+	}
+
+	// Worker 0 is the calling thread
+	os_scheduler_worker = scheduler->workers;
+	scheduler->worker_count = thread_count;
+	scheduler->thread_count = 1;
+	if (flags & OS_SCHEDULER_PIN_THREADS)
+		os_thread_pin(os_thread_current(), 0);
+	for (uint32_t i = 1; i < thread_count; ++i, ++scheduler->thread_count)
+	{
+		if (os_thread_create(&scheduler->workers[i].thread, scheduler->workers + i) != OS_OK)
+			break;
+		if (flags & OS_SCHEDULER_PIN_THREADS)
+			os_thread_pin(scheduler->workers[i].thread, i);
+	}
+	return scheduler;
+}
+
+void os_scheduler_destroy(OS_Scheduler* scheduler)
+{
+	os_sleeper_lock(&scheduler->sleeper);
+	os_atomic_store(&scheduler->stop, 1);
+	os_sleeper_wake_all(&scheduler->sleeper);
+	os_sleeper_unlock(&scheduler->sleeper);
+	for (uint32_t i = 1; i < scheduler->thread_count; ++i)
+		os_thread_join(scheduler->workers[i].thread);
+
+	if (os_scheduler_worker && os_scheduler_worker->scheduler == scheduler)
+		os_scheduler_worker = 0;
+	os_sleeper_destroy(&scheduler->sleeper);
+	free(scheduler->injected);
+	free(scheduler->workers);
+	free(scheduler);
+}
+
+uint32_t os_scheduler_thread_count(OS_Scheduler* scheduler)
+{
+	return scheduler->thread_count;
+}
+
+void os_task_spawn(OS_Scheduler* scheduler, OS_TaskGroup* group, OS_TaskProc proc, void* data)
+{
+	OS_Task task;
+	task.proc = proc;
+	task.data = data;
+	task.group = group;
+	task.start = 0;
+	task.end = 0;
+	os_atomic_add(&group->pending, 1);
+	os_scheduler_push(scheduler, &task);
+}
+
+void os_task_wait(OS_Scheduler* scheduler, OS_TaskGroup* group)
+{
+	OS_SchedulerWorker* worker = os_scheduler_worker;
+	if (worker && worker->scheduler != scheduler)
+		worker = 0;
+
+	while (os_atomic_load(&group->pending) > 0)
+	{
+		OS_Task task;
+		int64_t epoch = os_atomic_load(&scheduler->epoch);
+		if (os_scheduler_find(scheduler, worker, &task) == OS_OK)
+		{
+			os_task_run(scheduler, &task);
+			continue;
+		}
+		for (int i = 0; i < 64; ++i)
+			os_cpu_pause();
+		if (os_atomic_load(&scheduler->epoch) != epoch || os_atomic_load(&group->pending) <= 0)
+			continue;
+
+		// Nothing to run, sleep until a task is spawned or the group is done
+		os_sleeper_lock(&scheduler->sleeper);
+		os_atomic_add(&scheduler->sleeping, 1);
+		os_atomic_add(&scheduler->waiting, 1);
+		while (os_atomic_add(&scheduler->epoch, 0) == epoch && os_atomic_add(&group->pending, 0) > 0)
+			os_sleeper_wait(&scheduler->sleeper);
+		os_atomic_add(&scheduler->waiting, -1);
+		os_atomic_add(&scheduler->sleeping, -1);
+		os_sleeper_unlock(&scheduler->sleeper);
+	}
+}
+
+void os_parallel_for(OS_Scheduler* scheduler, uint64_t start, uint64_t end, uint64_t grain, OS_ParallelForProc proc, void* data)
+{
+	OS_TaskGroup group = { 0 };
+	OS_ParallelFor parallel_for;
+	OS_Task task;
+	if (end <= start)
+		return;
+
+	parallel_for.proc = proc;
+	parallel_for.data = data;
+	// By default give every thread about 8 pieces to balance uneven work
+	parallel_for.grain = (grain) ? grain : (end - start) / ((uint64_t)scheduler->thread_count * 8);
+	if (parallel_for.grain == 0)
+		parallel_for.grain = 1;
+
+	task.proc = 0;
+	task.data = &parallel_for;
+	task.group = &group;
+	task.start = start;
+	task.end = end;
+	group.pending = 1;
+	os_task_run(scheduler, &task);
+	os_task_wait(scheduler, &group);
+}
+
+const char* os_file_name_from_path(const char* path)
+{
+	int sep_index = 0;
+	const char* at = path;
+	while (*at)
+	{
+		char c = *at;
+		if (c == '\\' || c == '/')
+			sep_index = (int)(at - path + 1);
+		at++;
+	}
+	return path + sep_index;
+}
+
+const char* os_file_extension(const char* filename)
+{
+	int dot_index = 0;
+	const char* at = filename;
+	while (*at)
+	{
+		char c = *at;
+		if (c == '.')
+			dot_index = (int)(at - filename + 1);
+		at++;
+	}
+	return filename + dot_index;
+}
 #endif
 
 #endif // HO_OS
@@ -41,8 +41,43 @@
 
         return 0;
     }
+
+    ----------------------------------------------------------------------------------
+
+    An arena created with liarena_create_chained(block_size_bytes) only reserves
+    'block_size_bytes' at a time and links a new block when the current one is
+    full, instead of failing. Allocations keep bumping a pointer inside the current
+    block, liarena_clear keeps the blocks around to be reused and liarena_trim
+    releases the ones not in use.
+
+    ----------------------------------------------------------------------------------
+
+    Define LIGHT_ARENA_STATISTICS to keep allocation counters in every arena
+    (bytes allocated, alignment padding, commits, trims, high water mark and a
+    histogram of allocation sizes), liarena_dump_statistics prints them.
+
+    ----------------------------------------------------------------------------------
+
+    Pools and slabs are layered over an existing arena and allow objects to be freed
+    individually, freed objects are kept in a free list and reused in O(1):
+
+    Light_Arena* arena = liarena_create();
+
+    // Pool of fixed size objects of 48 bytes aligned to 16 bytes.
+    Light_Pool* pool = liarena_pool_create(arena, 48, 16);
+    void* node = liarena_pool_alloc(pool);
+    liarena_pool_release(pool, node);
+
+    // Slab with power of two size classes from 8 to LIGHT_ARENA_SLAB_MAX_SIZE bytes.
+    Light_Slab* slab = liarena_slab_create(arena);
+    void* small = liarena_slab_alloc(slab, 24);
+    liarena_slab_release(slab, small, 24);   // The size must be the one used to allocate
+
+    // The pool and the slab live in the arena, they go away with it.
+    liarena_free(arena);
 */
 #include <stdint.h>
+#include <stddef.h>
 
 #ifndef LIGHT_ARENA_MAX_RESERVED_VIRTUAL_SPACE_GB
 #define LIGHT_ARENA_MAX_RESERVED_VIRTUAL_SPACE_GB 16
@@ -73,11 +108,39 @@
 
 #endif
 
+#ifdef LIGHT_ARENA_STATISTICS
+#include <stdio.h>
+#include <inttypes.h>
+
+/* Bucket i counts allocations with size in [2^i, 2^(i+1)), the last one counts everything bigger */
+#define LIGHT_ARENA_HISTOGRAM_BUCKETS 24
+#endif
+
+/* The arena links new reservations when its reserved space is exhausted */
+#define LIGHT_ARENA_CHAINED (1 << 0)
+
+/* Blocks of chained arenas are multiples of this size */
+#define LIGHT_ARENA_MIN_BLOCK_SIZE (64 * 1024)
+
 typedef struct Light_Arena_t {
     size_t capacity;    /* the current committed memory capacity of the arena */
     size_t reserved;    /* how much virtual address space is reserved to the arena */
     size_t page_size;   /* the page size of the system */
     void*  ptr;         /* pointer to the base memory of the arena */
+    size_t flags;       /* LIGHT_ARENA_CHAINED */
+    struct Light_Arena_t* current;  /* block where allocations are made, the arena itself unless chained */
+    struct Light_Arena_t* next;     /* next block of a chained arena */
+#ifdef LIGHT_ARENA_STATISTICS
+    uint64_t allocation_count;  /* number of allocations made */
+    uint64_t allocated_bytes;   /* total bytes requested, without alignment padding */
+    uint64_t padding_bytes;     /* bytes wasted in alignment padding */
+    uint64_t commit_count;      /* number of times new pages were committed */
+    uint64_t trim_count;        /* number of calls to liarena_trim */
+    uint64_t clear_count;       /* number of calls to liarena_clear */
+    uint64_t used_bytes;        /* bytes in use, what liarena_used would return */
+    uint64_t high_water_mark;   /* maximum number of bytes in use at any point */
+    uint64_t size_histogram[LIGHT_ARENA_HISTOGRAM_BUCKETS];
+#endif
 } Light_Arena;
 
 /* Create an arena with default LIGHT_ARENA_MAX_RESERVED_VIRTUAL_SPACE_GB Gigabytes of max space. */
@@ -86,6 +149,11 @@ Light_Arena* liarena_create(void);
 /* Create an arena with 'max_size_gb' Gigabytes of max space. */
 Light_Arena* liarena_create_custom(size_t max_size_gb);
 
+/* Create an arena that reserves 'block_size_bytes' bytes at a time. Once a block is full
+   a new one is reserved and linked to it, so the arena has no max space. Allocations bigger
+   than a block get a block of their own. */
+Light_Arena* liarena_create_chained(size_t block_size_bytes);
+
 /* Allocates 'size_bytes' bytes aligned to 8 bytes by default. */
 void* liarena_alloc(Light_Arena* arena, size_t size_bytes);
 
@@ -104,6 +172,75 @@ void* liarena_alloc_unaligned(Light_Arena* arena, size_t size_bytes);
 /* Allocates 'size_bytes' bytes unaligned to a specified custom alignment. */
 void* liarena_alloc_aligned(Light_Arena* arena, size_t size_bytes, size_t alignment);
 
+/* Returns how many bytes are currently allocated in the arena. */
+size_t liarena_used(Light_Arena* arena);
+
+#ifdef LIGHT_ARENA_STATISTICS
+/* Prints all the allocation counters of the arena to 'out'. */
+void liarena_dump_statistics(Light_Arena* arena, FILE* out);
+#endif
+
+/* ---------------------------------------------------------------------------------- */
+
+#ifndef LIGHT_ARENA_POOL_CHUNK_SIZE
+#define LIGHT_ARENA_POOL_CHUNK_SIZE 4096 /* bytes of objects a pool takes from its arena at a time */
+#endif
+
+typedef struct Light_Pool_t {
+    Light_Arena* arena;         /* arena where objects are allocated */
+    void*        free_list;     /* singly linked list of released objects */
+    size_t       object_size;   /* size of every object, rounded up to the alignment */
+    size_t       alignment;     /* alignment of every object */
+    void*        chunks;        /* chunks taken from the arena, each one starts with a link to the previous */
+    char*        next;          /* next object never handed out in the last chunk */
+    char*        end;           /* end of the last chunk */
+} Light_Pool;
+
+/* Initializes 'pool' to hand out objects of 'object_size' bytes aligned to 'alignment' bytes
+   allocated from 'arena'. The arena can be shared with other allocations, the pool takes
+   LIGHT_ARENA_POOL_CHUNK_SIZE bytes of objects (at least one object) from it at a time. */
+void liarena_pool_init(Light_Pool* pool, Light_Arena* arena, size_t object_size, size_t alignment);
+
+/* Same as liarena_pool_init, with the pool itself allocated from 'arena'.
+   Returns 0 when the arena is out of memory. */
+Light_Pool* liarena_pool_create(Light_Arena* arena, size_t object_size, size_t alignment);
+
+/* Allocates one object from the pool, reusing released objects first. */
+void* liarena_pool_alloc(Light_Pool* pool);
+
+/* Gives back 'object' to the pool so that it can be reused by the next allocation. */
+void  liarena_pool_release(Light_Pool* pool, void* object);
+
+/* Releases all the objects in the pool at once, its chunks stay in the arena for the next allocations. */
+void  liarena_pool_clear(Light_Pool* pool);
+
+#define LIGHT_ARENA_SLAB_MIN_SIZE 8
+#define LIGHT_ARENA_SLAB_MAX_SIZE 4096
+#define LIGHT_ARENA_SLAB_CLASS_COUNT 10 /* 8, 16, 32, ..., 4096 */
+
+typedef struct Light_Slab_t {
+    Light_Arena* arena;         /* arena where objects are allocated */
+    Light_Pool   classes[LIGHT_ARENA_SLAB_CLASS_COUNT];  /* one pool per size class */
+} Light_Slab;
+
+/* Initializes 'slab' to hand out objects in power of two size classes allocated from 'arena'.
+   The arena can be shared with other allocations. */
+void liarena_slab_init(Light_Slab* slab, Light_Arena* arena);
+
+/* Same as liarena_slab_init, with the slab itself allocated from 'arena'.
+   Returns 0 when the arena is out of memory. */
+Light_Slab* liarena_slab_create(Light_Arena* arena);
+
+/* Allocates 'size_bytes' bytes from the smallest size class that fits it, aligned to the
+   size class up to 16 bytes. Returns 0 when 'size_bytes' is larger than LIGHT_ARENA_SLAB_MAX_SIZE. */
+void* liarena_slab_alloc(Light_Slab* slab, size_t size_bytes);
+
+/* Gives back 'object' to the slab, 'size_bytes' must be the same size passed to liarena_slab_alloc. */
+void  liarena_slab_release(Light_Slab* slab, void* object, size_t size_bytes);
+
+/* Releases all the objects in the slab at once, like liarena_pool_clear for every size class. */
+void  liarena_slab_clear(Light_Slab* slab);
+
 #if defined(LIGHT_ARENA_IMPLEMENT)
 
 static size_t liarena_align_delta(char* offset, size_t align_to)
@@ -112,10 +249,9 @@ static size_t liarena_align_delta(char* offset, size_t align_to)
 }
 
 #if defined(_WIN32) || defined(_WIN64)
-Light_Arena* liarena_create_custom(size_t max_size_gb)
+static Light_Arena* liarena_reserve(size_t reserve_bytes)
 {
-    uint64_t gigabyte = 1024*1024*1024;
-    Light_Arena* arena = (Light_Arena*)VirtualAlloc(0, gigabyte * max_size_gb, MEM_RESERVE, PAGE_NOACCESS);
+    Light_Arena* arena = (Light_Arena*)VirtualAlloc(0, reserve_bytes, MEM_RESERVE, PAGE_NOACCESS);
         
     if(arena)
     {
@@ -133,12 +269,15 @@ Light_Arena* liarena_create_custom(size_t max_size_gb)
             arena->capacity = 2 * page_size;
             arena->ptr = (char*)arena + arena->page_size;
 
-            arena->reserved = gigabyte * LIGHT_ARENA_MAX_RESERVED_VIRTUAL_SPACE_GB;
+            arena->reserved = reserve_bytes;
+            arena->current = arena;
+            arena->next = 0;
+            arena->flags = 0;
         }
         else
         {
             // Could not allocate anything apparently, system is out of resources. Fail completely.
-            VirtualFree(arena, arena->reserved, MEM_RELEASE);
+            VirtualFree(arena, 0, MEM_RELEASE);
             arena = 0;
         }
     }
@@ -146,49 +285,34 @@ Light_Arena* liarena_create_custom(size_t max_size_gb)
     return arena;
 }
 
-void* liarena_alloc_unaligned(Light_Arena* arena, size_t size_bytes)
-{    
-    size_t allocated = (char*)arena->ptr - (char*)arena;
-    void* result = arena->ptr;
-
-    if(arena->capacity < (allocated + size_bytes))
-    {
-        size_t new_size = size_bytes + liarena_align_delta((char*)size_bytes, arena->page_size);
-        // Commit the new space
-        if(VirtualAlloc((char*)arena + arena->capacity, new_size, MEM_COMMIT, PAGE_READWRITE))
-            arena->capacity += new_size;
-        else
-            return 0; // Could not commit pages, out of memory!
-    }
-
-    arena->ptr = (char*)result + size_bytes;
-
-    return result;
+static int liarena_commit(Light_Arena* block, size_t size_bytes)
+{
+    return VirtualAlloc((char*)block + block->capacity, size_bytes, MEM_COMMIT, PAGE_READWRITE) != 0;
 }
 
-inline void liarena_free(Light_Arena* arena)
+static void liarena_decommit(Light_Arena* block, size_t keep_bytes)
 {
-    VirtualFree(arena, arena->reserved, MEM_RELEASE);
+    VirtualFree((char*)block + keep_bytes, block->capacity - keep_bytes, MEM_DECOMMIT);
 }
 
-inline void liarena_trim(Light_Arena* arena)
+static void liarena_release(Light_Arena* block)
 {
-    VirtualFree((char*)arena + arena->capacity, arena->reserved - arena->capacity, MEM_DECOMMIT);
+    VirtualFree(block, 0, MEM_RELEASE);
 }
 
 #elif defined(__linux__)
-Light_Arena* liarena_create_custom(size_t max_size_gb)
+static Light_Arena* liarena_reserve(size_t reserve_bytes)
 {
-    uint64_t gigabyte = 1024*1024*1024;
     int zerofile = open("/dev/zero", 0);
 
     Light_Arena* arena = 0;
 
-    if(zerofile != 0)
+    if(zerofile != -1)
     {
-        arena = (Light_Arena*)mmap(0, gigabyte * max_size_gb, PROT_NONE, MAP_PRIVATE, zerofile, 0);
+        arena = (Light_Arena*)mmap(0, reserve_bytes, PROT_NONE, MAP_PRIVATE, zerofile, 0);
+        close(zerofile);
             
-        if(arena)
+        if(arena != MAP_FAILED)
         {
             size_t page_size = getpagesize(); 
 
@@ -201,73 +325,449 @@ Light_Arena* liarena_create_custom(size_t max_size_gb)
                 arena->capacity = 2 * page_size;
                 arena->ptr = (char*)arena + arena->page_size;
 
-                arena->reserved = gigabyte * LIGHT_ARENA_MAX_RESERVED_VIRTUAL_SPACE_GB;
+                arena->reserved = reserve_bytes;
+                arena->current = arena;
+                arena->next = 0;
+                arena->flags = 0;
             }
             else
             {
                 // Could not allocate anything apparently, system is out of resources. Fail completely.
-                munmap(arena, arena->reserved);
+                munmap(arena, reserve_bytes);
                 arena = 0;
             }
         }
+        else
+        {
+            arena = 0;
+        }
     }
 
     return arena;
 }
 
+static int liarena_commit(Light_Arena* block, size_t size_bytes)
+{
+    return mprotect((char*)block + block->capacity, size_bytes, PROT_READ|PROT_WRITE) == 0;
+}
+
+static void liarena_decommit(Light_Arena* block, size_t keep_bytes)
+{
+    mmap((char*)block + keep_bytes, block->capacity - keep_bytes, PROT_NONE, MAP_FIXED|MAP_PRIVATE|MAP_ANON, -1, 0);
+    msync((char*)block + keep_bytes, block->capacity - keep_bytes, MS_SYNC|MS_INVALIDATE);
+}
+
+static void liarena_release(Light_Arena* block)
+{
+    munmap(block, block->reserved);
+}
+#endif
+
+Light_Arena* liarena_create_custom(size_t max_size_gb)
+{
+    uint64_t gigabyte = 1024*1024*1024;
+    return liarena_reserve(gigabyte * max_size_gb);
+}
+
+Light_Arena* liarena_create(void)
+{
+    return liarena_create_custom(LIGHT_ARENA_MAX_RESERVED_VIRTUAL_SPACE_GB);
+}
+
+Light_Arena* liarena_create_chained(size_t block_size_bytes)
+{
+    Light_Arena* arena = 0;
+
+    // Round up to 64KB, a multiple of the page size and of the allocation granularity on Windows
+    if(block_size_bytes < LIGHT_ARENA_MIN_BLOCK_SIZE)
+        block_size_bytes = LIGHT_ARENA_MIN_BLOCK_SIZE;
+    block_size_bytes += liarena_align_delta((char*)block_size_bytes, LIGHT_ARENA_MIN_BLOCK_SIZE);
+
+    arena = liarena_reserve(block_size_bytes);
+    if(arena)
+        arena->flags |= LIGHT_ARENA_CHAINED;
+
+    return arena;
+}
+
+size_t liarena_used(Light_Arena* arena)
+{
+    Light_Arena* block = arena;
+    size_t used = 0;
+
+    for(;;)
+    {
+        used += (char*)block->ptr - (char*)block - block->page_size;
+        if(block == arena->current) break;
+        block = block->next;
+    }
+    return used;
+}
+
+#ifdef LIGHT_ARENA_STATISTICS
+/* 'size_bytes' is what was asked for, 'bumped_bytes' how far the arena moved including alignment padding */
+static void liarena_statistics_alloc(Light_Arena* arena, size_t size_bytes, size_t bumped_bytes)
+{
+    size_t bucket = 0;
+
+    while((bucket + 1) < LIGHT_ARENA_HISTOGRAM_BUCKETS && ((size_t)2 << bucket) <= size_bytes)
+        bucket++;
+
+    arena->allocation_count++;
+    arena->allocated_bytes += size_bytes;
+    arena->padding_bytes += bumped_bytes - size_bytes;
+    arena->size_histogram[bucket]++;
+
+    // A new block starts where the allocation starts, so this is exactly what liarena_used grows by
+    arena->used_bytes += bumped_bytes;
+    if(arena->used_bytes > arena->high_water_mark)
+        arena->high_water_mark = arena->used_bytes;
+}
+#endif
+
+// Moves the allocations of a chained arena to the block after the current one,
+// reusing the blocks kept by liarena_clear or reserving a new one big enough.
+static Light_Arena* liarena_next_block(Light_Arena* arena, size_t size_bytes)
+{
+    Light_Arena* block = arena->current;
+    Light_Arena* next = block->next;
+    size_t needed = block->page_size + size_bytes;
+
+    if(!next || next->reserved < needed)
+    {
+        size_t reserve_bytes = arena->reserved;
+        if(reserve_bytes < needed)
+            reserve_bytes = needed + liarena_align_delta((char*)needed, block->page_size);
+
+        next = liarena_reserve(reserve_bytes);
+        if(!next) return 0;
+
+        next->next = block->next;
+        block->next = next;
+    }
+
+    next->ptr = (char*)next + next->page_size;
+    arena->current = next;
+
+    return next;
+}
+
+static void* liarena_bump(Light_Arena* arena, size_t size_bytes)
+{
+    Light_Arena* block = arena->current;
+    size_t allocated = (char*)block->ptr - (char*)block;
+    void* result = block->ptr;
+
+    if(block->capacity < (allocated + size_bytes))
+    {
+        if(block->reserved < (allocated + size_bytes))
+        {
+            // The reserved space is exhausted, only chained arenas can continue in a new block
+            if(!(arena->flags & LIGHT_ARENA_CHAINED))
+                return 0;
+            block = liarena_next_block(arena, size_bytes);
+            if(!block)
+                return 0;
+            allocated = (char*)block->ptr - (char*)block;
+            result = block->ptr;
+        }
+
+        if(block->capacity < (allocated + size_bytes))
+        {
+            size_t new_size = size_bytes + liarena_align_delta((char*)size_bytes, block->page_size);
+            if(block->capacity + new_size > block->reserved)
+                new_size = block->reserved - block->capacity;
+
+            // Commit the new space
+            if(liarena_commit(block, new_size))
+                block->capacity += new_size;
+            else
+                return 0; // Could not commit pages, out of memory!
+#ifdef LIGHT_ARENA_STATISTICS
+            arena->commit_count++;
+#endif
+        }
+    }
+
+    block->ptr = (char*)result + size_bytes;
+
+    return result;
+}
+
 void* liarena_alloc_unaligned(Light_Arena* arena, size_t size_bytes)
 {    
-    size_t allocated = (char*)arena->ptr - (char*)arena;
-    void* result = arena->ptr;
+    void* result = liarena_bump(arena, size_bytes);
+#ifdef LIGHT_ARENA_STATISTICS
+    if(result) liarena_statistics_alloc(arena, size_bytes, size_bytes);
+#endif
+    return result;
+}
+
+void liarena_free(Light_Arena* arena)
+{
+    while(arena)
+    {
+        Light_Arena* next = arena->next;
+        liarena_release(arena);
+        arena = next;
+    }
+}
+
+void liarena_trim(Light_Arena* arena)
+{
+    Light_Arena* block = arena;
+    Light_Arena* unused = arena->current->next;
+
+#ifdef LIGHT_ARENA_STATISTICS
+    arena->trim_count++;
+#endif
+
+    // Blocks after the current one are not in use, give them back entirely
+    arena->current->next = 0;
+    liarena_free(unused);
+
+    for(;;)
+    {
+        size_t used = (char*)block->ptr - (char*)block;
+        size_t keep = used + liarena_align_delta((char*)used, block->page_size);
+        if(keep < block->capacity)
+        {
+            liarena_decommit(block, keep);
+            block->capacity = keep;
+        }
+        if(block == arena->current) break;
+        block = block->next;
+    }
+}
+
+void* liarena_alloc_aligned(Light_Arena* arena, size_t size_bytes, size_t alignment)
+{    
+    Light_Arena* block = arena->current;
+    size_t allocated = (char*)block->ptr - (char*)block;
+    size_t extra_size = liarena_align_delta((char*)block->ptr, alignment);
+    char* result;
+
+    // An allocation that does not fit the current block starts a new one, where the delta is not known yet
+    if(block->reserved < (allocated + size_bytes + extra_size))
+        extra_size = alignment - 1;
+
+    result = (char*)liarena_bump(arena, size_bytes + extra_size);
+    if(!result) return 0;
+#ifdef LIGHT_ARENA_STATISTICS
+    liarena_statistics_alloc(arena, size_bytes, size_bytes + extra_size);
+#endif
+    return result + liarena_align_delta(result, alignment);
+}
+
+void* liarena_alloc(Light_Arena* arena, size_t size_bytes)
+{
+    // Align to 8 bytes, a new block always starts 8 byte aligned
+    size_t extra_size = ((8 - ((size_t)(arena->current->ptr) & 0x7)) & 0x7);
+    char* result = (char*)liarena_bump(arena, size_bytes + extra_size);
+    if(!result) return 0;
+#ifdef LIGHT_ARENA_STATISTICS
+    liarena_statistics_alloc(arena, size_bytes, size_bytes + extra_size);
+#endif
+    return result + ((8 - ((size_t)result & 0x7)) & 0x7);
+}
+
+void liarena_clear(Light_Arena* arena)
+{
+#ifdef LIGHT_ARENA_STATISTICS
+    arena->clear_count++;
+    arena->used_bytes = 0;
+#endif
+    // Blocks of a chained arena are kept and reused by the next allocations
+    arena->current = arena;
+    arena->ptr = (char*)arena + arena->page_size;
+}
+
+#ifdef LIGHT_ARENA_STATISTICS
+void liarena_dump_statistics(Light_Arena* arena, FILE* out)
+{
+    Light_Arena* block = arena;
+    size_t committed = 0;
+    size_t reserved = 0;
+    size_t block_count = 0;
+    size_t i;
+
+    for(; block; block = block->next)
+    {
+        committed += block->capacity;
+        reserved += block->reserved;
+        block_count++;
+    }
 
-    if(arena->capacity < (allocated + size_bytes))
+    fprintf(out, "used:             %" PRIu64 " bytes\n", (uint64_t)liarena_used(arena));
+    fprintf(out, "committed:        %" PRIu64 " bytes\n", (uint64_t)committed);
+    fprintf(out, "reserved:         %" PRIu64 " bytes\n", (uint64_t)reserved);
+    fprintf(out, "blocks:           %" PRIu64 "\n", (uint64_t)block_count);
+    fprintf(out, "high water mark:  %" PRIu64 " bytes\n", arena->high_water_mark);
+    fprintf(out, "allocations:      %" PRIu64 "\n", arena->allocation_count);
+    fprintf(out, "allocated:        %" PRIu64 " bytes\n", arena->allocated_bytes);
+    fprintf(out, "padding:          %" PRIu64 " bytes\n", arena->padding_bytes);
+    fprintf(out, "commits:          %" PRIu64 "\n", arena->commit_count);
+    fprintf(out, "trims:            %" PRIu64 "\n", arena->trim_count);
+    fprintf(out, "clears:           %" PRIu64 "\n", arena->clear_count);
+    fprintf(out, "allocation sizes:\n");
+    for(i = 0; i < LIGHT_ARENA_HISTOGRAM_BUCKETS; ++i)
     {
-        size_t new_size = size_bytes + liarena_align_delta((char*)size_bytes, arena->page_size);
-        // Commit the new space
-        if(mprotect((char*)arena + arena->capacity, new_size, PROT_READ|PROT_WRITE) == 0)
-            arena->capacity += new_size;
+        if(arena->size_histogram[i] == 0) continue;
+        if(i + 1 == LIGHT_ARENA_HISTOGRAM_BUCKETS)
+            fprintf(out, "  >= %" PRIu64 ": %" PRIu64 "\n", (uint64_t)1 << i, arena->size_histogram[i]);
         else
-            return 0; // Could not commit pages, out of memory!
+            fprintf(out, "  [%" PRIu64 ", %" PRIu64 "): %" PRIu64 "\n", (i == 0) ? (uint64_t)0 : ((uint64_t)1 << i), (uint64_t)2 << i, arena->size_histogram[i]);
     }
+}
+#endif
+
+void liarena_pool_init(Light_Pool* pool, Light_Arena* arena, size_t object_size, size_t alignment)
+{
+    // Released objects store the free list link in place
+    if(alignment < sizeof(void*)) alignment = sizeof(void*);
+    if(object_size < sizeof(void*)) object_size = sizeof(void*);
+
+    pool->arena = arena;
+    pool->free_list = 0;
+    pool->alignment = alignment;
+    // Round up so that objects allocated one after the other stay aligned
+    pool->object_size = object_size + liarena_align_delta((char*)object_size, alignment);
+    pool->chunks = 0;
+    pool->next = 0;
+    pool->end = 0;
+}
+
+Light_Pool* liarena_pool_create(Light_Arena* arena, size_t object_size, size_t alignment)
+{
+    Light_Pool* pool = (Light_Pool*)liarena_alloc(arena, sizeof(Light_Pool));
+
+    if(pool)
+        liarena_pool_init(pool, arena, object_size, alignment);
+
+    return pool;
+}
 
-    arena->ptr = (char*)result + size_bytes;
+// The objects of a chunk start after its link, at the pool alignment
+static size_t liarena_pool_chunk_header(Light_Pool* pool)
+{
+    return sizeof(void*) + liarena_align_delta((char*)sizeof(void*), pool->alignment);
+}
+
+static size_t liarena_pool_chunk_bytes(Light_Pool* pool)
+{
+    size_t count = LIGHT_ARENA_POOL_CHUNK_SIZE / pool->object_size;
+    return ((count > 0) ? count : 1) * pool->object_size;
+}
+
+void* liarena_pool_alloc(Light_Pool* pool)
+{
+    void* result = pool->free_list;
+
+    if(result)
+    {
+        pool->free_list = *(void**)result;
+        return result;
+    }
+
+    if(pool->end - pool->next < (ptrdiff_t)pool->object_size)
+    {
+        // Chunks are linked so that liarena_pool_clear finds every object the pool handed out
+        size_t bytes = liarena_pool_chunk_bytes(pool);
+        void* chunk = liarena_alloc_aligned(pool->arena, liarena_pool_chunk_header(pool) + bytes, pool->alignment);
+        if(!chunk)
+            return 0;
+        *(void**)chunk = pool->chunks;
+        pool->chunks = chunk;
+        pool->next = (char*)chunk + liarena_pool_chunk_header(pool);
+        pool->end = pool->next + bytes;
+    }
 
+    result = pool->next;
+    pool->next += pool->object_size;
     return result;
 }
 
-inline void liarena_free(Light_Arena* arena)
+void liarena_pool_release(Light_Pool* pool, void* object)
 {
-    munmap(arena, arena->reserved);
+    *(void**)object = pool->free_list;
+    pool->free_list = object;
 }
 
-inline void liarena_trim(Light_Arena* arena)
+void liarena_pool_clear(Light_Pool* pool)
 {
-    mmap((char*)arena + arena->capacity, arena->reserved - arena->capacity, PROT_NONE, MAP_FIXED|MAP_PRIVATE|MAP_ANON, -1, 0);
-    msync((char*)arena + arena->capacity, arena->reserved - arena->capacity, MS_SYNC|MS_INVALIDATE);
+    size_t bytes = liarena_pool_chunk_bytes(pool);
+    void* chunk;
+
+    // Every object of every chunk goes back to the free list, handed out or not
+    pool->free_list = 0;
+    for(chunk = pool->chunks; chunk; chunk = *(void**)chunk)
+    {
+        char* objects = (char*)chunk + liarena_pool_chunk_header(pool);
+        size_t offset;
+        for(offset = 0; offset < bytes; offset += pool->object_size)
+            liarena_pool_release(pool, objects + offset);
+    }
+    pool->next = 0;
+    pool->end = 0;
 }
-#endif
 
-Light_Arena* liarena_create(void)
+static size_t liarena_slab_class(size_t size_bytes)
 {
-    return liarena_create_custom(LIGHT_ARENA_MAX_RESERVED_VIRTUAL_SPACE_GB);
+    size_t index = 0;
+    size_t class_size = LIGHT_ARENA_SLAB_MIN_SIZE;
+
+    while(class_size < size_bytes)
+    {
+        class_size <<= 1;
+        index++;
+    }
+    return index;
 }
 
-inline void* liarena_alloc_aligned(Light_Arena* arena, size_t size_bytes, size_t alignment)
-{    
-    size_t extra_size = liarena_align_delta(arena->ptr, alignment);
-    return liarena_alloc_unaligned(arena, size_bytes + extra_size);
+void liarena_slab_init(Light_Slab* slab, Light_Arena* arena)
+{
+    size_t i;
+
+    slab->arena = arena;
+    for(i = 0; i < LIGHT_ARENA_SLAB_CLASS_COUNT; ++i)
+    {
+        size_t class_size = (size_t)LIGHT_ARENA_SLAB_MIN_SIZE << i;
+        liarena_pool_init(&slab->classes[i], arena, class_size, (class_size < 16) ? class_size : 16);
+    }
 }
 
-inline void* liarena_alloc(Light_Arena* arena, size_t size_bytes)
+Light_Slab* liarena_slab_create(Light_Arena* arena)
 {
-    // Align to 8 bytes
-    size_t extra_size = ((8 - ((size_t)(arena->ptr) & 0x7)) & 0x7);
-    return liarena_alloc_unaligned(arena, size_bytes + extra_size);
+    Light_Slab* slab = (Light_Slab*)liarena_alloc(arena, sizeof(Light_Slab));
+
+    if(slab)
+        liarena_slab_init(slab, arena);
+
+    return slab;
 }
 
-inline void liarena_clear(Light_Arena* arena)
+void* liarena_slab_alloc(Light_Slab* slab, size_t size_bytes)
 {
-    arena->ptr = (char*)arena + arena->page_size;
+    size_t index = liarena_slab_class(size_bytes);
+
+    if(index >= LIGHT_ARENA_SLAB_CLASS_COUNT)
+        return 0;
+    return liarena_pool_alloc(&slab->classes[index]);
+}
+
+void liarena_slab_release(Light_Slab* slab, void* object, size_t size_bytes)
+{
+    size_t index = liarena_slab_class(size_bytes);
+
+    ASSERT(index < LIGHT_ARENA_SLAB_CLASS_COUNT);
+    liarena_pool_release(&slab->classes[index], object);
+}
+
+void liarena_slab_clear(Light_Slab* slab)
+{
+    size_t i;
+    for(i = 0; i < LIGHT_ARENA_SLAB_CLASS_COUNT; ++i)
+        liarena_pool_clear(&slab->classes[i]);
 }
 
 #endif
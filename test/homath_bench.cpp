@@ -0,0 +1,128 @@
+/* Compares the homath mat4 products against the plain scalar code they replaced.
+   c++ -O2 test/homath_bench.cpp -o homath_bench                    (SSE2)
+   c++ -O2 -mavx2 -mfma test/homath_bench.cpp -o homath_bench       (AVX2 + FMA)
+   c++ -O2 -DHOMATH_NO_SIMD test/homath_bench.cpp -o homath_bench */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../homath.h"
+
+#define CHAIN_LENGTH 4096
+#define CHAINS 1000
+#define RUNS 5
+
+static double now_seconds(void) {
+	struct timespec t;
+	timespec_get(&t, TIME_UTC);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+/* The 64 multiply-adds homath used before it had a SIMD path */
+static hm::mat4 scalar_multiply(const hm::mat4& left, const hm::mat4& right) {
+	hm::mat4 r;
+	for (int i = 0; i < 4; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			r.m[i][j] = left.m[i][0] * right.m[0][j] + left.m[i][1] * right.m[1][j] + left.m[i][2] * right.m[2][j] + left.m[i][3] * right.m[3][j];
+		}
+	}
+	return r;
+}
+
+/* A loop over the rows: written out like the homath template, GCC folds the two into one */
+/* function (-fipa-icf) and stops vectorizing it into the loops below */
+static hm::vec4 scalar_transform(const hm::mat4& m, const hm::vec4& v) {
+	float r[4];
+	for (int i = 0; i < 4; ++i)
+		r[i] = m.m[i][0] * v.x + m.m[i][1] * v.y + m.m[i][2] * v.z + m.m[i][3] * v.w;
+	return hm::vec4(r[0], r[1], r[2], r[3]);
+}
+
+/* Rotations close to the identity so a long chain neither blows up nor vanishes */
+static hm::mat4* make_matrices(void) {
+	hm::mat4* matrices = new hm::mat4[CHAIN_LENGTH];
+	uint32_t seed = 1;
+	for (int i = 0; i < CHAIN_LENGTH; ++i) {
+		hm::vec3 axis;
+		seed = seed * 1664525 + 1013904223;
+		axis.x = (float)(seed >> 8) / 16777216.0f + 0.1f;
+		seed = seed * 1664525 + 1013904223;
+		axis.y = (float)(seed >> 8) / 16777216.0f;
+		seed = seed * 1664525 + 1013904223;
+		axis.z = (float)(seed >> 8) / 16777216.0f;
+		matrices[i] = hm::mat4::rotate(axis, 1.0f);
+	}
+	return matrices;
+}
+
+static void report(const char* name, double best, int64_t operations, float check) {
+	printf("%-20s %8.4fs %8.1f M/s (check %g)\n", name, best, (double)operations / best * 1e-6, check);
+}
+
+int main(void) {
+	hm::mat4* matrices = make_matrices();
+	hm::vec4* points = new hm::vec4[CHAIN_LENGTH];
+	float check = 0.0f;
+	double best;
+
+	best = 1e9;
+	for (int r = 0; r < RUNS; ++r) {
+		double start = now_seconds();
+		for (int c = 0; c < CHAINS; ++c) {
+			hm::mat4 chain = matrices[c];
+			for (int i = 0; i < CHAIN_LENGTH; ++i)
+				chain = scalar_multiply(chain, matrices[i]);
+			check += chain.m[0][0];
+		}
+		double t = now_seconds() - start;
+		if (t < best) best = t;
+	}
+	report("scalar mat4 chain", best, (int64_t)CHAINS * CHAIN_LENGTH, check);
+
+	best = 1e9;
+	check = 0.0f;
+	for (int r = 0; r < RUNS; ++r) {
+		double start = now_seconds();
+		for (int c = 0; c < CHAINS; ++c) {
+			hm::mat4 chain = matrices[c];
+			for (int i = 0; i < CHAIN_LENGTH; ++i)
+				chain = chain * matrices[i];
+			check += chain.m[0][0];
+		}
+		double t = now_seconds() - start;
+		if (t < best) best = t;
+	}
+	report("homath mat4 chain", best, (int64_t)CHAINS * CHAIN_LENGTH, check);
+
+	/* Every point of an array through each matrix in turn, the points don't depend on each other */
+	best = 1e9;
+	for (int r = 0; r < RUNS; ++r) {
+		for (int i = 0; i < CHAIN_LENGTH; ++i)
+			points[i] = hm::vec4((float)i, 1.0f, 2.0f, 1.0f);
+		double start = now_seconds();
+		for (int c = 0; c < CHAINS; ++c) {
+			for (int i = 0; i < CHAIN_LENGTH; ++i)
+				points[i] = scalar_transform(matrices[c], points[i]);
+		}
+		double t = now_seconds() - start;
+		if (t < best) best = t;
+	}
+	report("scalar mat4 * vec4", best, (int64_t)CHAINS * CHAIN_LENGTH, points[1].x);
+
+	best = 1e9;
+	for (int r = 0; r < RUNS; ++r) {
+		for (int i = 0; i < CHAIN_LENGTH; ++i)
+			points[i] = hm::vec4((float)i, 1.0f, 2.0f, 1.0f);
+		double start = now_seconds();
+		for (int c = 0; c < CHAINS; ++c) {
+			for (int i = 0; i < CHAIN_LENGTH; ++i)
+				points[i] = matrices[c] * points[i];
+		}
+		double t = now_seconds() - start;
+		if (t < best) best = t;
+	}
+	report("homath mat4 * vec4", best, (int64_t)CHAINS * CHAIN_LENGTH, points[1].x);
+
+	delete[] points;
+	delete[] matrices;
+	return 0;
+}
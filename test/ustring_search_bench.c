@@ -0,0 +1,110 @@
+/* Compares the ustring utf8 searches against the C runtime.
+   cc -O2 test/ustring_search_bench.c -o search_bench            (SSE2)
+   cc -O2 -mavx2 test/ustring_search_bench.c -o search_bench     (AVX2)
+   cc -O2 -DUSTRING_NO_SIMD test/ustring_search_bench.c -o search_bench */
+#define _GNU_SOURCE /* memmem */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define USTRING_IMPLEMENT
+#include "../ustring.h"
+
+#define TEXT_SIZE (256 * 1024 * 1024)
+#define RUNS 5
+
+static double now_seconds(void) {
+	struct timespec t;
+	timespec_get(&t, TIME_UTC);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+/* Text with the needle only at the very end, the rest is lowercase letters and spaces */
+static uint8_t* make_text(const char* needle) {
+	int64_t needle_length = (int64_t)strlen(needle);
+	uint8_t* text = (uint8_t*)malloc(TEXT_SIZE + 1);
+	uint32_t seed = 1;
+	for (int64_t i = 0; i < TEXT_SIZE; ++i) {
+		seed = seed * 1664525 + 1013904223;
+		text[i] = ((seed >> 24) % 8 == 0) ? ' ' : (uint8_t)('a' + (seed >> 24) % 26);
+	}
+	memcpy(text + TEXT_SIZE - needle_length, needle, (size_t)needle_length);
+	text[TEXT_SIZE] = 0;
+	return text;
+}
+
+static void report(const char* name, double best, int64_t index) {
+	printf("%-24s %8.4fs %8.0f MB/s (found at %lld)\n", name, best, TEXT_SIZE / best / (1024.0 * 1024.0), (long long)index);
+}
+
+int main(void) {
+	const char* needle = "xylophones!";
+	int64_t needle_length = (int64_t)strlen(needle);
+	uint8_t* text = make_text(needle);
+	int64_t index = -1;
+	double best;
+
+	best = 1e9;
+	for (int r = 0; r < RUNS; ++r) {
+		double start = now_seconds();
+		index = ustring_utf8_find(text, TEXT_SIZE, (const uint8_t*)needle, needle_length);
+		double t = now_seconds() - start;
+		if (t < best) best = t;
+	}
+	report("ustring_utf8_find", best, index);
+
+	best = 1e9;
+	for (int r = 0; r < RUNS; ++r) {
+		double start = now_seconds();
+		index = ustring_utf8_find_last(text, TEXT_SIZE, (const uint8_t*)"yxylophones", needle_length);
+		double t = now_seconds() - start;
+		if (t < best) best = t;
+	}
+	report("ustring_utf8_find_last", best, index);
+
+#if defined(__GLIBC__)
+	best = 1e9;
+	for (int r = 0; r < RUNS; ++r) {
+		double start = now_seconds();
+		const uint8_t* found = (const uint8_t*)memmem(text, TEXT_SIZE, needle, (size_t)needle_length);
+		double t = now_seconds() - start;
+		index = (found) ? found - text : -1;
+		if (t < best) best = t;
+	}
+	report("memmem", best, index);
+#endif
+
+	best = 1e9;
+	for (int r = 0; r < RUNS; ++r) {
+		double start = now_seconds();
+		const char* found = strstr((const char*)text, needle);
+		double t = now_seconds() - start;
+		index = (found) ? (const uint8_t*)found - text : -1;
+		if (t < best) best = t;
+	}
+	report("strstr", best, index);
+
+	{
+		/* the text has no capitals or punctuation, so only the needle at the end matches */
+		const char* needles[] = { "xylophones!", "Zebra crossing", "quixotic.", "Jukebox", "fjord," };
+		int64_t lengths[] = { 11, 14, 9, 7, 6 };
+		ustring_matcher m = ustring_matcher_new(needles, lengths, 5);
+		int32_t which = -1;
+
+		best = 1e9;
+		for (int r = 0; r < RUNS; ++r) {
+			double start = now_seconds();
+			index = ustring_matcher_find(&m, text, TEXT_SIZE, &which);
+			double t = now_seconds() - start;
+			if (t < best) best = t;
+		}
+		report("ustring_matcher_find", best, index);
+		printf("matcher: %d states, %d byte classes, %lld bytes of transitions\n",
+			m.state_count, m.class_count, (long long)m.state_count * m.class_count * (long long)sizeof(int32_t));
+		ustring_matcher_free(&m);
+	}
+
+	free(text);
+	return 0;
+}
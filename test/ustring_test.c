@@ -0,0 +1,184 @@
+/* Tests for ustring.h, prints the failed checks and returns 1 if there are any.
+   cc -O2 test/ustring_test.c -o ustring_test            (SSE2)
+   cc -O2 -mssse3 test/ustring_test.c -o ustring_test    (SSSE3)
+   cc -O2 -mavx2 test/ustring_test.c -o ustring_test     (AVX2)
+   cc -O2 -DUSTRING_NO_SIMD test/ustring_test.c -o ustring_test */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define USTRING_IMPLEMENT
+#include "../ustring.h"
+
+static int failures;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: %s\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while (0)
+
+/* Every malformed byte is one U+FFFD, then decoding goes on with the next byte */
+static void test_ustring8_invalid(void) {
+	struct {
+		const char* text;
+		int64_t count;
+	} cases[] = {
+		{ "\x80", 1 },             /* stray continuation byte */
+		{ "\xC0\x80", 2 },         /* overlong U+0000 */
+		{ "\xED\xA0\x80", 3 },     /* encoded surrogate U+D800 */
+		{ "\xF4\x90\x80\x80", 4 }, /* U+110000 */
+	};
+
+	for (int c = 0; c < (int)(sizeof(cases) / sizeof(cases[0])); ++c) {
+		ustring8 s = ustring8_new_cstr(cases[c].text);
+		ustring u = ustring8_to_ustring(s);
+		CHECK(s.count == cases[c].count);
+		CHECK(u.length == cases[c].count);
+		for (int64_t i = 0; i < s.count; ++i) {
+			CHECK(ustring8_at(&s, i) == 0xFFFD);
+			CHECK(u.data[i] == 0xFFFD);
+		}
+		ustring_free(&u);
+		ustring8_free(&s);
+	}
+
+	{
+		/* Valid text around a malformed byte is unaffected */
+		ustring8 s = ustring8_new_cstr("a\xC3\xA9\x80\xE2\x82\xAC");
+		CHECK(s.count == 4);
+		CHECK(ustring8_at(&s, 0) == 'a');
+		CHECK(ustring8_at(&s, 1) == 0xE9);
+		CHECK(ustring8_at(&s, 2) == 0xFFFD);
+		CHECK(ustring8_at(&s, 3) == 0x20AC);
+		ustring8_free(&s);
+	}
+	{
+		/* A sequence cut short by the end of the string */
+		ustring8 s = ustring8_new_len("\xE2\x82", 2);
+		CHECK(s.count == 2);
+		CHECK(ustring8_at(&s, 0) == 0xFFFD);
+		CHECK(ustring8_at(&s, 1) == 0xFFFD);
+		ustring8_free(&s);
+	}
+}
+
+/* Appending or inserting a string into itself, the source moves when 's' grows */
+static void test_ustring_alias(void) {
+	{
+		ustring s = ustring_new_utf8("abc");
+		ustring_append(&s, s);
+		CHECK(s.length == 6);
+		CHECK(s.data[3] == 'a' && s.data[4] == 'b' && s.data[5] == 'c');
+		ustring_append(&s, ustring_substring(s, 1, 3));
+		CHECK(s.length == 8);
+		CHECK(s.data[6] == 'b' && s.data[7] == 'c');
+		ustring_free(&s);
+	}
+	{
+		ustring s = ustring_new_utf8("abcd");
+		ustring_insert(&s, s, 1);
+		CHECK(s.length == 8);
+		for (int i = 0; i < 8; ++i) CHECK(s.data[i] == (uint32_t)"aabcdbcd"[i]);
+		ustring_free(&s);
+	}
+	{
+		/* The source sits after the insertion point and gets shifted by it */
+		ustring s = ustring_new_utf8("abcd");
+		ustring_insert(&s, ustring_substring(s, 2, 4), 0);
+		CHECK(s.length == 6);
+		for (int i = 0; i < 6; ++i) CHECK(s.data[i] == (uint32_t)"cdabcd"[i]);
+		ustring_free(&s);
+	}
+}
+
+/* The bulk transcoders against a code point at a time, on random mixes of every sequence length */
+/* and of malformed bytes, at every length so that each one lands on and across vector boundaries */
+static void test_utf8_transcoding(void) {
+	static const char* pieces[] = {
+		"a", " ", "Hello ", "\xC3\xA9", "\xD0\x96", "\xE2\x82\xAC", "\xE4\xB8\xAD", "\xEF\xBF\xBF", "\xF0\x9F\x98\x80", "\xF4\x8F\xBF\xBF",
+		"\x80", "\xBF", "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xED\xA0\x80", "\xF0\x80\x80\x80", "\xF4\x90\x80\x80", "\xF5", "\xFF",
+		"\xC3", "\xE2\x82", "\xF0\x9F\x98",
+	};
+	int piece_count = (int)(sizeof(pieces) / sizeof(pieces[0]));
+	uint8_t text[256];
+	uint32_t expected[256];
+	uint8_t expected_bytes[4 * 256];
+	uint32_t seed = 1;
+
+	for (int round = 0; round < 20000; ++round) {
+		int64_t length = 0, count = 0, i = 0;
+		bool valid = USTRING_TRUE;
+		/* mostly valid text, so that the vector paths get to run */
+		int malformed = round % 4;
+		int target;
+
+		seed = seed * 1664525 + 1013904223;
+		target = (int)((seed >> 8) % 200);
+		while (length < target) {
+			int p;
+			seed = seed * 1664525 + 1013904223;
+			p = (int)((seed >> 8) % (malformed ? piece_count : 10));
+			memcpy(text + length, pieces[p], strlen(pieces[p]));
+			length += (int64_t)strlen(pieces[p]);
+		}
+
+		while (i < length) {
+			int64_t advance = ustring_utf8_decode_checked(text + i, length - i, &expected[count]);
+			if (advance == 0) {
+				expected[count] = 0xFFFD;
+				advance = 1;
+				valid = USTRING_FALSE;
+			}
+			count++;
+			i += advance;
+		}
+		/* exactly the space the functions ask for, the sanitizers catch a vector store past it */
+		uint32_t* decoded = (uint32_t*)malloc((size_t)(length > 0 ? length : 1) * sizeof(uint32_t));
+		uint8_t* encoded = (uint8_t*)malloc((size_t)(count > 0 ? 4 * count : 1));
+		CHECK(ustring_utf8_validate(text, length) == valid);
+		CHECK(ustring_utf8_to_utf32(text, length, decoded) == count);
+		CHECK(memcmp(decoded, expected, (size_t)count * sizeof(uint32_t)) == 0);
+
+		/* and back, with surrogates and values past 0x10FFFF in the mix */
+		{
+			int64_t expected_length = 0;
+			if (malformed == 3 && count > 0) {
+				seed = seed * 1664525 + 1013904223;
+				decoded[(seed >> 8) % count] = ((seed >> 4) & 1) ? 0xDC00 : 0x110000;
+			}
+			for (int64_t c = 0; c < count; ++c) {
+				expected_length += ustring_unicode_to_utf8(decoded[c], expected_bytes + expected_length);
+			}
+			CHECK(ustring_utf32_to_utf8(decoded, count, encoded) == expected_length);
+			CHECK(memcmp(encoded, expected_bytes, (size_t)expected_length) == 0);
+		}
+		free(encoded);
+		free(decoded);
+		if (failures > 0) {
+			printf("round %d, %lld bytes\n", round, (long long)length);
+			return;
+		}
+	}
+
+	/* A sequence cut short right at the end of a vector, followed by ascii or by the end of the text */
+	for (int cut = 0; cut < 3; ++cut) {
+		static const char* truncated[] = { "\xC3", "\xE2\x82", "\xF0\x9F\x98" };
+		int64_t cut_length = (int64_t)strlen(truncated[cut]);
+		for (int64_t end = 16; end <= 64; end += 16) {
+			memset(text, 'a', 96);
+			memcpy(text + end - cut_length, truncated[cut], (size_t)cut_length);
+			CHECK(!ustring_utf8_validate(text, end));
+			CHECK(!ustring_utf8_validate(text, 96));
+		}
+	}
+}
+
+int main(void) {
+	test_ustring8_invalid();
+	test_ustring_alias();
+	test_utf8_transcoding();
+	if (failures == 0) printf("all ustring tests passed\n");
+	return failures ? 1 : 0;
+}
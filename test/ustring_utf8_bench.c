@@ -0,0 +1,119 @@
+/* Compares the ustring utf8 transcoders against a code point at a time on text mixing scripts.
+   cc -O2 test/ustring_utf8_bench.c -o utf8_bench             (SSE2)
+   cc -O2 -mssse3 test/ustring_utf8_bench.c -o utf8_bench     (SSSE3)
+   cc -O2 -mavx2 test/ustring_utf8_bench.c -o utf8_bench      (AVX2)
+   cc -O2 -DUSTRING_NO_SIMD test/ustring_utf8_bench.c -o utf8_bench */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define USTRING_IMPLEMENT
+#include "../ustring.h"
+
+#define TEXT_SIZE (64 * 1024 * 1024)
+#define RUNS 5
+
+static double now_seconds(void) {
+	struct timespec t;
+	timespec_get(&t, TIME_UTC);
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+/* Words of one, two, three and four byte characters picked at random, separated by spaces */
+static uint8_t* make_text(int64_t* out_length) {
+	static const char* words[] = {
+		"the", "utf8", "text", "вектор", "строка", "λόγος", "κείμενο", "文字列", "変換", "검증", "😀👍", "naïve", "𝔘𝔫𝔦𝔠𝔬𝔡𝔢",
+	};
+	int word_count = (int)(sizeof(words) / sizeof(words[0]));
+	uint8_t* text = (uint8_t*)malloc(TEXT_SIZE + 64);
+	uint32_t seed = 1;
+	int64_t length = 0;
+	while (length < TEXT_SIZE) {
+		const char* word;
+		seed = seed * 1664525 + 1013904223;
+		word = words[(seed >> 8) % word_count];
+		memcpy(text + length, word, strlen(word));
+		length += (int64_t)strlen(word);
+		text[length++] = ' ';
+	}
+	*out_length = length;
+	return text;
+}
+
+static bool scalar_validate(const uint8_t* text, int64_t length) {
+	int64_t i = 0;
+	while (i < length) {
+		uint32_t unicode;
+		int64_t advance = ustring_utf8_decode_checked(text + i, length - i, &unicode);
+		if (advance == 0) return USTRING_FALSE;
+		i += advance;
+	}
+	return USTRING_TRUE;
+}
+
+static int64_t scalar_to_utf32(const uint8_t* text, int64_t length, uint32_t* out) {
+	int64_t i = 0, count = 0;
+	while (i < length) {
+		int64_t advance = ustring_utf8_decode_checked(text + i, length - i, out + count);
+		if (advance == 0) {
+			out[count] = 0xFFFD;
+			advance = 1;
+		}
+		count++;
+		i += advance;
+	}
+	return count;
+}
+
+static int64_t scalar_to_utf8(const uint32_t* data, int64_t length, uint8_t* out) {
+	int64_t bytes = 0;
+	for (int64_t i = 0; i < length; ++i) {
+		bytes += ustring_unicode_to_utf8(data[i], out + bytes);
+	}
+	return bytes;
+}
+
+static void report(const char* name, double best, int64_t length, int64_t result) {
+	printf("%-28s %8.4fs %8.0f MB/s (result %lld)\n", name, best, (double)length / best / (1024.0 * 1024.0), (long long)result);
+}
+
+int main(void) {
+	int64_t length, count = 0, bytes = 0;
+	uint8_t* text = make_text(&length);
+	uint32_t* unicode = (uint32_t*)malloc((size_t)length * sizeof(uint32_t));
+	uint8_t* encoded = (uint8_t*)malloc((size_t)length * 4);
+	bool valid = USTRING_FALSE;
+	double best;
+
+#define BENCH(name, expression) \
+	best = 1e9; \
+	for (int r = 0; r < RUNS; ++r) { \
+		double start = now_seconds(); \
+		expression; \
+		double t = now_seconds() - start; \
+		if (t < best) best = t; \
+	}
+
+	BENCH("scalar validate", valid = scalar_validate(text, length));
+	report("scalar validate", best, length, valid);
+	BENCH("ustring_utf8_validate", valid = ustring_utf8_validate(text, length));
+	report("ustring_utf8_validate", best, length, valid);
+
+	BENCH("scalar utf8 to utf32", count = scalar_to_utf32(text, length, unicode));
+	report("scalar utf8 to utf32", best, length, count);
+	BENCH("ustring_utf8_to_utf32", count = ustring_utf8_to_utf32(text, length, unicode));
+	report("ustring_utf8_to_utf32", best, length, count);
+
+	/* the utf8 length is reported for both directions, so the rates compare */
+	BENCH("scalar utf32 to utf8", bytes = scalar_to_utf8(unicode, count, encoded));
+	report("scalar utf32 to utf8", best, length, bytes);
+	BENCH("ustring_utf32_to_utf8", bytes = ustring_utf32_to_utf8(unicode, count, encoded));
+	report("ustring_utf32_to_utf8", best, length, bytes);
+	if (bytes != length || memcmp(encoded, text, (size_t)length) != 0) printf("round trip mismatch\n");
+
+	free(encoded);
+	free(unicode);
+	free(text);
+	return 0;
+}
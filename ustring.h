@@ -16,7 +16,7 @@ void    ustring_free(ustring* s);
 ustring ustring_substring(ustring s, int64_t start_index, int64_t end_index);
 
 /* Appending to a string does not allocate a new one, instead */
-/* it appends to the passed one. */
+/* it appends to the passed one. The capacity grows geometrically. */
 void ustring_append(ustring* s, ustring appended);
 void ustring_append_cstr(ustring* s, const char* appended);
 void ustring_append_unicode(ustring* s, uint32_t unicode);
@@ -33,6 +33,169 @@ bool string_equal_len(const char* s1, int64_t s1_length, const char* s2, int64_t
 uint32_t ustring_get_unicode_from_utf8(uint8_t* text, uint32_t* advance);
 /* ustring_to_utf8 uses calloc to allocate new string, caller must free this memory after use */
 char* ustring_to_utf8(ustring s, int32_t* out_size_bytes);
+/* Writes the utf8 encoding of 'unicode' to 'out' and returns how many bytes were written. */
+/* Surrogates and values past 0x10FFFF can't be encoded and are written as U+FFFD. */
+int32_t ustring_unicode_to_utf8(uint32_t unicode, uint8_t out[4]);
+
+/* Bulk transcoding, runs of ascii are processed 16 bytes at a time with SSE2 (32 with AVX2) */
+/* and ustring_utf32_to_utf8 encodes other code points 4 at a time. With SSSE3 (-mssse3) */
+/* ustring_utf8_validate checks 16 bytes at a time whatever the script (32 with AVX2) and */
+/* ustring_utf8_to_utf32 decodes multibyte text 12 bytes at a time. */
+/* Define USTRING_NO_SIMD to only use the scalar code. */
+
+/* Returns true if 'text' is well formed utf8 (no overlongs, surrogates or values past 0x10FFFF) */
+bool    ustring_utf8_validate(const uint8_t* text, int64_t length_bytes);
+/* Decodes 'text' into 'out', which must have space for 'length_bytes' code points. */
+/* Malformed sequences are decoded as U+FFFD. Returns the number of code points written. */
+int64_t ustring_utf8_to_utf32(const uint8_t* text, int64_t length_bytes, uint32_t* out);
+/* Encodes 'data' into 'out', which must have space for 4 * 'length' bytes. Returns the number of bytes written. */
+int64_t ustring_utf32_to_utf8(const uint32_t* data, int64_t length, uint8_t* out);
+
+/* Searching, the functions return the index of the match or -1 if there is none. */
+/* Candidates are found comparing the first and last code points (bytes for utf8 */
+/* buffers) of the needle against a whole vector of positions at once. */
+int64_t ustring_find(ustring s, ustring needle);
+int64_t ustring_find_last(ustring s, ustring needle);
+int64_t ustring_find_unicode(ustring s, uint32_t unicode);
+/* Writes the indices of the non overlapping matches to 'out_indices', returns how many were written */
+int64_t ustring_find_all(ustring s, ustring needle, int64_t* out_indices, int64_t max_count);
+
+/* Splitting, the pieces are substrings of 's' and don't own memory. */
+/* Iterates the pieces of 's' separated by 'delimiter', '*at' must start at 0. */
+/* Returns false when there are no more pieces. */
+bool    ustring_split_next(ustring s, uint32_t delimiter, int64_t* at, ustring* out_piece);
+/* Writes up to 'max_count' pieces to 'out_pieces', returns how many were written */
+int64_t ustring_split(ustring s, uint32_t delimiter, ustring* out_pieces, int64_t max_count);
+
+/* Same searches over utf8 buffers, indices are in bytes */
+int64_t ustring_utf8_find(const uint8_t* text, int64_t length, const uint8_t* needle, int64_t needle_length);
+int64_t ustring_utf8_find_last(const uint8_t* text, int64_t length, const uint8_t* needle, int64_t needle_length);
+int64_t ustring_utf8_find_all(const uint8_t* text, int64_t length, const uint8_t* needle, int64_t needle_length, int64_t* out_indices, int64_t max_count);
+/* Iterates the lines of 'text' without the line ending ("\n" or "\r\n"), '*at' must start at 0. */
+/* Returns false when there are no more lines. */
+bool    ustring_utf8_next_line(const uint8_t* text, int64_t length, int64_t* at, const uint8_t** out_line, int64_t* out_line_length);
+
+/* ustring_matcher searches for many needles in a single pass (Aho-Corasick). */
+/* Bytes that don't appear in any needle behave the same in every state, so they share */
+/* one column of the transition table: it takes state_count * class_count * 4 bytes, */
+/* where class_count is the number of distinct needle bytes plus one. */
+typedef struct {
+	int32_t* transitions;  /* state_count * class_count entries, the next state for every class */
+	int32_t* outputs;      /* longest needle that ends in each state, -1 if none */
+	int64_t* lengths;      /* length of every needle */
+	int32_t  state_count;
+	int32_t  needle_count;
+	int32_t  class_count;
+	uint8_t  classes[256]; /* class of every byte */
+} ustring_matcher;
+
+ustring_matcher ustring_matcher_new(const char** needles, const int64_t* needle_lengths, int32_t needle_count);
+void            ustring_matcher_free(ustring_matcher* m);
+/* Returns the byte index of the first match to end in 'text' (the longest one if several end */
+/* at the same byte) and writes which needle matched to 'out_needle'. Returns -1 if none matches. */
+int64_t         ustring_matcher_find(ustring_matcher* m, const uint8_t* text, int64_t length, int32_t* out_needle);
+
+/* ustring8 stores the string utf8 encoded, indices are in code points. */
+/* The byte offset of every USTRING8_INDEX_STRIDE-th code point is cached */
+/* the first time it is needed, so random access only scans a few bytes. */
+#define USTRING8_INDEX_STRIDE 64
+
+typedef struct {
+	int64_t  length;         /* length in bytes */
+	int64_t  capacity;       /* capacity in bytes, 0 for substrings which don't own their data */
+	int64_t  count;          /* length in code points */
+	uint8_t* data;
+	int64_t* index;          /* byte offset of code points 0, STRIDE, 2 * STRIDE, ... */
+	int64_t  index_count;    /* how many entries of the index are valid */
+	int64_t  index_capacity;
+} ustring8;
+
+ustring8 ustring8_new(uint64_t allocate_bytes);
+ustring8 ustring8_new_cstr(const char* s);
+ustring8 ustring8_new_len(const char* s, int64_t length_bytes);
+ustring8 ustring8_from_ustring(ustring s);
+ustring  ustring8_to_ustring(ustring8 s);
+ustring8 ustring8_copy(ustring8 s);
+void     ustring8_free(ustring8* s);
+/* The substring does not own its memory, it is only valid while 's' is not modified. */
+/* Editing the substring first copies it to memory it owns, after which it needs ustring8_free */
+ustring8 ustring8_substring(ustring8* s, int64_t start_index, int64_t end_index);
+
+/* Returns the code point at 'index', U+FFFD for a truncated or invalid sequence */
+uint32_t ustring8_at(ustring8* s, int64_t index);
+/* Returns the byte offset of the code point at 'index' */
+int64_t  ustring8_offset(ustring8* s, int64_t index);
+
+void ustring8_append(ustring8* s, ustring8 appended);
+void ustring8_append_cstr(ustring8* s, const char* appended);
+void ustring8_append_unicode(ustring8* s, uint32_t unicode);
+void ustring8_insert(ustring8* s, ustring8 inserted, int64_t index);
+void ustring8_insert_unicode(ustring8* s, uint32_t unicode, int64_t index);
+void ustring8_remove(ustring8* s, int64_t n, int64_t index);
+
+bool ustring8_equal(ustring8 s1, ustring8 s2);
+bool ustring8_equal_cstr(ustring8 s1, const char* s2);
+
+/* ustring_gap is a gap buffer for editing: the code points are split in two runs */
+/* around an empty gap. Inserting or removing at the gap is O(1), editing */
+/* elsewhere moves the gap there first, which only copies the text in between, */
+/* so edits close to each other (like typing) are cheap. */
+typedef struct {
+	int64_t   capacity;  /* capacity in code points */
+	int64_t   gap_start; /* index of the first code point of the gap */
+	int64_t   gap_end;   /* index of the first code point after the gap */
+	uint32_t* data;
+} ustring_gap;
+
+ustring_gap ustring_gap_new(uint64_t allocate);
+ustring_gap ustring_gap_from_ustring(ustring s);
+/* Copies the contents to a new ustring, the caller must free it */
+ustring     ustring_gap_to_ustring(ustring_gap* g);
+void        ustring_gap_free(ustring_gap* g);
+int64_t     ustring_gap_length(ustring_gap* g);
+uint32_t    ustring_gap_at(ustring_gap* g, int64_t index);
+void        ustring_gap_insert(ustring_gap* g, ustring inserted, int64_t index);
+void        ustring_gap_insert_unicode(ustring_gap* g, uint32_t unicode, int64_t index);
+void        ustring_gap_remove(ustring_gap* g, int64_t n, int64_t index);
+
+/* ustring_interner stores each distinct string once and gives it a 32 bit handle, */
+/* two strings interned in the same interner are equal if and only if their */
+/* handles are equal. Strings are kept utf8 encoded and null terminated in */
+/* blocks of USTRING_INTERN_BLOCK_SIZE bytes that never move, so the pointers */
+/* returned by ustring_intern_get stay valid until the interner is freed. */
+#define USTRING_INTERN_BLOCK_SIZE (64 * 1024)
+
+/* 0 is never a valid handle */
+typedef uint32_t ustring_handle;
+
+typedef struct {
+	uint64_t    hash;
+	const char* data;
+	int64_t     length;
+} ustring_intern_entry;
+
+typedef struct {
+	ustring_intern_entry* entries;   /* indexed by handle, entry 0 is unused */
+	uint32_t              entry_count;
+	uint32_t              entry_capacity;
+	ustring_handle*       slots;     /* open addressing table of handles, 0 means empty */
+	uint32_t              slot_count; /* always a power of two */
+	char*                 block;     /* current storage block, the first bytes link to the previous one */
+	int64_t               block_used;
+	int64_t               block_size;
+	uint8_t*              scratch;   /* used to encode ustrings to utf8 */
+	int64_t               scratch_size;
+} ustring_interner;
+
+ustring_interner ustring_interner_new(void);
+void             ustring_interner_free(ustring_interner* interner);
+ustring_handle   ustring_intern(ustring_interner* interner, ustring s);
+ustring_handle   ustring_intern_cstr(ustring_interner* interner, const char* s);
+ustring_handle   ustring_intern_len(ustring_interner* interner, const char* s, int64_t length_bytes);
+/* Returns the handle of the string if it was interned, 0 otherwise */
+ustring_handle   ustring_intern_find(ustring_interner* interner, const char* s, int64_t length_bytes);
+/* Returns the null terminated utf8 string of 'handle' and writes its length to 'out_length_bytes' if not null */
+const char*      ustring_intern_get(ustring_interner* interner, ustring_handle handle, int64_t* out_length_bytes);
 
 
 #if defined(USTRING_IMPLEMENT)
@@ -45,14 +208,27 @@ char* ustring_to_utf8(ustring s, int32_t* out_size_bytes);
 #include <string.h>
 #include <stdlib.h>
 
-ustring ustring_new_utf8(const char* s) {
-	ustring result = ustring_new(strlen(s) * sizeof(uint32_t));
+#if !defined(USTRING_NO_SIMD)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define USTRING_AVX2
+#define USTRING_SSSE3
+#define USTRING_SSE2
+#elif defined(__SSSE3__) || defined(__AVX__)
+#include <tmmintrin.h>
+#define USTRING_SSSE3
+#define USTRING_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define USTRING_SSE2
+#endif
+#endif
 
-	while (*s) {
-		uint32_t advance = 0;
-		ustring_append_unicode(&result, ustring_get_unicode_from_utf8((uint8_t*)s, &advance));
-		s += advance;
-	}
+ustring ustring_new_utf8(const char* s) {
+	int64_t length = (int64_t)strlen(s);
+	/* there are never more code points than bytes */
+	ustring result = ustring_new((uint64_t)length);
+	result.length = ustring_utf8_to_utf32((const uint8_t*)s, length, result.data);
 	return result;
 }
 
@@ -91,14 +267,31 @@ void ustring_free(ustring* s) {
 	free(s->data);
 }
 
+/* Makes sure 's' has space for 'length' code points, doubling the capacity */
+/* so that appending one code point at a time is amortized O(1). */
+static void ustring_reserve(ustring* s, int64_t length) {
+	int64_t size = length * (int64_t)sizeof(uint32_t);
+	if (s->capacity < size) {
+		int64_t capacity = s->capacity * 2;
+		if (capacity < size) capacity = size;
+		s->data = (uint32_t*)realloc(s->data, (size_t)capacity);
+		s->capacity = capacity;
+	}
+}
+
+/* Index of the code point of 's' that 'p' points to, e.g. for a substring of it, or -1 */
+static int64_t ustring_alias_index(const ustring* s, const uint32_t* p) {
+	if (!s->data || p < s->data || p >= s->data + s->length) return -1;
+	return (int64_t)(((uintptr_t)p - (uintptr_t)s->data) / sizeof(uint32_t));
+}
+
 /* Appending to a string does not allocate a new one, instead
    it appends to the passed one. */
 void ustring_append(ustring* s, ustring appended) {
-	if (s->capacity < ((s->length + appended.length) * (int64_t)sizeof(uint32_t))) {
-		/* realloc to support new string */
-		s->data = (uint32_t*)realloc(s->data, (s->length + appended.length) * sizeof(uint32_t));
-		s->capacity = (s->length + appended.length) * sizeof(uint32_t);
-	}
+	/* 'appended' can be 's' itself or one of its substrings, find it again after growing */
+	int64_t source = ustring_alias_index(s, appended.data);
+	ustring_reserve(s, s->length + appended.length);
+	if (source >= 0) appended.data = s->data + source;
 	memcpy(s->data + s->length, appended.data, appended.length * sizeof(uint32_t));
 	s->length += appended.length;
 }
@@ -110,11 +303,8 @@ void ustring_append_cstr(ustring* s, const char* appended) {
 }
 
 void ustring_append_unicode(ustring* s, uint32_t unicode) {
-	ustring a;
-	a.capacity = 0;
-	a.length = 1;
-	a.data = (uint32_t*)&unicode;
-	ustring_append(s, a);
+	ustring_reserve(s, s->length + 1);
+	s->data[s->length++] = unicode;
 }
 
 /* Comparisons */
@@ -173,20 +363,22 @@ uint32_t ustring_get_unicode_from_utf8(uint8_t* text, uint32_t* advance) {
 }
 
 void ustring_insert(ustring* s, ustring inserted, int32_t index) {
-	if (s->length == index) {
-		ustring_append(s, inserted);
-	} else if (s->length > index) {
-		ustring c = *s;
-		c.data = c.data + index;
-		c.length -= index;
-		c.capacity -= index * sizeof(uint32_t);
-		ustring temp = ustring_copy(c);
+	uint32_t* copy = 0;
+	if (s->length < index) return;
 
-		s->length = index;
-		ustring_append(s, inserted);
-		ustring_append(s, temp);
-		ustring_free(&temp);
+	/* Code points from 's' itself move with the memmove below, insert a copy of them */
+	if (ustring_alias_index(s, inserted.data) >= 0) {
+		copy = (uint32_t*)malloc((size_t)inserted.length * sizeof(uint32_t));
+		memcpy(copy, inserted.data, (size_t)inserted.length * sizeof(uint32_t));
+		inserted.data = copy;
 	}
+
+	/* open space in place instead of copying the tail to a temporary */
+	ustring_reserve(s, s->length + inserted.length);
+	memmove(s->data + index + inserted.length, s->data + index, (s->length - index) * sizeof(uint32_t));
+	memcpy(s->data + index, inserted.data, inserted.length * sizeof(uint32_t));
+	s->length += inserted.length;
+	free(copy);
 }
 
 void ustring_insert_unicode(ustring* s, uint32_t unicode, int32_t index) {
@@ -201,43 +393,1399 @@ void ustring_remove(ustring* s, int32_t n, int32_t index) {
 	n = USTRING_MIN(n, (int32_t)(s->length - index));
 	if (n == 0) return;
 
-	memcpy(s->data + index, s->data + index + n, (s->length - index - n) * sizeof(uint32_t));
+	memmove(s->data + index, s->data + index + n, (s->length - index - n) * sizeof(uint32_t));
 	s->length -= n;
 }
 
 char*
 ustring_to_utf8(ustring s, int32_t* out_size_bytes) {
-    uint8_t* result = (uint8_t*)calloc(1, s.length * sizeof(uint32_t));
-    uint8_t* start = result;
-    for(int64_t i = 0; i < s.length; ++i) {
-        uint32_t unicode = s.data[i];
-        if(unicode <= 0x7f) {
-            *result++ = (uint8_t)unicode;
-        } else if(unicode >= 0x80 && unicode <= 0x7ff) {
-            uint8_t b1 = 0xc0 | (unicode >> 6);
-            uint8_t b2 = 0x80 | ((unicode & 0x3f) | 0x30000000);
-            *result++ = b1;
-            *result++ = b2;
-        } else if(unicode >= 0x800 && unicode <= 0xffff) {
-            uint8_t b1 = 0xe0 | (unicode >> 12);
-            uint8_t b2 = 0x80 | (((unicode >> 6) & 0x3f) | 0x30000000);
-            uint8_t b3 = 0x80 | ((unicode & 0x3f) | 0x30000000);
-            *result++ = b1;
-            *result++ = b2;
-            *result++ = b3;
-        } else if(unicode >= 0x00010000 && unicode <= 0x001fffff) {
-            uint8_t b1 = 0xf0 | (unicode >> 18);
-            uint8_t b2 = 0x80 | (((unicode >> 12) & 0x3f) | 0x30000000);
-            uint8_t b3 = 0x80 | (((unicode >> 6) & 0x3f) | 0x30000000);
-            uint8_t b4 = 0x80 | ((unicode & 0x3f) | 0x30000000);
-            *result++ = b1;
-            *result++ = b2;
-            *result++ = b3;
-            *result++ = b4;
-        }
-    }
-    *out_size_bytes = result - start;
-    return (char*)start;
+    uint8_t* result = (uint8_t*)calloc(1, s.length * sizeof(uint32_t) + 1);
+    *out_size_bytes = (int32_t)ustring_utf32_to_utf8(s.data, s.length, result);
+    return (char*)result;
+}
+
+int32_t ustring_unicode_to_utf8(uint32_t unicode, uint8_t out[4]) {
+	if (unicode <= 0x7f) {
+		out[0] = (uint8_t)unicode;
+		return 1;
+	} else if (unicode <= 0x7ff) {
+		out[0] = 0xc0 | (uint8_t)(unicode >> 6);
+		out[1] = 0x80 | (uint8_t)(unicode & 0x3f);
+		return 2;
+	} else if (unicode <= 0xffff) {
+		/* same rules as ustring_utf8_validate, surrogates are not valid on their own */
+		if (unicode >= 0xd800 && unicode <= 0xdfff) unicode = 0xfffd;
+		out[0] = 0xe0 | (uint8_t)(unicode >> 12);
+		out[1] = 0x80 | (uint8_t)((unicode >> 6) & 0x3f);
+		out[2] = 0x80 | (uint8_t)(unicode & 0x3f);
+		return 3;
+	} else if (unicode <= 0x10ffff) {
+		out[0] = 0xf0 | (uint8_t)(unicode >> 18);
+		out[1] = 0x80 | (uint8_t)((unicode >> 12) & 0x3f);
+		out[2] = 0x80 | (uint8_t)((unicode >> 6) & 0x3f);
+		out[3] = 0x80 | (uint8_t)(unicode & 0x3f);
+		return 4;
+	}
+	out[0] = 0xef;
+	out[1] = 0xbf;
+	out[2] = 0xbd;
+	return 3;
+}
+
+/* Decodes one strictly well formed sequence, returns its length or 0 if it is malformed */
+static int64_t ustring_utf8_decode_checked(const uint8_t* text, int64_t remaining, uint32_t* out) {
+	uint8_t lead = text[0];
+	uint8_t low = 0x80, high = 0xBF;
+	int64_t length = 0;
+	uint32_t result = 0;
+
+	if (lead < 0x80) {
+		*out = lead;
+		return 1;
+	} else if (lead >= 0xC2 && lead <= 0xDF) {
+		length = 2;
+		result = lead & 0x1F;
+	} else if (lead >= 0xE0 && lead <= 0xEF) {
+		length = 3;
+		result = lead & 0x0F;
+		if (lead == 0xE0) low = 0xA0;       /* overlong */
+		else if (lead == 0xED) high = 0x9F; /* surrogates */
+	} else if (lead >= 0xF0 && lead <= 0xF4) {
+		length = 4;
+		result = lead & 0x07;
+		if (lead == 0xF0) low = 0x90;       /* overlong */
+		else if (lead == 0xF4) high = 0x8F; /* past 0x10FFFF */
+	} else {
+		return 0;
+	}
+
+	if (remaining < length) return 0;
+	if (text[1] < low || text[1] > high) return 0;
+	for (int64_t i = 1; i < length; ++i) {
+		if ((text[i] & 0xC0) != 0x80) return 0;
+		result = (result << 6) | (text[i] & 0x3F);
+	}
+	*out = result;
+	return length;
+}
+
+#if defined(USTRING_SSSE3)
+/* Keiser and Lemire's utf8 validation: the kind of error a pair of bytes can make is looked up */
+/* from the high and low nibbles of the first byte and the high nibble of the second one, every */
+/* table holds one bit per kind of error and the pair is wrong when a bit is set in all three */
+#define USTRING_UTF8_TOO_SHORT      (1 << 0) /* lead followed by ascii or another lead */
+#define USTRING_UTF8_TOO_LONG       (1 << 1) /* ascii followed by a continuation */
+#define USTRING_UTF8_OVERLONG_3     (1 << 2) /* E0 80..9F */
+#define USTRING_UTF8_TOO_LARGE      (1 << 3) /* F4 90..BF, F5..FF 90..BF */
+#define USTRING_UTF8_SURROGATE      (1 << 4) /* ED A0..BF */
+#define USTRING_UTF8_OVERLONG_2     (1 << 5) /* C0..C1 followed by a continuation */
+#define USTRING_UTF8_TOO_LARGE_1000 (1 << 6) /* F5..FF 80..8F */
+#define USTRING_UTF8_OVERLONG_4     (1 << 6) /* F0 80..8F */
+#define USTRING_UTF8_TWO_CONTS      (1 << 7) /* continuation followed by a continuation */
+#define USTRING_UTF8_CARRY          (USTRING_UTF8_TOO_SHORT | USTRING_UTF8_TOO_LONG | USTRING_UTF8_TWO_CONTS)
+
+static const uint8_t ustring_utf8_byte1_high[16] = {
+	/* 0_______ ascii */
+	USTRING_UTF8_TOO_LONG, USTRING_UTF8_TOO_LONG, USTRING_UTF8_TOO_LONG, USTRING_UTF8_TOO_LONG,
+	USTRING_UTF8_TOO_LONG, USTRING_UTF8_TOO_LONG, USTRING_UTF8_TOO_LONG, USTRING_UTF8_TOO_LONG,
+	/* 10______ continuation */
+	USTRING_UTF8_TWO_CONTS, USTRING_UTF8_TWO_CONTS, USTRING_UTF8_TWO_CONTS, USTRING_UTF8_TWO_CONTS,
+	/* 1100____ and 1101____ two byte leads */
+	USTRING_UTF8_TOO_SHORT | USTRING_UTF8_OVERLONG_2,
+	USTRING_UTF8_TOO_SHORT,
+	/* 1110____ three byte leads */
+	USTRING_UTF8_TOO_SHORT | USTRING_UTF8_OVERLONG_3 | USTRING_UTF8_SURROGATE,
+	/* 1111____ four byte leads and bytes that are never valid */
+	USTRING_UTF8_TOO_SHORT | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000 | USTRING_UTF8_OVERLONG_4,
+};
+
+static const uint8_t ustring_utf8_byte1_low[16] = {
+	USTRING_UTF8_CARRY | USTRING_UTF8_OVERLONG_3 | USTRING_UTF8_OVERLONG_2 | USTRING_UTF8_OVERLONG_4, /* ____0000 */
+	USTRING_UTF8_CARRY | USTRING_UTF8_OVERLONG_2,                                                    /* ____0001 */
+	USTRING_UTF8_CARRY,
+	USTRING_UTF8_CARRY,
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE,                                                     /* ____0100 */
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000,
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000,
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000,
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000,
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000,
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000,
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000,
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000,
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000 | USTRING_UTF8_SURROGATE, /* ____1101 */
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000,
+	USTRING_UTF8_CARRY | USTRING_UTF8_TOO_LARGE | USTRING_UTF8_TOO_LARGE_1000,
+};
+
+static const uint8_t ustring_utf8_byte2_high[16] = {
+	/* ascii */
+	USTRING_UTF8_TOO_SHORT, USTRING_UTF8_TOO_SHORT, USTRING_UTF8_TOO_SHORT, USTRING_UTF8_TOO_SHORT,
+	USTRING_UTF8_TOO_SHORT, USTRING_UTF8_TOO_SHORT, USTRING_UTF8_TOO_SHORT, USTRING_UTF8_TOO_SHORT,
+	/* 1000____ */
+	USTRING_UTF8_TOO_LONG | USTRING_UTF8_OVERLONG_2 | USTRING_UTF8_TWO_CONTS | USTRING_UTF8_OVERLONG_3 | USTRING_UTF8_TOO_LARGE_1000 | USTRING_UTF8_OVERLONG_4,
+	/* 1001____ */
+	USTRING_UTF8_TOO_LONG | USTRING_UTF8_OVERLONG_2 | USTRING_UTF8_TWO_CONTS | USTRING_UTF8_OVERLONG_3 | USTRING_UTF8_TOO_LARGE,
+	/* 101_____ */
+	USTRING_UTF8_TOO_LONG | USTRING_UTF8_OVERLONG_2 | USTRING_UTF8_TWO_CONTS | USTRING_UTF8_SURROGATE | USTRING_UTF8_TOO_LARGE,
+	USTRING_UTF8_TOO_LONG | USTRING_UTF8_OVERLONG_2 | USTRING_UTF8_TWO_CONTS | USTRING_UTF8_SURROGATE | USTRING_UTF8_TOO_LARGE,
+	/* leads */
+	USTRING_UTF8_TOO_SHORT, USTRING_UTF8_TOO_SHORT, USTRING_UTF8_TOO_SHORT, USTRING_UTF8_TOO_SHORT,
+};
+
+/* Nonzero bytes where 'input' is wrong, 'prev' is the vector before it (zero when 'input' starts a character) */
+static __m128i ustring_utf8_errors_ssse3(__m128i input, __m128i prev) {
+	__m128i nibble = _mm_set1_epi8(0x0F);
+	__m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+	__m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+	__m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+	__m128i byte1_high = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)ustring_utf8_byte1_high), _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+	__m128i byte1_low = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)ustring_utf8_byte1_low), _mm_and_si128(prev1, nibble));
+	__m128i byte2_high = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)ustring_utf8_byte2_high), _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+	__m128i special = _mm_and_si128(_mm_and_si128(byte1_high, byte1_low), byte2_high);
+	/* the third and fourth bytes of a sequence are continuations the lookups took for two in a row, */
+	/* the saturating subtractions leave the high bit set exactly where a three or four byte lead is 2 or 3 bytes back */
+	__m128i must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80))), _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80))));
+	return _mm_xor_si128(_mm_and_si128(must23, _mm_set1_epi8((char)0x80)), special);
+}
+
+#if !defined(USTRING_AVX2)
+/* Nonzero where one of the last 3 bytes of 'input' is a lead whose sequence doesn't fit in it */
+static __m128i ustring_utf8_incomplete_ssse3(__m128i input) {
+	return _mm_subs_epu8(input, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1)));
+}
+
+static bool ustring_utf8_validate_ssse3(const uint8_t* text, int64_t length) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i error = zero, prev = zero, incomplete = zero;
+	uint8_t tail[16] = { 0 };
+	int64_t i = 0;
+
+	for (; i + 16 <= length; i += 16) {
+		__m128i input = _mm_loadu_si128((const __m128i*)(text + i));
+		if (_mm_movemask_epi8(input) == 0) {
+			/* ascii is only wrong after a sequence the vector before left unfinished */
+			error = _mm_or_si128(error, incomplete);
+		} else {
+			error = _mm_or_si128(error, ustring_utf8_errors_ssse3(input, prev));
+			incomplete = ustring_utf8_incomplete_ssse3(input);
+		}
+		prev = input;
+	}
+	if (i < length) {
+		/* the zeros after the tail are ascii, a sequence cut short by the end is too short */
+		memcpy(tail, text + i, (size_t)(length - i));
+		error = _mm_or_si128(error, ustring_utf8_errors_ssse3(_mm_loadu_si128((const __m128i*)tail), prev));
+	} else {
+		error = _mm_or_si128(error, incomplete);
+	}
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) == 0xFFFF;
+}
+#endif
+
+/* Picks the lanes of a vector whose bit is set in the index, packed at the start */
+static const uint8_t ustring_compress_epi32[16][16] = {
+	{ 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x00, 0x01, 0x02, 0x03, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x04, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x00, 0x01, 0x02, 0x03, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x00, 0x01, 0x02, 0x03, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x80, 0x80, 0x80, 0x80 },
+	{ 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F },
+};
+
+/* Decodes the characters starting in the first 12 bytes of windows of 16, the bytes of the */
+/* character at every position are gathered into its 32 bit lane and the lanes of continuation */
+/* bytes are dropped. Stops at a window with an error, a window of ascii or the last 16 bytes, */
+/* returns the bytes consumed, always at the start of a character */
+static int64_t ustring_utf8_to_utf32_ssse3(const uint8_t* text, int64_t length, uint32_t** cursor) {
+	__m128i gather[3];
+	__m128i prev = _mm_setzero_si128();
+	uint32_t* out = *cursor;
+	int64_t i = 0;
+
+	gather[0] = _mm_setr_epi8(0, 1, 2, 3, 1, 2, 3, 4, 2, 3, 4, 5, 3, 4, 5, 6);
+	gather[1] = _mm_setr_epi8(4, 5, 6, 7, 5, 6, 7, 8, 6, 7, 8, 9, 7, 8, 9, 10);
+	gather[2] = _mm_setr_epi8(8, 9, 10, 11, 9, 10, 11, 12, 10, 11, 12, 13, 11, 12, 13, 14);
+
+	for (; i + 16 <= length; i += 12) {
+		__m128i input = _mm_loadu_si128((const __m128i*)(text + i));
+		__m128i zero = _mm_setzero_si128();
+		int leads;
+
+		if (_mm_movemask_epi8(input) == 0) break;
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(ustring_utf8_errors_ssse3(input, prev), zero)) != 0xFFFF) break;
+
+		/* anything but 10______ starts a character */
+		leads = _mm_movemask_epi8(_mm_cmpgt_epi8(input, _mm_set1_epi8((char)0xBF)));
+		for (int g = 0; g < 3; ++g) {
+			__m128i word = _mm_shuffle_epi8(input, gather[g]);
+			__m128i low6 = _mm_set1_epi32(0x3F);
+			__m128i b0 = _mm_and_si128(word, _mm_set1_epi32(0xFF));
+			__m128i b1 = _mm_and_si128(_mm_srli_epi32(word, 8), low6);
+			__m128i b2 = _mm_and_si128(_mm_srli_epi32(word, 16), low6);
+			__m128i b3 = _mm_and_si128(_mm_srli_epi32(word, 24), low6);
+			__m128i two = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(b0, _mm_set1_epi32(0x1F)), 6), b1);
+			__m128i three = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(b0, _mm_set1_epi32(0x0F)), 12), _mm_slli_epi32(b1, 6)), b2);
+			__m128i four = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(b0, _mm_set1_epi32(0x07)), 18), _mm_slli_epi32(b1, 12)), _mm_or_si128(_mm_slli_epi32(b2, 6), b3));
+			__m128i is_two = _mm_cmpgt_epi32(b0, _mm_set1_epi32(0xBF));
+			__m128i is_three = _mm_cmpgt_epi32(b0, _mm_set1_epi32(0xDF));
+			__m128i is_four = _mm_cmpgt_epi32(b0, _mm_set1_epi32(0xEF));
+			__m128i unicode = _mm_or_si128(_mm_and_si128(is_two, two), _mm_andnot_si128(is_two, b0));
+			unicode = _mm_or_si128(_mm_and_si128(is_three, three), _mm_andnot_si128(is_three, unicode));
+			unicode = _mm_or_si128(_mm_and_si128(is_four, four), _mm_andnot_si128(is_four, unicode));
+
+			int keep = (leads >> (4 * g)) & 0xF;
+			_mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(unicode, _mm_loadu_si128((const __m128i*)ustring_compress_epi32[keep])));
+			out += (keep & 1) + ((keep >> 1) & 1) + ((keep >> 2) & 1) + (keep >> 3);
+		}
+		/* the next window starts 12 bytes in, its context are bytes 9 to 11 of this one */
+		prev = _mm_slli_si128(input, 4);
+	}
+	/* the window before ends in continuations of a character it already decoded */
+	if (i > 0) {
+		while (i < length && (text[i] & 0xC0) == 0x80) i++;
+	}
+	*cursor = out;
+	return i;
+}
+#endif
+
+#if defined(USTRING_AVX2)
+/* The vector before 'input' shifted in by 'n' bytes, across the two 128 bit lanes */
+#define USTRING_PREV_AVX2(input, prev, n) _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - (n))
+
+static __m256i ustring_utf8_errors_avx2(__m256i input, __m256i prev) {
+	__m256i nibble = _mm256_set1_epi8(0x0F);
+	__m256i prev1 = USTRING_PREV_AVX2(input, prev, 1);
+	__m256i prev2 = USTRING_PREV_AVX2(input, prev, 2);
+	__m256i prev3 = USTRING_PREV_AVX2(input, prev, 3);
+	__m256i byte1_high = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ustring_utf8_byte1_high)), _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+	__m256i byte1_low = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ustring_utf8_byte1_low)), _mm256_and_si256(prev1, nibble));
+	__m256i byte2_high = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)ustring_utf8_byte2_high)), _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+	__m256i special = _mm256_and_si256(_mm256_and_si256(byte1_high, byte1_low), byte2_high);
+	__m256i must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80))), _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80))));
+	return _mm256_xor_si256(_mm256_and_si256(must23, _mm256_set1_epi8((char)0x80)), special);
+}
+
+static __m256i ustring_utf8_incomplete_avx2(__m256i input) {
+	__m256i max = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+	return _mm256_subs_epu8(input, max);
+}
+
+static bool ustring_utf8_validate_avx2(const uint8_t* text, int64_t length) {
+	__m256i zero = _mm256_setzero_si256();
+	__m256i error = zero, prev = zero, incomplete = zero;
+	uint8_t tail[32] = { 0 };
+	int64_t i = 0;
+
+	for (; i + 32 <= length; i += 32) {
+		__m256i input = _mm256_loadu_si256((const __m256i*)(text + i));
+		if (_mm256_movemask_epi8(input) == 0) {
+			error = _mm256_or_si256(error, incomplete);
+		} else {
+			error = _mm256_or_si256(error, ustring_utf8_errors_avx2(input, prev));
+			incomplete = ustring_utf8_incomplete_avx2(input);
+		}
+		prev = input;
+	}
+	if (i < length) {
+		memcpy(tail, text + i, (size_t)(length - i));
+		error = _mm256_or_si256(error, ustring_utf8_errors_avx2(_mm256_loadu_si256((const __m256i*)tail), prev));
+	} else {
+		error = _mm256_or_si256(error, incomplete);
+	}
+	return _mm256_testz_si256(error, error) != 0;
+}
+#endif
+
+#if defined(USTRING_SSE2)
+/* Lanes holding a surrogate or a value past 0x10FFFF, the scalar code writes those as U+FFFD */
+static __m128i ustring_utf32_invalid_sse2(__m128i unicode) {
+	__m128i surrogate = _mm_cmpeq_epi32(_mm_and_si128(unicode, _mm_set1_epi32(~0x7FF)), _mm_set1_epi32(0xD800));
+	__m128i too_large = _mm_cmpgt_epi32(_mm_srli_epi32(unicode, 16), _mm_set1_epi32(0x10));
+	return _mm_or_si128(surrogate, too_large);
+}
+
+/* Encodes the 4 valid code points of 'unicode', each lane is encoded in place and written */
+/* whole, the next one overwrites the bytes it didn't need. Returns the new end of 'out' */
+static uint8_t* ustring_utf8_encode4_sse2(__m128i unicode, uint8_t* out) {
+	__m128i low6 = _mm_set1_epi32(0x3F);
+	__m128i cont = _mm_set1_epi32(0x80);
+	__m128i x0 = _mm_or_si128(_mm_and_si128(unicode, low6), cont);
+	__m128i x1 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(unicode, 6), low6), cont);
+	__m128i x2 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(unicode, 12), low6), cont);
+	__m128i two = _mm_or_si128(_mm_or_si128(_mm_set1_epi32(0xC0), _mm_srli_epi32(unicode, 6)), _mm_slli_epi32(x0, 8));
+	__m128i three = _mm_or_si128(_mm_or_si128(_mm_set1_epi32(0xE0), _mm_srli_epi32(unicode, 12)), _mm_or_si128(_mm_slli_epi32(x1, 8), _mm_slli_epi32(x0, 16)));
+	__m128i four = _mm_or_si128(_mm_or_si128(_mm_set1_epi32(0xF0), _mm_srli_epi32(unicode, 18)),
+		_mm_or_si128(_mm_slli_epi32(x2, 8), _mm_or_si128(_mm_slli_epi32(x1, 16), _mm_slli_epi32(x0, 24))));
+	__m128i is_two = _mm_cmpgt_epi32(unicode, _mm_set1_epi32(0x7F));
+	__m128i is_three = _mm_cmpgt_epi32(unicode, _mm_set1_epi32(0x7FF));
+	__m128i is_four = _mm_cmpgt_epi32(unicode, _mm_set1_epi32(0xFFFF));
+	__m128i word = _mm_or_si128(_mm_and_si128(is_two, two), _mm_andnot_si128(is_two, unicode));
+	uint32_t words[4];
+	int32_t lengths[4];
+
+	word = _mm_or_si128(_mm_and_si128(is_three, three), _mm_andnot_si128(is_three, word));
+	word = _mm_or_si128(_mm_and_si128(is_four, four), _mm_andnot_si128(is_four, word));
+	_mm_storeu_si128((__m128i*)words, word);
+	/* the comparisons are -1 where they hold */
+	_mm_storeu_si128((__m128i*)lengths, _mm_sub_epi32(_mm_sub_epi32(_mm_sub_epi32(_mm_set1_epi32(1), is_two), is_three), is_four));
+	for (int k = 0; k < 4; ++k) {
+		memcpy(out, &words[k], 4);
+		out += lengths[k];
+	}
+	return out;
+}
+#endif
+
+#if !defined(USTRING_SSSE3)
+/* Returns how many bytes at the start of 'text' are ascii, checking a vector at a time */
+static int64_t ustring_ascii_prefix(const uint8_t* text, int64_t length) {
+	int64_t i = 0;
+#if defined(USTRING_SSE2)
+	for (; i + 16 <= length; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(text + i));
+		if (_mm_movemask_epi8(v) != 0) break;
+	}
+#endif
+	while (i < length && text[i] < 0x80) i++;
+	return i;
+}
+#endif
+
+/* After a vector finds non-ascii bytes the rest of it is handled a byte at a time, */
+/* testing again after every multibyte character would load each vector once per character */
+#define USTRING_SCALAR_RUN 16
+
+bool ustring_utf8_validate(const uint8_t* text, int64_t length_bytes) {
+#if defined(USTRING_AVX2)
+	return ustring_utf8_validate_avx2(text, length_bytes);
+#elif defined(USTRING_SSSE3)
+	return ustring_utf8_validate_ssse3(text, length_bytes);
+#else
+	int64_t i = 0;
+	while (i < length_bytes) {
+		int64_t end;
+
+		i += ustring_ascii_prefix(text + i, length_bytes - i);
+		if (i == length_bytes) break;
+
+		end = USTRING_MIN(i + USTRING_SCALAR_RUN, length_bytes);
+		while (i < end) {
+			uint32_t unicode;
+			int64_t advance = 1;
+			if (text[i] >= 0x80) {
+				advance = ustring_utf8_decode_checked(text + i, length_bytes - i, &unicode);
+				if (advance == 0) return USTRING_FALSE;
+			}
+			i += advance;
+		}
+	}
+	return USTRING_TRUE;
+#endif
+}
+
+int64_t ustring_utf8_to_utf32(const uint8_t* text, int64_t length_bytes, uint32_t* out) {
+	int64_t i = 0;
+	uint32_t* start = out;
+
+	while (i < length_bytes) {
+#if defined(USTRING_AVX2)
+		for (; i + 32 <= length_bytes; i += 32, out += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(text + i));
+			if (_mm256_movemask_epi8(v) != 0) break;
+			_mm256_storeu_si256((__m256i*)(out + 0), _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(text + i + 0))));
+			_mm256_storeu_si256((__m256i*)(out + 8), _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(text + i + 8))));
+			_mm256_storeu_si256((__m256i*)(out + 16), _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(text + i + 16))));
+			_mm256_storeu_si256((__m256i*)(out + 24), _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(text + i + 24))));
+		}
+#endif
+#if defined(USTRING_SSE2)
+		for (; i + 16 <= length_bytes; i += 16, out += 16) {
+			__m128i zero = _mm_setzero_si128();
+			__m128i v = _mm_loadu_si128((const __m128i*)(text + i));
+			if (_mm_movemask_epi8(v) != 0) break;
+			__m128i lo = _mm_unpacklo_epi8(v, zero);
+			__m128i hi = _mm_unpackhi_epi8(v, zero);
+			_mm_storeu_si128((__m128i*)(out + 0), _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)(out + 4), _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128((__m128i*)(out + 8), _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128((__m128i*)(out + 12), _mm_unpackhi_epi16(hi, zero));
+		}
+#endif
+		if (i == length_bytes) break;
+#if defined(USTRING_SSSE3)
+		{
+			int64_t decoded = ustring_utf8_to_utf32_ssse3(text + i, length_bytes - i, &out);
+			i += decoded;
+			if (decoded > 0) continue;
+		}
+#endif
+
+		int64_t end = USTRING_MIN(i + USTRING_SCALAR_RUN, length_bytes);
+		while (i < end) {
+			if (text[i] < 0x80) {
+				*out++ = text[i++];
+			} else {
+				int64_t advance = ustring_utf8_decode_checked(text + i, length_bytes - i, out);
+				if (advance == 0) {
+					*out = 0xFFFD;
+					advance = 1;
+				}
+				out++;
+				i += advance;
+			}
+		}
+	}
+	return out - start;
+}
+
+int64_t ustring_utf32_to_utf8(const uint32_t* data, int64_t length, uint8_t* out) {
+	int64_t i = 0;
+	uint8_t* start = out;
+
+	while (i < length) {
+#if defined(USTRING_SSE2)
+		for (; i + 16 <= length; i += 16) {
+			__m128i a = _mm_loadu_si128((const __m128i*)(data + i + 0));
+			__m128i b = _mm_loadu_si128((const __m128i*)(data + i + 4));
+			__m128i c = _mm_loadu_si128((const __m128i*)(data + i + 8));
+			__m128i d = _mm_loadu_si128((const __m128i*)(data + i + 12));
+			__m128i any = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+			__m128i high = _mm_and_si128(any, _mm_set1_epi32(~0x7F));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(high, _mm_setzero_si128())) == 0xFFFF) {
+				/* all values are below 0x80, so the saturating packs are exact */
+				__m128i ab = _mm_packs_epi32(a, b);
+				__m128i cd = _mm_packs_epi32(c, d);
+				_mm_storeu_si128((__m128i*)out, _mm_packus_epi16(ab, cd));
+				out += 16;
+				continue;
+			}
+			__m128i invalid = _mm_or_si128(_mm_or_si128(ustring_utf32_invalid_sse2(a), ustring_utf32_invalid_sse2(b)),
+				_mm_or_si128(ustring_utf32_invalid_sse2(c), ustring_utf32_invalid_sse2(d)));
+			if (_mm_movemask_epi8(invalid) != 0) break;
+			out = ustring_utf8_encode4_sse2(a, out);
+			out = ustring_utf8_encode4_sse2(b, out);
+			out = ustring_utf8_encode4_sse2(c, out);
+			out = ustring_utf8_encode4_sse2(d, out);
+		}
+#endif
+		if (i == length) break;
+
+		int64_t end = USTRING_MIN(i + USTRING_SCALAR_RUN, length);
+		for (; i < end; ++i) {
+			if (data[i] < 0x80)
+				*out++ = (uint8_t)data[i];
+			else
+				out += ustring_unicode_to_utf8(data[i], out);
+		}
+	}
+	return out - start;
+}
+
+/* ustring8 */
+
+/* Bytes taken by the code point at 'offset'. Like ustring_utf8_to_utf32, a byte that doesn't */
+/* start a well formed sequence is one U+FFFD on its own and decoding resumes at the next byte */
+static int64_t ustring8_step(const uint8_t* data, int64_t offset, int64_t length) {
+	uint32_t unicode;
+	int64_t step;
+	if (data[offset] < 0x80) return 1;
+	step = ustring_utf8_decode_checked(data + offset, length - offset, &unicode);
+	return (step > 0) ? step : 1;
+}
+
+/* Decodes the code point at 'offset' without reading past 'length', */
+/* truncated or invalid sequences decode as U+FFFD */
+static uint32_t ustring8_decode(const uint8_t* data, int64_t offset, int64_t length, int64_t* out_step) {
+	uint32_t unicode;
+	int64_t step = ustring_utf8_decode_checked(data + offset, length - offset, &unicode);
+	if (step == 0) {
+		step = 1;
+		unicode = 0xFFFD;
+	}
+	*out_step = step;
+	return unicode;
+}
+
+static int64_t ustring8_count(const uint8_t* data, int64_t length) {
+	int64_t count = 0;
+	int64_t i = 0;
+	while (i < length) {
+		i += ustring8_step(data, i, length);
+		count++;
+	}
+	return count;
+}
+
+/* Substrings don't own their data, the first edit copies it to memory of their own */
+static void ustring8_reserve(ustring8* s, int64_t length) {
+	if (s->capacity == 0) {
+		int64_t capacity = (length > 0) ? length : 1;
+		uint8_t* data = (uint8_t*)malloc((size_t)capacity);
+		memcpy(data, s->data, (size_t)s->length);
+		s->data = data;
+		s->capacity = capacity;
+	} else if (s->capacity < length) {
+		int64_t capacity = s->capacity * 2;
+		if (capacity < length) capacity = length;
+		s->data = (uint8_t*)realloc(s->data, (size_t)capacity);
+		s->capacity = capacity;
+	}
+}
+
+/* True if 'p' points into the bytes of 's', which move when 's' grows */
+static bool ustring8_aliases(const ustring8* s, const uint8_t* p) {
+	return s->data && p >= s->data && p < s->data + s->length;
+}
+
+/* Drop the cached offsets past the code point 'index', they are stale after an edit at it */
+static void ustring8_invalidate_index(ustring8* s, int64_t index) {
+	int64_t valid = index / USTRING8_INDEX_STRIDE + 1;
+	if (s->index_count > valid) s->index_count = valid;
+}
+
+ustring8 ustring8_new(uint64_t allocate_bytes) {
+	ustring8 result = { 0 };
+
+	if (allocate_bytes == 0) allocate_bytes = 1;
+
+	result.capacity = (int64_t)allocate_bytes;
+	result.data = (uint8_t*)malloc((size_t)allocate_bytes);
+
+	return result;
+}
+
+ustring8 ustring8_new_len(const char* s, int64_t length_bytes) {
+	ustring8 result = ustring8_new((uint64_t)length_bytes);
+	memcpy(result.data, s, (size_t)length_bytes);
+	result.length = length_bytes;
+	result.count = ustring8_count(result.data, length_bytes);
+	return result;
+}
+
+ustring8 ustring8_new_cstr(const char* s) {
+	return ustring8_new_len(s, (int64_t)strlen(s));
+}
+
+ustring8 ustring8_from_ustring(ustring s) {
+	ustring8 result = ustring8_new((uint64_t)s.length);
+	for (int64_t i = 0; i < s.length; ++i)
+		ustring8_append_unicode(&result, s.data[i]);
+	return result;
+}
+
+ustring ustring8_to_ustring(ustring8 s) {
+	ustring result = ustring_new((uint64_t)s.count);
+	int64_t i = 0;
+	while (i < s.length) {
+		int64_t step;
+		result.data[result.length++] = ustring8_decode(s.data, i, s.length, &step);
+		i += step;
+	}
+	return result;
+}
+
+ustring8 ustring8_copy(ustring8 s) {
+	return ustring8_new_len((const char*)s.data, s.length);
+}
+
+void ustring8_free(ustring8* s) {
+	free(s->data);
+	free(s->index);
+	s->data = 0;
+	s->index = 0;
+	s->length = 0;
+	s->capacity = 0;
+	s->count = 0;
+	s->index_count = 0;
+	s->index_capacity = 0;
+}
+
+int64_t ustring8_offset(ustring8* s, int64_t index) {
+	int64_t block = index / USTRING8_INDEX_STRIDE;
+	int64_t offset = 0;
+	int64_t cp = 0;
+
+	if (index >= s->count) return s->length;
+
+	if (s->capacity == 0) {
+		/* Substrings don't own memory for an index, scan from the start */
+	} else if (block < s->index_count) {
+		offset = s->index[block];
+		cp = block * USTRING8_INDEX_STRIDE;
+	} else {
+		/* Extend the index up to the requested block */
+		if (s->index_capacity <= block) {
+			int64_t capacity = s->index_capacity * 2;
+			if (capacity <= block) capacity = block + 1;
+			s->index = (int64_t*)realloc(s->index, (size_t)capacity * sizeof(int64_t));
+			s->index_capacity = capacity;
+		}
+		if (s->index_count == 0) {
+			s->index[0] = 0;
+			s->index_count = 1;
+		}
+		offset = s->index[s->index_count - 1];
+		cp = (s->index_count - 1) * USTRING8_INDEX_STRIDE;
+		while (s->index_count <= block) {
+			for (int64_t i = 0; i < USTRING8_INDEX_STRIDE && offset < s->length; ++i)
+				offset += ustring8_step(s->data, offset, s->length);
+			cp += USTRING8_INDEX_STRIDE;
+			s->index[s->index_count++] = offset;
+		}
+	}
+
+	while (cp < index && offset < s->length) {
+		offset += ustring8_step(s->data, offset, s->length);
+		cp++;
+	}
+	return offset;
+}
+
+uint32_t ustring8_at(ustring8* s, int64_t index) {
+	int64_t offset = ustring8_offset(s, index);
+	int64_t step;
+	if (offset >= s->length) return 0;
+	return ustring8_decode(s->data, offset, s->length, &step);
+}
+
+ustring8 ustring8_substring(ustring8* s, int64_t start_index, int64_t end_index) {
+	ustring8 result = { 0 };
+	int64_t start = ustring8_offset(s, start_index);
+	result.capacity = 0;
+	result.data = s->data + start;
+	result.length = ustring8_offset(s, end_index) - start;
+	result.count = end_index - start_index;
+	return result;
+}
+
+void ustring8_append(ustring8* s, ustring8 appended) {
+	/* 'appended' can be 's' itself or one of its substrings, find it again after growing */
+	if (ustring8_aliases(s, appended.data)) {
+		int64_t source = appended.data - s->data;
+		ustring8_reserve(s, s->length + appended.length);
+		appended.data = s->data + source;
+	} else {
+		ustring8_reserve(s, s->length + appended.length);
+	}
+	memcpy(s->data + s->length, appended.data, (size_t)appended.length);
+	s->length += appended.length;
+	s->count += appended.count;
+}
+
+void ustring8_append_cstr(ustring8* s, const char* appended) {
+	int64_t length = (int64_t)strlen(appended);
+	ustring8_reserve(s, s->length + length);
+	memcpy(s->data + s->length, appended, (size_t)length);
+	s->count += ustring8_count(s->data + s->length, length);
+	s->length += length;
+}
+
+void ustring8_append_unicode(ustring8* s, uint32_t unicode) {
+	ustring8_reserve(s, s->length + 4);
+	s->length += ustring_unicode_to_utf8(unicode, s->data + s->length);
+	s->count++;
+}
+
+void ustring8_insert(ustring8* s, ustring8 inserted, int64_t index) {
+	if (index > s->count) return;
+	int64_t offset = ustring8_offset(s, index);
+	uint8_t* copy = 0;
+
+	/* Text from 's' itself moves with the memmove below, insert a copy of it */
+	if (ustring8_aliases(s, inserted.data)) {
+		copy = (uint8_t*)malloc((size_t)inserted.length);
+		memcpy(copy, inserted.data, (size_t)inserted.length);
+		inserted.data = copy;
+	}
+
+	ustring8_reserve(s, s->length + inserted.length);
+	memmove(s->data + offset + inserted.length, s->data + offset, (size_t)(s->length - offset));
+	memcpy(s->data + offset, inserted.data, (size_t)inserted.length);
+	s->length += inserted.length;
+	s->count += inserted.count;
+	ustring8_invalidate_index(s, index);
+	free(copy);
+}
+
+void ustring8_insert_unicode(ustring8* s, uint32_t unicode, int64_t index) {
+	ustring8 in = { 0 };
+	uint8_t encoded[4];
+	in.length = ustring_unicode_to_utf8(unicode, encoded);
+	in.count = 1;
+	in.data = encoded;
+	ustring8_insert(s, in, index);
+}
+
+void ustring8_remove(ustring8* s, int64_t n, int64_t index) {
+	n = USTRING_MIN(n, s->count - index);
+	if (n <= 0) return;
+
+	int64_t start = ustring8_offset(s, index);
+	int64_t end = ustring8_offset(s, index + n);
+	ustring8_reserve(s, s->length);
+	memmove(s->data + start, s->data + end, (size_t)(s->length - end));
+	s->length -= end - start;
+	s->count -= n;
+	ustring8_invalidate_index(s, index);
+}
+
+bool ustring8_equal(ustring8 s1, ustring8 s2) {
+	if (s1.length != s2.length) return USTRING_FALSE;
+	return memcmp(s1.data, s2.data, (size_t)s1.length) == 0;
+}
+
+bool ustring8_equal_cstr(ustring8 s1, const char* s2) {
+	int64_t length = (int64_t)strlen(s2);
+	if (s1.length != length) return USTRING_FALSE;
+	return memcmp(s1.data, s2, (size_t)length) == 0;
+}
+
+/* ustring_gap */
+
+ustring_gap ustring_gap_new(uint64_t allocate) {
+	ustring_gap result;
+
+	if (allocate == 0) allocate = 1;
+
+	result.capacity = (int64_t)allocate;
+	result.gap_start = 0;
+	result.gap_end = (int64_t)allocate;
+	result.data = (uint32_t*)malloc((size_t)allocate * sizeof(uint32_t));
+
+	return result;
+}
+
+ustring_gap ustring_gap_from_ustring(ustring s) {
+	ustring_gap result = ustring_gap_new((uint64_t)s.length * 2);
+	memcpy(result.data, s.data, (size_t)s.length * sizeof(uint32_t));
+	result.gap_start = s.length;
+	return result;
+}
+
+ustring ustring_gap_to_ustring(ustring_gap* g) {
+	int64_t after = g->capacity - g->gap_end;
+	ustring result = ustring_new((uint64_t)(g->gap_start + after));
+	memcpy(result.data, g->data, (size_t)g->gap_start * sizeof(uint32_t));
+	memcpy(result.data + g->gap_start, g->data + g->gap_end, (size_t)after * sizeof(uint32_t));
+	result.length = g->gap_start + after;
+	return result;
+}
+
+void ustring_gap_free(ustring_gap* g) {
+	free(g->data);
+	g->data = 0;
+	g->capacity = 0;
+	g->gap_start = 0;
+	g->gap_end = 0;
+}
+
+int64_t ustring_gap_length(ustring_gap* g) {
+	return g->capacity - (g->gap_end - g->gap_start);
+}
+
+uint32_t ustring_gap_at(ustring_gap* g, int64_t index) {
+	if (index < g->gap_start) return g->data[index];
+	return g->data[index + (g->gap_end - g->gap_start)];
+}
+
+/* Moves the gap so that it starts at 'index' */
+static void ustring_gap_move(ustring_gap* g, int64_t index) {
+	if (index < g->gap_start) {
+		int64_t n = g->gap_start - index;
+		memmove(g->data + g->gap_end - n, g->data + index, (size_t)n * sizeof(uint32_t));
+		g->gap_start -= n;
+		g->gap_end -= n;
+	} else if (index > g->gap_start) {
+		int64_t n = index - g->gap_start;
+		memmove(g->data + g->gap_start, g->data + g->gap_end, (size_t)n * sizeof(uint32_t));
+		g->gap_start += n;
+		g->gap_end += n;
+	}
+}
+
+/* Makes the gap at least 'size' code points long, doubling the capacity */
+static void ustring_gap_reserve(ustring_gap* g, int64_t size) {
+	if (g->gap_end - g->gap_start < size) {
+		int64_t after = g->capacity - g->gap_end;
+		int64_t capacity = g->capacity * 2;
+		if (capacity < ustring_gap_length(g) + size) capacity = ustring_gap_length(g) + size;
+
+		g->data = (uint32_t*)realloc(g->data, (size_t)capacity * sizeof(uint32_t));
+		memmove(g->data + capacity - after, g->data + g->gap_end, (size_t)after * sizeof(uint32_t));
+		g->gap_end = capacity - after;
+		g->capacity = capacity;
+	}
+}
+
+void ustring_gap_insert(ustring_gap* g, ustring inserted, int64_t index) {
+	if (index > ustring_gap_length(g)) return;
+
+	ustring_gap_reserve(g, inserted.length);
+	ustring_gap_move(g, index);
+	memcpy(g->data + g->gap_start, inserted.data, (size_t)inserted.length * sizeof(uint32_t));
+	g->gap_start += inserted.length;
+}
+
+void ustring_gap_insert_unicode(ustring_gap* g, uint32_t unicode, int64_t index) {
+	if (index > ustring_gap_length(g)) return;
+
+	ustring_gap_reserve(g, 1);
+	ustring_gap_move(g, index);
+	g->data[g->gap_start++] = unicode;
+}
+
+void ustring_gap_remove(ustring_gap* g, int64_t n, int64_t index) {
+	n = USTRING_MIN(n, ustring_gap_length(g) - index);
+	if (n <= 0) return;
+
+	/* the removed code points are just absorbed by the gap */
+	ustring_gap_move(g, index);
+	g->gap_end += n;
+}
+
+/* Searching */
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static int ustring_lowest_bit(uint32_t mask) { unsigned long index; _BitScanForward(&index, mask); return (int)index; }
+static int ustring_highest_bit(uint32_t mask) { unsigned long index; _BitScanReverse(&index, mask); return (int)index; }
+#else
+static int ustring_lowest_bit(uint32_t mask) { return __builtin_ctz(mask); }
+static int ustring_highest_bit(uint32_t mask) { return 31 - __builtin_clz(mask); }
+#endif
+
+/* 'at' is a candidate whose first and last code points match, compare what is in between */
+static bool ustring_match_inner(const uint32_t* at, const uint32_t* needle, int64_t length) {
+	return length <= 2 || memcmp(at + 1, needle + 1, (size_t)(length - 2) * sizeof(uint32_t)) == 0;
+}
+
+static bool ustring_utf8_match_inner(const uint8_t* at, const uint8_t* needle, int64_t length) {
+	return length <= 2 || memcmp(at + 1, needle + 1, (size_t)(length - 2)) == 0;
+}
+
+static int64_t ustring_find_from(const uint32_t* s, int64_t length, const uint32_t* needle, int64_t needle_length) {
+	int64_t last = needle_length - 1;
+	int64_t i = 0;
+
+	if (needle_length == 0) return 0;
+	if (needle_length > length) return -1;
+
+#if defined(USTRING_AVX2)
+	{
+		__m256i first_v = _mm256_set1_epi32((int)needle[0]);
+		__m256i last_v = _mm256_set1_epi32((int)needle[last]);
+		for (; i + last + 8 <= length; i += 8) {
+			__m256i a = _mm256_cmpeq_epi32(first_v, _mm256_loadu_si256((const __m256i*)(s + i)));
+			__m256i b = _mm256_cmpeq_epi32(last_v, _mm256_loadu_si256((const __m256i*)(s + i + last)));
+			uint32_t mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(a, b)));
+			while (mask) {
+				int bit = ustring_lowest_bit(mask);
+				if (ustring_match_inner(s + i + bit, needle, needle_length)) return i + bit;
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+#if defined(USTRING_SSE2)
+	{
+		__m128i first_v = _mm_set1_epi32((int)needle[0]);
+		__m128i last_v = _mm_set1_epi32((int)needle[last]);
+		for (; i + last + 4 <= length; i += 4) {
+			__m128i a = _mm_cmpeq_epi32(first_v, _mm_loadu_si128((const __m128i*)(s + i)));
+			__m128i b = _mm_cmpeq_epi32(last_v, _mm_loadu_si128((const __m128i*)(s + i + last)));
+			uint32_t mask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(a, b)));
+			while (mask) {
+				int bit = ustring_lowest_bit(mask);
+				if (ustring_match_inner(s + i + bit, needle, needle_length)) return i + bit;
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+	for (; i + last < length; ++i) {
+		if (s[i] == needle[0] && s[i + last] == needle[last] && ustring_match_inner(s + i, needle, needle_length))
+			return i;
+	}
+	return -1;
+}
+
+int64_t ustring_find(ustring s, ustring needle) {
+	return ustring_find_from(s.data, s.length, needle.data, needle.length);
+}
+
+int64_t ustring_find_unicode(ustring s, uint32_t unicode) {
+	return ustring_find_from(s.data, s.length, &unicode, 1);
+}
+
+int64_t ustring_find_last(ustring s, ustring needle) {
+	int64_t last = needle.length - 1;
+	int64_t i = s.length - needle.length; /* last candidate */
+
+	if (needle.length == 0) return s.length;
+	if (needle.length > s.length) return -1;
+
+#if defined(USTRING_SSE2)
+	{
+		__m128i first_v = _mm_set1_epi32((int)needle.data[0]);
+		__m128i last_v = _mm_set1_epi32((int)needle.data[last]);
+		/* check the candidates [i - 3, i] at once, from the end */
+		for (; i >= 3; i -= 4) {
+			const uint32_t* base = s.data + i - 3;
+			__m128i a = _mm_cmpeq_epi32(first_v, _mm_loadu_si128((const __m128i*)base));
+			__m128i b = _mm_cmpeq_epi32(last_v, _mm_loadu_si128((const __m128i*)(base + last)));
+			uint32_t mask = (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_and_si128(a, b)));
+			while (mask) {
+				int bit = ustring_highest_bit(mask);
+				if (ustring_match_inner(base + bit, needle.data, needle.length)) return i - 3 + bit;
+				mask &= ~(1u << bit);
+			}
+		}
+	}
+#endif
+	for (; i >= 0; --i) {
+		if (s.data[i] == needle.data[0] && s.data[i + last] == needle.data[last] && ustring_match_inner(s.data + i, needle.data, needle.length))
+			return i;
+	}
+	return -1;
+}
+
+int64_t ustring_find_all(ustring s, ustring needle, int64_t* out_indices, int64_t max_count) {
+	int64_t count = 0;
+	int64_t at = 0;
+
+	if (needle.length == 0) return 0;
+
+	while (count < max_count) {
+		int64_t index = ustring_find_from(s.data + at, s.length - at, needle.data, needle.length);
+		if (index < 0) break;
+		out_indices[count++] = at + index;
+		at += index + needle.length;
+	}
+	return count;
+}
+
+bool ustring_split_next(ustring s, uint32_t delimiter, int64_t* at, ustring* out_piece) {
+	int64_t start = *at;
+	int64_t index;
+
+	if (start > s.length) return USTRING_FALSE;
+
+	index = ustring_find_from(s.data + start, s.length - start, &delimiter, 1);
+	if (index < 0) {
+		*out_piece = ustring_substring(s, start, s.length);
+		*at = s.length + 1;
+	} else {
+		*out_piece = ustring_substring(s, start, start + index);
+		*at = start + index + 1;
+	}
+	return USTRING_TRUE;
+}
+
+int64_t ustring_split(ustring s, uint32_t delimiter, ustring* out_pieces, int64_t max_count) {
+	int64_t count = 0;
+	int64_t at = 0;
+	while (count < max_count && ustring_split_next(s, delimiter, &at, out_pieces + count))
+		count++;
+	return count;
+}
+
+static int64_t ustring_utf8_find_from(const uint8_t* text, int64_t length, const uint8_t* needle, int64_t needle_length) {
+	int64_t last = needle_length - 1;
+	int64_t i = 0;
+
+	if (needle_length == 0) return 0;
+	if (needle_length > length) return -1;
+	if (needle_length == 1) {
+		/* the C runtime memchr is already vectorized */
+		const uint8_t* found = (const uint8_t*)memchr(text, needle[0], (size_t)length);
+		return (found) ? found - text : -1;
+	}
+
+#if defined(USTRING_AVX2)
+	{
+		__m256i first_v = _mm256_set1_epi8((char)needle[0]);
+		__m256i last_v = _mm256_set1_epi8((char)needle[last]);
+		for (; i + last + 32 <= length; i += 32) {
+			__m256i a = _mm256_cmpeq_epi8(first_v, _mm256_loadu_si256((const __m256i*)(text + i)));
+			__m256i b = _mm256_cmpeq_epi8(last_v, _mm256_loadu_si256((const __m256i*)(text + i + last)));
+			uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(a, b));
+			while (mask) {
+				int bit = ustring_lowest_bit(mask);
+				if (ustring_utf8_match_inner(text + i + bit, needle, needle_length)) return i + bit;
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+#if defined(USTRING_SSE2)
+	{
+		__m128i first_v = _mm_set1_epi8((char)needle[0]);
+		__m128i last_v = _mm_set1_epi8((char)needle[last]);
+		for (; i + last + 16 <= length; i += 16) {
+			__m128i a = _mm_cmpeq_epi8(first_v, _mm_loadu_si128((const __m128i*)(text + i)));
+			__m128i b = _mm_cmpeq_epi8(last_v, _mm_loadu_si128((const __m128i*)(text + i + last)));
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(a, b));
+			while (mask) {
+				int bit = ustring_lowest_bit(mask);
+				if (ustring_utf8_match_inner(text + i + bit, needle, needle_length)) return i + bit;
+				mask &= mask - 1;
+			}
+		}
+	}
+#endif
+	for (; i + last < length; ++i) {
+		if (text[i] == needle[0] && text[i + last] == needle[last] && ustring_utf8_match_inner(text + i, needle, needle_length))
+			return i;
+	}
+	return -1;
+}
+
+int64_t ustring_utf8_find(const uint8_t* text, int64_t length, const uint8_t* needle, int64_t needle_length) {
+	return ustring_utf8_find_from(text, length, needle, needle_length);
+}
+
+int64_t ustring_utf8_find_last(const uint8_t* text, int64_t length, const uint8_t* needle, int64_t needle_length) {
+	int64_t last = needle_length - 1;
+	int64_t i = length - needle_length; /* last candidate */
+
+	if (needle_length == 0) return length;
+	if (needle_length > length) return -1;
+
+#if defined(USTRING_SSE2)
+	{
+		__m128i first_v = _mm_set1_epi8((char)needle[0]);
+		__m128i last_v = _mm_set1_epi8((char)needle[last]);
+		/* check the candidates [i - 15, i] at once, from the end */
+		for (; i >= 15; i -= 16) {
+			const uint8_t* base = text + i - 15;
+			__m128i a = _mm_cmpeq_epi8(first_v, _mm_loadu_si128((const __m128i*)base));
+			__m128i b = _mm_cmpeq_epi8(last_v, _mm_loadu_si128((const __m128i*)(base + last)));
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(a, b));
+			while (mask) {
+				int bit = ustring_highest_bit(mask);
+				if (ustring_utf8_match_inner(base + bit, needle, needle_length)) return i - 15 + bit;
+				mask &= ~(1u << bit);
+			}
+		}
+	}
+#endif
+	for (; i >= 0; --i) {
+		if (text[i] == needle[0] && text[i + last] == needle[last] && ustring_utf8_match_inner(text + i, needle, needle_length))
+			return i;
+	}
+	return -1;
+}
+
+int64_t ustring_utf8_find_all(const uint8_t* text, int64_t length, const uint8_t* needle, int64_t needle_length, int64_t* out_indices, int64_t max_count) {
+	int64_t count = 0;
+	int64_t at = 0;
+
+	if (needle_length == 0) return 0;
+
+	while (count < max_count) {
+		int64_t index = ustring_utf8_find_from(text + at, length - at, needle, needle_length);
+		if (index < 0) break;
+		out_indices[count++] = at + index;
+		at += index + needle_length;
+	}
+	return count;
+}
+
+bool ustring_utf8_next_line(const uint8_t* text, int64_t length, int64_t* at, const uint8_t** out_line, int64_t* out_line_length) {
+	int64_t start = *at;
+	int64_t end;
+	const uint8_t* newline;
+
+	if (start >= length) return USTRING_FALSE;
+
+	newline = (const uint8_t*)memchr(text + start, '\n', (size_t)(length - start));
+	end = (newline) ? newline - text : length;
+	*at = end + 1;
+
+	if (end > start && text[end - 1] == '\r') end--;
+	*out_line = text + start;
+	*out_line_length = end - start;
+	return USTRING_TRUE;
+}
+
+/* ustring_matcher */
+
+ustring_matcher ustring_matcher_new(const char** needles, const int64_t* needle_lengths, int32_t needle_count) {
+	ustring_matcher m;
+	int64_t max_states = 1;
+	int32_t* fail;
+	int32_t* queue;
+	int32_t head = 0, tail = 0;
+	bool used[256] = { 0 };
+	int32_t classes;
+
+	for (int32_t n = 0; n < needle_count; ++n) {
+		max_states += needle_lengths[n];
+		for (int64_t i = 0; i < needle_lengths[n]; ++i)
+			used[(uint8_t)needles[n][i]] = USTRING_TRUE;
+	}
+
+	/* every needle byte gets its own class, all the others share the last one */
+	m.class_count = 0;
+	for (int c = 0; c < 256; ++c)
+		if (used[c]) m.classes[c] = (uint8_t)m.class_count++;
+	if (m.class_count < 256) {
+		for (int c = 0; c < 256; ++c)
+			if (!used[c]) m.classes[c] = (uint8_t)m.class_count;
+		m.class_count++;
+	}
+	classes = m.class_count;
+
+	m.transitions = (int32_t*)malloc((size_t)max_states * classes * sizeof(int32_t));
+	m.outputs = (int32_t*)malloc((size_t)max_states * sizeof(int32_t));
+	m.lengths = (int64_t*)malloc((size_t)(needle_count + 1) * sizeof(int64_t));
+	m.needle_count = needle_count;
+	m.state_count = 1;
+	memset(m.transitions, 0xff, classes * sizeof(int32_t));
+	m.outputs[0] = -1;
+
+	/* Build the trie, -1 is a missing transition */
+	for (int32_t n = 0; n < needle_count; ++n) {
+		int32_t state = 0;
+		m.lengths[n] = needle_lengths[n];
+		if (needle_lengths[n] == 0) continue;
+
+		for (int64_t i = 0; i < needle_lengths[n]; ++i) {
+			int32_t* next = m.transitions + state * classes + m.classes[(uint8_t)needles[n][i]];
+			if (*next < 0) {
+				*next = m.state_count;
+				memset(m.transitions + (int64_t)m.state_count * classes, 0xff, classes * sizeof(int32_t));
+				m.outputs[m.state_count] = -1;
+				m.state_count++;
+			}
+			state = *next;
+		}
+		/* a state is as deep as its longest match, later duplicates are ignored */
+		if (m.outputs[state] < 0) m.outputs[state] = n;
+	}
+
+	/* Turn the trie into a full automaton in breadth first order, following the fail links */
+	fail = (int32_t*)calloc((size_t)m.state_count, sizeof(int32_t));
+	queue = (int32_t*)malloc((size_t)m.state_count * sizeof(int32_t));
+	for (int32_t c = 0; c < classes; ++c) {
+		int32_t* next = m.transitions + c;
+		if (*next < 0) {
+			*next = 0;
+		} else {
+			fail[*next] = 0;
+			queue[tail++] = *next;
+		}
+	}
+	while (head < tail) {
+		int32_t state = queue[head++];
+		int32_t* row = m.transitions + (int64_t)state * classes;
+		int32_t* fail_row = m.transitions + (int64_t)fail[state] * classes;
+
+		if (m.outputs[state] < 0) m.outputs[state] = m.outputs[fail[state]];
+
+		for (int32_t c = 0; c < classes; ++c) {
+			if (row[c] < 0) {
+				row[c] = fail_row[c];
+			} else {
+				fail[row[c]] = fail_row[c];
+				queue[tail++] = row[c];
+			}
+		}
+	}
+	free(fail);
+	free(queue);
+
+	return m;
+}
+
+void ustring_matcher_free(ustring_matcher* m) {
+	free(m->transitions);
+	free(m->outputs);
+	free(m->lengths);
+	m->transitions = 0;
+	m->outputs = 0;
+	m->lengths = 0;
+	m->state_count = 0;
+	m->needle_count = 0;
+	m->class_count = 0;
+}
+
+int64_t ustring_matcher_find(ustring_matcher* m, const uint8_t* text, int64_t length, int32_t* out_needle) {
+	const int32_t* transitions = m->transitions;
+	const uint8_t* classes = m->classes;
+	int64_t class_count = m->class_count;
+	int32_t state = 0;
+
+	for (int64_t i = 0; i < length; ++i) {
+		state = transitions[state * class_count + classes[text[i]]];
+		if (m->outputs[state] >= 0) {
+			int32_t needle = m->outputs[state];
+			if (out_needle) *out_needle = needle;
+			return i - m->lengths[needle] + 1;
+		}
+	}
+	return -1;
+}
+
+/* ustring_interner */
+
+#define USTRING_INTERN_INITIAL_SLOTS 256
+
+static uint64_t ustring_intern_hash(const char* s, int64_t length) {
+	/* FNV-1a */
+	uint64_t hash = 14695981039346656037ULL;
+	for (int64_t i = 0; i < length; ++i) {
+		hash ^= (uint8_t)s[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+ustring_interner ustring_interner_new(void) {
+	ustring_interner result;
+	memset(&result, 0, sizeof(result));
+
+	result.entry_capacity = 64;
+	result.entry_count = 1; /* handle 0 is the invalid handle */
+	result.entries = (ustring_intern_entry*)calloc(result.entry_capacity, sizeof(ustring_intern_entry));
+	result.slot_count = USTRING_INTERN_INITIAL_SLOTS;
+	result.slots = (ustring_handle*)calloc(result.slot_count, sizeof(ustring_handle));
+
+	return result;
+}
+
+void ustring_interner_free(ustring_interner* interner) {
+	char* block = interner->block;
+	while (block) {
+		char* previous = *(char**)block;
+		free(block);
+		block = previous;
+	}
+	free(interner->entries);
+	free(interner->slots);
+	free(interner->scratch);
+	memset(interner, 0, sizeof(*interner));
+}
+
+static ustring_handle* ustring_intern_slot(ustring_interner* interner, const char* s, int64_t length, uint64_t hash) {
+	uint32_t mask = interner->slot_count - 1;
+	uint32_t index = (uint32_t)hash & mask;
+
+	for (;;) {
+		ustring_handle* slot = interner->slots + index;
+		if (*slot == 0) return slot;
+
+		ustring_intern_entry* entry = interner->entries + *slot;
+		/* 's' can be null for an empty string, memcmp and memcpy must not be given it */
+		if (entry->hash == hash && entry->length == length && (length == 0 || memcmp(entry->data, s, (size_t)length) == 0))
+			return slot;
+		index = (index + 1) & mask;
+	}
+}
+
+static void ustring_intern_grow(ustring_interner* interner) {
+	uint32_t slot_count = interner->slot_count * 2;
+	uint32_t mask = slot_count - 1;
+	ustring_handle* slots = (ustring_handle*)calloc(slot_count, sizeof(ustring_handle));
+
+	/* the hashes are stored, so rehashing doesn't touch the strings */
+	for (uint32_t handle = 1; handle < interner->entry_count; ++handle) {
+		uint32_t index = (uint32_t)interner->entries[handle].hash & mask;
+		while (slots[index] != 0) index = (index + 1) & mask;
+		slots[index] = handle;
+	}
+
+	free(interner->slots);
+	interner->slots = slots;
+	interner->slot_count = slot_count;
+}
+
+static const char* ustring_intern_store(ustring_interner* interner, const char* s, int64_t length) {
+	int64_t size = length + 1;
+	char* result;
+
+	if (!interner->block || interner->block_used + size > interner->block_size) {
+		int64_t block_size = USTRING_INTERN_BLOCK_SIZE;
+		if (block_size < size + (int64_t)sizeof(char*)) block_size = size + (int64_t)sizeof(char*);
+
+		char* block = (char*)malloc((size_t)block_size);
+		*(char**)block = interner->block;
+		interner->block = block;
+		interner->block_used = sizeof(char*);
+		interner->block_size = block_size;
+	}
+
+	result = interner->block + interner->block_used;
+	if (length > 0) memcpy(result, s, (size_t)length);
+	result[length] = 0;
+	interner->block_used += size;
+
+	return result;
+}
+
+ustring_handle ustring_intern_find(ustring_interner* interner, const char* s, int64_t length_bytes) {
+	uint64_t hash = ustring_intern_hash(s, length_bytes);
+	return *ustring_intern_slot(interner, s, length_bytes, hash);
+}
+
+ustring_handle ustring_intern_len(ustring_interner* interner, const char* s, int64_t length_bytes) {
+	uint64_t hash = ustring_intern_hash(s, length_bytes);
+	ustring_handle* slot = ustring_intern_slot(interner, s, length_bytes, hash);
+
+	if (*slot == 0) {
+		ustring_intern_entry* entry;
+
+		/* keep the table at most 70% full */
+		if ((uint64_t)interner->entry_count * 10 >= (uint64_t)interner->slot_count * 7) {
+			ustring_intern_grow(interner);
+			slot = ustring_intern_slot(interner, s, length_bytes, hash);
+		}
+		if (interner->entry_count == interner->entry_capacity) {
+			interner->entry_capacity *= 2;
+			interner->entries = (ustring_intern_entry*)realloc(interner->entries, interner->entry_capacity * sizeof(ustring_intern_entry));
+		}
+
+		entry = interner->entries + interner->entry_count;
+		entry->hash = hash;
+		entry->length = length_bytes;
+		entry->data = ustring_intern_store(interner, s, length_bytes);
+		*slot = interner->entry_count++;
+	}
+
+	return *slot;
+}
+
+ustring_handle ustring_intern_cstr(ustring_interner* interner, const char* s) {
+	return ustring_intern_len(interner, s, (int64_t)strlen(s));
+}
+
+ustring_handle ustring_intern(ustring_interner* interner, ustring s) {
+	int64_t size = s.length * (int64_t)sizeof(uint32_t);
+	if (interner->scratch_size < size) {
+		interner->scratch = (uint8_t*)realloc(interner->scratch, (size_t)size);
+		interner->scratch_size = size;
+	}
+	int64_t length = ustring_utf32_to_utf8(s.data, s.length, interner->scratch);
+	return ustring_intern_len(interner, (const char*)interner->scratch, length);
+}
+
+const char* ustring_intern_get(ustring_interner* interner, ustring_handle handle, int64_t* out_length_bytes) {
+	if (handle == 0 || handle >= interner->entry_count) return 0;
+	if (out_length_bytes) *out_length_bytes = interner->entries[handle].length;
+	return interner->entries[handle].data;
 }
 #endif /* USTRING_IMPLEMENT */
 #endif /* H_USTRING */
\ No newline at end of file